@@ -0,0 +1,178 @@
+/**
+ * @file config.c
+ * @author David Ng 550084
+ * @brief This component is responsible for the node configuration persisted in EEPROM, so that the device boots into operation without user input. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../hostlink/hostlink.h"
+#include "config.h"
+#include "../layer2/rate_limit.h"
+
+extern int ADDRESS;
+extern int sendSpeed;
+extern int operatingMode;
+extern unsigned int msgWaitingPeriod;
+extern unsigned int receiveTimeoutPeriods;
+extern unsigned char receiveMaxLength;
+extern unsigned char sendQueueLimit;
+extern unsigned char forwardQueueLimit;
+extern unsigned int rateLimit;
+extern unsigned char rateBurst;
+extern unsigned char rateAimdThreshold;
+
+struct node_config EEMEM eepromConfig; ///< This is the configuration in EEPROM. 
+
+/**
+ * @brief This function copies the current settings into a node_config and calculates its checksum. 
+ * @param config The instance of node_config to fill. 
+ */
+void configCollect(struct node_config *config)
+{
+    config->version = CONFIG_VERSION;
+    config->address = ADDRESS;
+    config->speed = sendSpeed;
+    config->operatingMode = operatingMode == MODE_BINARY ? MODE_BINARY : MODE_CONSOLE;
+    config->msgWaitingPeriod = msgWaitingPeriod;
+    config->receiveTimeoutPeriods = receiveTimeoutPeriods;
+    config->receiveMaxLength = receiveMaxLength;
+    config->sendQueueLimit = sendQueueLimit;
+    config->forwardQueueLimit = forwardQueueLimit;
+    config->rateLimit = rateLimit;
+    config->rateBurst = rateBurst;
+    config->rateAimdThreshold = rateAimdThreshold;
+    config->checksum = calculateCRC8((unsigned char*)config, sizeof(struct node_config) - 1);
+}
+
+/**
+ * The configuration is only applied when its version and checksum match and every value is in range. <br>
+ * The operating mode is not applied here, as UART and transport layer are not initialised yet. 
+ * @brief This function reads the configuration from EEPROM and applies it. 
+ * @return The stored operating mode if the configuration is applied, otherwise -1. 
+ */
+int configLoad()
+{
+    struct node_config config;
+    eeprom_read_block(&config, &eepromConfig, sizeof(struct node_config));
+    if (config.version != CONFIG_VERSION || calculateCRC8((unsigned char*)&config, sizeof(struct node_config) - 1) != config.checksum)
+        return -1;
+    if (config.address == 0 || isMulticast(config.address) || config.address == PING_ADDRESS || config.speed < 1 || config.speed > 5 || !config.msgWaitingPeriod || config.msgWaitingPeriod > CONFIG_TIMEOUT_MAX || !config.receiveTimeoutPeriods || config.receiveMaxLength < 2 || !config.rateBurst)
+        return -1;
+    ADDRESS = config.address;
+    sendSpeed = config.speed;
+    msgWaitingPeriod = config.msgWaitingPeriod;
+    receiveTimeoutPeriods = config.receiveTimeoutPeriods;
+    receiveMaxLength = config.receiveMaxLength;
+    sendQueueLimit = config.sendQueueLimit;
+    forwardQueueLimit = config.forwardQueueLimit;
+    rateLimit = config.rateLimit;
+    rateBurst = config.rateBurst;
+    rateAimdThreshold = config.rateAimdThreshold;
+    return config.operatingMode;
+}
+
+/**
+ * Only bytes that differ are written, in order to spare the EEPROM. 
+ * @brief This function writes the current settings to EEPROM. 
+ */
+void configSave()
+{
+    struct node_config config;
+    configCollect(&config);
+    eeprom_update_block(&config, &eepromConfig, sizeof(struct node_config));
+}
+
+/**
+ * @brief This function invalidates the configuration in EEPROM, so that the user is asked for the speed at next startup. 
+ */
+void configErase()
+{
+    eeprom_update_byte(&eepromConfig.version, 0xFF);
+}
+
+/**
+ * The setting takes effect at once. Keys are address, speed, timeout, rxtimeout, maxlength, sendqueue, forwardqueue, rate, burst, aimd and mode. 
+ * @brief This function changes a setting by its name. 
+ * @param key The name of the setting. 
+ * @param value The new value. 
+ * @return 1 if the setting has been changed, 0 if the key is unknown or the value is out of range. 
+ */
+int configSet(char *key, long value)
+{
+    if (strcmp(key, "address") == 0 && value > 0 && value < 256 && !isMulticast(value) && value != PING_ADDRESS)
+        ADDRESS = value;
+    else if (strcmp(key, "speed") == 0 && value >= 1 && value <= 5)
+    {
+        sendSpeed = value;
+        timeInterruptInit(value);
+    }
+    else if (strcmp(key, "timeout") == 0 && value > 0 && value <= CONFIG_TIMEOUT_MAX)
+        msgWaitingPeriod = value;
+    else if (strcmp(key, "rxtimeout") == 0 && value > 0 && value <= 0xFFFF)
+        receiveTimeoutPeriods = value;
+    else if (strcmp(key, "maxlength") == 0 && value >= 2 && value <= 255)
+        receiveMaxLength = value;
+    else if (strcmp(key, "sendqueue") == 0 && value > 0 && value <= 255)
+        sendQueueLimit = value;
+    else if (strcmp(key, "forwardqueue") == 0 && value > 0 && value <= 255)
+        forwardQueueLimit = value;
+    else if (strcmp(key, "rate") == 0 && value >= 0 && value <= 0xFFFF)
+    {
+        rateLimit = value;
+        rateReset();
+    }
+    else if (strcmp(key, "burst") == 0 && value > 0 && value <= 255)
+    {
+        rateBurst = value;
+        rateReset();
+    }
+    else if (strcmp(key, "aimd") == 0 && value >= 0 && value <= 255)
+        rateAimdThreshold = value;
+    else if (strcmp(key, "mode") == 0 && (value == MODE_CONSOLE || value == MODE_BINARY))
+    {
+        if (value == MODE_BINARY)
+            hostlinkStart();
+    }
+    else
+        return 0;
+    return 1;
+}
+
+/**
+ * @brief This function prints the current settings and whether a valid configuration is stored in EEPROM. 
+ */
+void configPrint()
+{
+    struct node_config stored;
+    eeprom_read_block(&stored, &eepromConfig, sizeof(struct node_config));
+    int valid = stored.version == CONFIG_VERSION && calculateCRC8((unsigned char*)&stored, sizeof(struct node_config) - 1) == stored.checksum;
+    printf("address %d speed %d timeout %u rxtimeout %u maxlength %u\r\n", ADDRESS, sendSpeed, msgWaitingPeriod, receiveTimeoutPeriods, receiveMaxLength);
+    printf("sendqueue %u forwardqueue %u rate %u burst %u aimd %u mode %d\r\n", sendQueueLimit, forwardQueueLimit, rateLimit, rateBurst, rateAimdThreshold, operatingMode);
+    printf("EEPROM: %s\r\n", valid ? "valid" : "empty");
+}
@@ -0,0 +1,36 @@
+#define CONFIG_VERSION 2 ///< This is the version of the layout of node_config. A stored configuration of another version is ignored. 
+#define CONFIG_TIMEOUT_MAX 0x3FFF ///< This is the longest accepted msgWaitingPeriod, so that the reassembly and stream time-outs of 4 times it still fit the 16-bit period difference. 
+
+//! This structure is the node configuration as stored in EEPROM. 
+/**
+ * The layout is versioned by CONFIG_VERSION and protected by a CRC-8 over all preceding bytes, so that an erased or outdated EEPROM is never applied. <br>
+ * Multi-byte fields are stored in little endian. 
+*/
+struct node_config
+{
+    uint8_t version; ///< This is the version of the layout, CONFIG_VERSION. 
+    uint8_t address; ///< This denotes the address of the device. 
+    uint8_t speed; ///< This denotes the transmission speed from 1 to 5. 
+    uint8_t operatingMode; ///< This denotes the operating mode at startup. 
+    uint16_t msgWaitingPeriod; ///< This denotes the time-out of messages waiting for ACK in periods. 
+    uint16_t receiveTimeoutPeriods; ///< This denotes the time-out of a stalled received packet in periods. 
+    uint8_t receiveMaxLength; ///< This denotes the longest accepted payload. 
+    uint8_t sendQueueLimit; ///< This denotes the most packets in send queue. 
+    uint8_t forwardQueueLimit; ///< This denotes the most packets in forward queue. 
+    uint16_t rateLimit; ///< This denotes the rate of originated packets in bytes per second, 0 for no limit. 
+    uint8_t rateBurst; ///< This denotes the burst size of originated packets in bytes. 
+    uint8_t rateAimdThreshold; ///< This denotes the forward queue depth that cuts the rate in AIMD mode, 0 for AIMD off. 
+    uint8_t checksum; ///< This is the CRC-8 over all preceding bytes. 
+};
+
+void configCollect(struct node_config *config);
+
+int configLoad();
+
+void configSave();
+
+void configErase();
+
+int configSet(char *key, long value);
+
+void configPrint();
@@ -0,0 +1,256 @@
+/**
+ * @file console.c
+ * @author David Ng 550084
+ * @brief This component is responsible for processing console commands typed by the user
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../profiler/profiler.h"
+#include "../memory/memory.h"
+#include "../hostlink/hostlink.h"
+#include "console.h"
+#include "../layer4/transport_struct.h"
+#include "../layer4/stream.h"
+#include "../layer4/credit.h"
+#include "../layer2/rate_limit.h"
+#include "../trace/trace.h"
+#include "../config/config.h"
+#include "../scheduler/scheduler.h"
+#include "../traffic/traffic.h"
+#include "../layer4/port.h"
+#include "../ping/ping.h"
+
+extern uint16_t multicastGroups;
+extern struct ping_run pingRun;
+
+unsigned char consoleBuffer[CONSOLE_BUFFER_LENGTH]; ///< This is the buffer of the line being typed. 
+int consoleIndex = 0; ///< This denotes the number of characters in consoleBuffer. 
+int consoleInputMode = 0; ///< This denotes which line is being typed: 0 is target address or command, 1 is type of message, 2 is message. 
+int consoleAddress = 0; ///< This is the target address typed for the message. 
+int consoleType = 0; ///< This is the type of message typed for the message. 
+
+/**
+ * Firstly the user should type the address of the receiver, or a console command, and press ENTER. <br>
+ * Then the user should type the type of the message and press ENTER, and finally the message and press ENTER. After that, initiateSend function on transport layer will be invoked to start the sending procedures. <br>
+ * Characters beyond the length of consoleBuffer are ignored. 
+ * @brief This function processes a character typed at the console. 
+ * @param c The character received from UART. 
+ */
+void consoleReceiveChar(unsigned char c)
+{
+    if (c == '\r')
+    {
+        consoleBuffer[consoleIndex] = '\0';
+        if (consoleInputMode == 2) // when accepting message body
+        {
+            unsigned char *message = memoryMalloc(MEMORY_MAIN, consoleIndex + 1); // kept by transport layer until ACK
+            if (message == NULL)
+                printf("Not enough memory to send\r\n");
+            else
+            {
+                memcpy(message, consoleBuffer, consoleIndex + 1);
+                int id = initiateSend(consoleAddress, consoleType, message, consoleIndex + 1);
+                if (id == TRANSPORT_ERROR_TABLE_FULL)
+                    printf("Too many messages waiting for ACK, try again later\r\n");
+                else if (id == TRANSPORT_ERROR_NO_CREDIT)
+                    printf("Node %d has no credit, try again later\r\n", consoleAddress);
+                else if (id == TRANSPORT_ERROR_NO_MEMORY)
+                    printf("Not enough memory to send\r\n");
+                if (id < 0)
+                    memoryFree(message);
+            }
+            consoleInputMode = 0;
+        }
+        else if (consoleInputMode == 1) // when accepting type of message (flag in transport layer)
+        {
+            consoleType = strtol((char*)consoleBuffer, NULL, 0);
+            consoleInputMode = 2;
+        }
+        else if (consoleBuffer[0] == '/') // when a console command is typed instead of address
+            consoleCommand(consoleBuffer);
+        else // when accepting address of recipient
+        {
+            consoleAddress = strtol((char*)consoleBuffer, NULL, 0);
+            consoleInputMode = 1;
+        }
+        consoleIndex = 0;
+    }
+    else if (c == '\b') // Remove one character from buffer when "backspace" is taped
+    {
+        if (consoleIndex)
+            consoleIndex--;
+    }
+    else if (consoleIndex < CONSOLE_BUFFER_LENGTH - 1) // keep space for the terminating character
+        consoleBuffer[consoleIndex++] = c;
+}
+
+/**
+ * A console command is a line starting with '/' typed in place of the destination address. <br>
+ * The command word is followed by optional arguments separated by spaces. Supported commands are: <br>
+ * /stats [r] prints the statistics as text, r resets the counters after reading. <br>
+ * /statsbin [r] prints the statistics as binary snapshot, r resets the counters after reading. <br>
+ * /prof [r] prints the interrupt timing records of the profiling build, r resets the records after reading. <br>
+ * /mem prints heap usage, stack high-water mark, and allocation totals of each subsystem. <br>
+ * /bin switches to the binary host protocol. <br>
+ * /join &lt;group&gt; and /leave &lt;group&gt; join or leave a multicast group from 0 to 15, /groups prints the joined groups. <br>
+ * /cfg prints the configuration, /cfg &lt;key&gt; &lt;value&gt; changes a setting, /cfg save writes the settings to EEPROM, and /cfg erase removes them from EEPROM. <br>
+ * /stream &lt;address&gt; &lt;bytes&gt; sends the given number of bytes following on UART to another node, paced with XON and XOFF. <br>
+ * /credit prints the credit advertised by other nodes and the credit this device can give. <br>
+ * /rate prints the configured and current rate of packets originated by this device. <br>
+ * /bench <address> <packets> <size>[-<max size>] [<bytes per second>] [d] starts a benchmark run, d for datagrams. /bench prints the results so far, and /bench stop ends the run. <br>
+ * /ping [&lt;probes&gt;] sends probes around the ring and reports the round trip and the time spent in each node. /ping without a number during a run prints the results so far. <br>
+ * /port prints the registered ports, /port &lt;port&gt; o opens an inbox for the messages of a flag, /port &lt;port&gt; r takes the oldest message from it, and /port &lt;port&gt; c closes it. <br>
+ * /tasks [r] prints the run count, run time and share of each task of the main loop and the time slept, r resets the accounting after reading. <br>
+ * /trace dumps the bit capture of the trace build, /trace t triggers the capture, and /trace r dumps it and arms the capture again. 
+ * @brief This function processes a console command. 
+ * @param line The null-terminated command line, including the leading '/'. 
+ */
+void consoleCommand(unsigned char *line)
+{
+    char *command = strtok((char*)line + 1, " ");
+    char *argument = strtok(NULL, " ");
+    int reset = argument != NULL && argument[0] == 'r';
+    if (command == NULL)
+        return;
+    if (strcmp(command, "stats") == 0)
+        statsPrintText(reset);
+    else if (strcmp(command, "statsbin") == 0)
+        statsPrintBinary(reset);
+    else if (strcmp(command, "bin") == 0)
+        hostlinkStart();
+    else if (strcmp(command, "join") == 0 && argument != NULL)
+        multicastJoin(strtol(argument, NULL, 0));
+    else if (strcmp(command, "leave") == 0 && argument != NULL)
+        multicastLeave(strtol(argument, NULL, 0));
+    else if (strcmp(command, "groups") == 0)
+    {
+        for (unsigned char i = 0; i < MULTICAST_GROUPS; i++)
+            if ((multicastGroups >> i) & 1)
+                printf("Group %d (address %d)\r\n", i, MULTICAST_FIRST + i);
+    }
+    else if (strcmp(command, "cfg") == 0)
+    {
+        char *value = strtok(NULL, " ");
+        if (argument == NULL)
+            configPrint();
+        else if (strcmp(argument, "save") == 0)
+            configSave();
+        else if (strcmp(argument, "erase") == 0)
+            configErase();
+        else if (value == NULL || !configSet(argument, strtol(value, NULL, 0)))
+            printf("Invalid setting: %s\r\n", argument);
+    }
+    else if (strcmp(command, "stream") == 0)
+    {
+        char *length = strtok(NULL, " ");
+        streamStart(argument ? strtol(argument, NULL, 0) : 0, length ? strtoul(length, NULL, 0) : 0);
+    }
+    else if (strcmp(command, "mem") == 0)
+        memoryPrint();
+    else if (strcmp(command, "credit") == 0)
+        creditPrint();
+    else if (strcmp(command, "rate") == 0)
+        ratePrint();
+    else if (strcmp(command, "bench") == 0)
+    {
+        if (argument == NULL)
+            trafficReport();
+        else if (strcmp(argument, "stop") == 0)
+            trafficStop();
+        else
+        {
+            char *packets = strtok(NULL, " ");
+            char *size = strtok(NULL, " ");
+            char *option;
+            char *end = NULL;
+            long minSize = size ? strtol(size, &end, 0) : 0;
+            long maxSize = end != NULL && *end == '-' ? strtol(end + 1, NULL, 0) : minSize;
+            unsigned int rate = 0;
+            unsigned char datagram = 0;
+            while ((option = strtok(NULL, " ")) != NULL)
+            {
+                if (option[0] == 'd')
+                    datagram = 1;
+                else
+                    rate = strtoul(option, NULL, 0);
+            }
+            trafficStart(strtol(argument, NULL, 0), packets ? strtoul(packets, NULL, 0) : 0, minSize, maxSize, rate, datagram);
+        }
+    }
+    else if (strcmp(command, "ping") == 0)
+    {
+        if (argument == NULL && pingRun.active)
+            pingReport();
+        else
+            pingStart(argument ? strtoul(argument, NULL, 0) : 0);
+    }
+    else if (strcmp(command, "port") == 0)
+    {
+        char *option = strtok(NULL, " ");
+        unsigned char port = argument ? strtoul(argument, NULL, 0) : 0;
+        struct port_message message;
+        if (argument == NULL || option == NULL)
+            portPrint();
+        else if (option[0] == 'o' && !portRegister(port, NULL))
+            printf("Port table full\r\n");
+        else if (option[0] == 'r')
+        {
+            if (portReceive(port, &message))
+            {
+                printf("Port %u from %u: %.*s\r\n", port, message.source, message.length, message.data);
+                portDone(&message);
+            }
+            else
+                printf("Inbox of port %u empty\r\n", port);
+        }
+        else if (option[0] == 'c')
+            portUnregister(port);
+    }
+    else if (strcmp(command, "tasks") == 0)
+        schedulerPrint(reset);
+    else if (strcmp(command, "trace") == 0)
+#ifdef TRACE_CAPTURE
+    {
+        if (argument != NULL && argument[0] == 't')
+            traceTrigger(TRACE_TRIGGER_MANUAL);
+        else
+            traceDump(reset);
+    }
+#else
+        printf("Trace capture is not enabled in this build\r\n");
+#endif
+    else if (strcmp(command, "prof") == 0)
+#ifdef PROFILE_ISR
+        profilerPrint(reset);
+#else
+        printf("Profiling is not enabled in this build\r\n");
+#endif
+    else
+        printf("Unknown command: %s\r\n", command);
+}
@@ -0,0 +1,5 @@
+#define CONSOLE_BUFFER_LENGTH 128 ///< This denotes the size of the buffer of a typed line, including the terminating character. 
+
+void consoleReceiveChar(unsigned char c);
+
+void consoleCommand(unsigned char *line);
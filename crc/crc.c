@@ -41,11 +41,10 @@ const int CRCVal = 32;
  */
 void printCRCByByte(unsigned long crcValue)
 {
-	uint32_t crc = 0, generator = 0x4C11DB7;
 		printf("CRC: ");
 		int i;
 		for (i = 0; i < 4; i++)
-			printf("%X ", crcValue >> (24 - i * 8) & 0xFF);
+			printf("%X ", (unsigned int)(crcValue >> (24 - i * 8) & 0xFF));
 		printf("\r\n");
 }
 
@@ -76,3 +75,69 @@ unsigned long calculateCRC(unsigned char *payload, unsigned char length)
 	}
 	return crc & 0xFFFFFFFF;
 }
+
+/// This method calculates the CRC-16 of short payloads.
+/**
+ * The generator polynomial is 0x1021 with initial value 0xFFFF (CRC-16/CCITT-FALSE), computed bitwise in the same way as calculateCRC.
+ * @param payload This is the payload data for calculation.
+ * @param length This is the length of the payload data.
+ * @return The CRC Value in unsigned int.
+ *
+ */
+unsigned int calculateCRC16(unsigned char *payload, unsigned char length)
+{
+	unsigned int crc = 0xFFFF, generator = 0x1021;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		crc ^= ((unsigned int)payload[i]) << 8;
+		int j;
+		for (j = 0; j < 8; j++)
+		{
+			if (crc & 0x8000)
+				crc = (unsigned int)((crc << 1) ^ generator);
+			else
+				crc <<= 1;
+		}
+	}
+	return crc & 0xFFFF;
+}
+
+/// This method updates a CRC-8 with one more byte.
+/**
+ * The generator polynomial is 0x07 (CRC-8/SMBUS), computed bitwise in the same way as calculateCRC.
+ * @param crc This is the CRC-8 of the preceding bytes, 0 for the first byte.
+ * @param byte This is the byte to add.
+ * @return The CRC Value in unsigned char.
+ *
+ */
+unsigned char calculateCRC8Update(unsigned char crc, unsigned char byte)
+{
+	unsigned char generator = 0x07;
+	crc ^= byte;
+	int j;
+	for (j = 0; j < 8; j++)
+	{
+		if (crc & 0x80)
+			crc = (unsigned char)((crc << 1) ^ generator);
+		else
+			crc <<= 1;
+	}
+	return crc;
+}
+
+/// This method calculates the CRC-8 used to protect the packet header.
+/**
+ * @param data This is the data for calculation.
+ * @param length This is the length of the data.
+ * @return The CRC Value in unsigned char.
+ *
+ */
+unsigned char calculateCRC8(unsigned char *data, unsigned char length)
+{
+	unsigned char crc = 0;
+	int i;
+	for (i = 0; i < length; i++)
+		crc = calculateCRC8Update(crc, data[i]);
+	return crc;
+}
@@ -4,6 +4,15 @@ void printCRCByByte(unsigned long crcValue);
 
 
 unsigned long calculateCRC(unsigned char *payload, unsigned char length);
+
+
+unsigned int calculateCRC16(unsigned char *payload, unsigned char length);
+
+
+unsigned char calculateCRC8Update(unsigned char crc, unsigned char byte);
+
+
+unsigned char calculateCRC8(unsigned char *data, unsigned char length);
 /*
 int calculateCRC(unsigned char *payload, int length);
 */
@@ -0,0 +1,123 @@
+/**
+ * @file inflight_bench.c
+ * @author David Ng 550084
+ * @brief This program measures on the host the cost of taking and releasing slots of the in-flight table, compared with the former array of 256 pointers. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ * Build and run with "make bench". The figures are host nanoseconds and only compare the 2 methods with each other. 
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../../layer4/transport_struct.h"
+#include "../../layer4/inflight.h"
+
+#define ROUNDS 200000 ///< This denotes how many times the table is filled and emptied. 
+
+extern struct inflight_table inflight;
+
+/// This structure is the former transport_node, which was allocated on heap for every sent message. 
+struct legacy_node
+{
+    unsigned int sentPeriodStamp;
+    int length;
+    unsigned char flag;
+    unsigned char *msg;
+    unsigned char destination;
+};
+
+struct legacy_node *legacyCache[256]; ///< This is the former array of 256 pointers. 
+int legacyNextSlot = 0; ///< This is the former nextAvailableSlot. 
+
+/**
+ * @brief This function finds the next free slot by a linear scan, as the former updateCacheArrIndex. 
+ */
+void legacyUpdateIndex()
+{
+    int oldValue = legacyNextSlot;
+    while (legacyCache[legacyNextSlot] != NULL)
+    {
+        legacyNextSlot = (legacyNextSlot + 1) & 0xFF;
+        if (oldValue == legacyNextSlot)
+            return;
+    }
+}
+
+/**
+ * @brief This function returns the current time in nanoseconds. 
+ * @return The time in nanoseconds. 
+ */
+double now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/**
+ * Each round takes `outstanding` slots and releases them in an order shifted by the round number, so that released slots are scattered. 
+ * @brief This function measures the in-flight table. 
+ * @param outstanding The number of messages waiting for ACK at the same time. 
+ * @return The time per pair of take and release in nanoseconds. 
+ */
+double benchInflight(int outstanding)
+{
+    int slots[128];
+    volatile int sink = 0;
+    inflightInit();
+    double start = now();
+    for (long round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < outstanding; i++)
+            slots[i] = inflightAlloc();
+        for (int i = 0; i < outstanding; i++)
+        {
+            int slot = slots[(i + round) % outstanding];
+            sink += inflightFind(inflight.id[slot]);
+            inflightFree(slot);
+        }
+    }
+    return (now() - start) / ROUNDS / outstanding;
+}
+
+/**
+ * @brief This function measures the former array of 256 pointers with a heap node per message. 
+ * @param outstanding The number of messages waiting for ACK at the same time. 
+ * @return The time per pair of take and release in nanoseconds. 
+ */
+double benchLegacy(int outstanding)
+{
+    int slots[128];
+    volatile int sink = 0;
+    double start = now();
+    for (long round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < outstanding; i++)
+        {
+            slots[i] = legacyNextSlot;
+            legacyCache[legacyNextSlot] = malloc(sizeof(struct legacy_node));
+            legacyUpdateIndex();
+        }
+        for (int i = 0; i < outstanding; i++)
+        {
+            int slot = slots[(i + round) % outstanding];
+            sink += legacyCache[slot] != NULL;
+            free(legacyCache[slot]);
+            legacyCache[slot] = NULL;
+        }
+    }
+    return (now() - start) / ROUNDS / outstanding;
+}
+
+int main(void)
+{
+    // on AVR, int and pointers take 2 bytes and malloc keeps 2 bytes of size per block
+    printf("Table of %d slots on AVR: %d bytes, former array: 512 bytes plus 10 bytes of heap per message\n", TRANSPORT_MAX_OUTSTANDING, TRANSPORT_MAX_OUTSTANDING * 13 + 2 * TRANSPORT_MAX_OUTSTANDING / 8);
+    printf("outstanding  inflight ns  former ns\n");
+    for (int outstanding = 1; outstanding <= TRANSPORT_MAX_OUTSTANDING; outstanding *= 2)
+        printf("%11d  %11.1f  %9.1f\n", outstanding, benchInflight(outstanding), benchLegacy(outstanding));
+    return 0;
+}
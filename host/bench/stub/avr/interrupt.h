@@ -0,0 +1,3 @@
+// Host stand-in for <avr/interrupt.h>.
+#define sei()
+#define cli()
@@ -0,0 +1 @@
+// Host stand-in for <avr/io.h>, only what inflight.c needs to compile on the host.
@@ -0,0 +1,4 @@
+// Host stand-in for <util/atomic.h>, the benchmark is single threaded.
+#define ATOMIC_BLOCK(type) for (int atomicOnce = 1; atomicOnce; atomicOnce = 0)
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
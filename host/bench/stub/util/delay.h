@@ -0,0 +1,2 @@
+// Host stand-in for <util/delay.h>.
+#define _delay_ms(ms)
@@ -0,0 +1 @@
+// Host stand-in for <util/setbaud.h>.
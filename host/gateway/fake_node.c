@@ -0,0 +1,533 @@
+/**
+ * @file fake_node.c
+ * @author David Ng 550084
+ * @brief This program stands in for a node on a pseudo-terminal, so that the gateway can be tried without a board. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ * Build with "make gateway" and run "host/gateway/fake_node [-l link] [-a address] [-d event delay in ms] [-x absent address] [-r reset period in s] [-m message period in ms] [-e every nth frame corrupted] [-c] [-u]", then "host/gateway/gateway -d /tmp/raspnet-tty". <br>
+ * The node speaks the binary host protocol like hostlink.c, or starts at the console with -c, where only /bin is understood. <br>
+ * Messages are ACKed after the event delay, unless they are sent to the absent address, which fails. Messages to the own address are received as well. At most TRANSPORT_MAX_OUTSTANDING messages wait for ACK, further send requests are answered with busy. <br>
+ * With -r, the node is reset periodically and sends a ready event if it starts in binary operating mode. With -u as well, the pseudo-terminal is closed and opened again like a USB serial adapter, so that the gateway has to reconnect. With -m, a message from node 7 with flag 3 is received periodically. With -e, every nth request is treated as if its checksum had failed. 
+ */
+
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "../../crc/crc.h"
+#include "../../hostlink/hostlink.h"
+#include "../../stats/stats.h"
+#include "../../layer3/network.h"
+#include "../../layer4/transport_struct.h"
+
+#define FAKE_LINK "/tmp/raspnet-tty" ///< This is the symbolic link to the pseudo-terminal by default. 
+#define FAKE_EVENTS 256 ///< This denotes how many events may wait to be sent. 
+#define FAKE_FRAME_MAX 1024 ///< This denotes the longest frame written to the gateway. 
+
+//! This structure is an event that is sent to the gateway when it is due.
+struct fake_event
+{
+    long long due; ///< This is the time at which the event is sent, 0 if the entry is free. 
+    unsigned char type; ///< This is the event type, one of the HOSTLINK_EVENT definitions. 
+    unsigned char address; ///< This is the first byte of the event body. 
+    unsigned char value; ///< This is the second byte of the event body. 
+    int length; ///< This denotes the length of data, or -1 for an event body of only 1 byte. 
+    unsigned char *data; ///< This is the remaining body. 
+    unsigned char outstanding; ///< This flag denotes that the event ends a message waiting for ACK. 
+};
+
+struct fake_event events[FAKE_EVENTS]; ///< These are the events waiting to be sent. 
+struct statistics stats; ///< These are the statistics reported to the gateway. 
+int master = -1; ///< This is the master side of the pseudo-terminal. 
+int slave = -1; ///< This is the slave side of the pseudo-terminal, kept open so that the master does not see a hang-up between gateway connections. 
+const char *linkPath = FAKE_LINK; ///< This is the symbolic link to the pseudo-terminal. 
+int address = 15; ///< This is the address of the node. 
+int absent = -1; ///< This is the address of a node that does not exist. 
+long long delay = 50; ///< This denotes how many milliseconds pass before an ACK, failed or broadcasted event. 
+int corruptEvery = 0; ///< This denotes that every nth request fails its checksum, 0 for none. 
+int requests = 0; ///< This denotes how many requests have been received. 
+int binary = 1; ///< This flag denotes that the node speaks the binary host protocol. 
+int outstanding = 0; ///< This denotes how many messages wait for ACK. 
+unsigned char nextId = 0; ///< This is the transport id of the next acknowledged message. 
+unsigned char nextDatagramId = 0; ///< This is the transport id of the next datagram, broadcast or multicast. 
+char console[64]; ///< This is the line typed at the console. 
+int consoleIndex = 0; ///< This denotes how many characters of console have been typed. 
+unsigned char frame[HOSTLINK_MAX_FRAME]; ///< This is the frame that is being decoded. 
+int frameIndex = 0; ///< This denotes how many bytes of frame have been decoded. 
+unsigned char blockLeft = 0; ///< This denotes how many bytes of the current COBS block are left. 
+unsigned char blockCode = 0; ///< This is the code byte of the current COBS block. 
+unsigned char frameOverflow = 0; ///< This flag denotes that the frame is too long. 
+unsigned char *partMessage = NULL; ///< This is the message being collected from send part requests. 
+int partLength = 0; ///< This denotes how many bytes of partMessage have been collected. 
+
+/**
+ * @brief This function returns the time of the monotonic clock. 
+ * @return The time in milliseconds. 
+ */
+long long fakeNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief This function writes bytes to the gateway. 
+ * @param data The bytes. 
+ * @param length The number of bytes. 
+ */
+void fakeWrite(const void *data, int length)
+{
+    const unsigned char *bytes = data;
+    while (length > 0 && master >= 0)
+    {
+        ssize_t written = write(master, bytes, length);
+        if (written < 0 && errno != EAGAIN && errno != EINTR)
+            return;
+        if (written < 0)
+        {
+            struct pollfd fd = {master, POLLOUT, 0};
+            poll(&fd, 1, 100);
+            continue;
+        }
+        bytes += written;
+        length -= written;
+    }
+}
+
+/**
+ * @brief This function sends a frame to the gateway, COBS encoded like hostlinkSendFrame. 
+ * @param type The type of the frame. 
+ * @param seq The sequence number, 0 for events. 
+ * @param prefix The bytes of body before data. 
+ * @param prefixLength The length of prefix. 
+ * @param data The remaining bytes of body. 
+ * @param dataLength The length of data. 
+ */
+void fakeSendFrame(unsigned char type, unsigned char seq, unsigned char *prefix, int prefixLength, unsigned char *data, int dataLength)
+{
+    unsigned char decoded[FAKE_FRAME_MAX], encoded[FAKE_FRAME_MAX + FAKE_FRAME_MAX / 254 + 3];
+    int length = 0, index = 0, start = 0;
+    decoded[length++] = type;
+    decoded[length++] = seq;
+    memcpy(decoded + length, prefix, prefixLength);
+    length += prefixLength;
+    if (dataLength)
+        memcpy(decoded + length, data, dataLength);
+    length += dataLength;
+    decoded[length] = calculateCRC8Update(0, decoded[0]);
+    for (int i = 1; i < length; i++)
+        decoded[length] = calculateCRC8Update(decoded[length], decoded[i]);
+    length++;
+    while (start <= length) // each loop writes one block
+    {
+        int end = start;
+        while (end < length && end - start < 254 && decoded[end] != 0)
+            end++;
+        encoded[index++] = end - start + 1;
+        memcpy(encoded + index, decoded + start, end - start);
+        index += end - start;
+        start = end - start == 254 && end < length ? end : end + 1;
+    }
+    encoded[index++] = 0;
+    fakeWrite(encoded, index);
+}
+
+/**
+ * @brief This function sends an event to the gateway, like hostlinkEvent. 
+ * @param event The event. 
+ */
+void fakeSendEvent(struct fake_event *event)
+{
+    unsigned char prefix[2] = {event->address, event->value};
+    if (!binary)
+        return;
+    if (event->length < 0)
+        fakeSendFrame(event->type, 0, prefix, 1, NULL, 0);
+    else
+        fakeSendFrame(event->type, 0, prefix, 2, event->data, event->length);
+}
+
+/**
+ * @brief This function schedules an event. 
+ * @param type The event type. 
+ * @param first The first byte of the event body. 
+ * @param second The second byte of the event body. 
+ * @param data The remaining body, which is copied. 
+ * @param length The length of data, or -1 for an event body of only 1 byte. 
+ * @param ends This flag denotes that the event ends a message waiting for ACK. 
+ */
+void fakeSchedule(unsigned char type, unsigned char first, unsigned char second, unsigned char *data, int length, unsigned char ends)
+{
+    for (int i = 0; i < FAKE_EVENTS; i++)
+        if (events[i].due == 0)
+        {
+            events[i].due = fakeNow() + delay;
+            events[i].type = type;
+            events[i].address = first;
+            events[i].value = second;
+            events[i].length = length;
+            events[i].data = length > 0 ? memcpy(malloc(length), data, length) : NULL;
+            events[i].outstanding = ends;
+            return;
+        }
+}
+
+/**
+ * @brief This function switches to the binary host protocol like hostlinkStart: a byte of 0 ends any console text, then a ready event follows. 
+ */
+void fakeStart()
+{
+    struct fake_event ready = {0, HOSTLINK_EVENT_READY, address, 0, -1, NULL, 0};
+    binary = 1;
+    frameIndex = blockLeft = blockCode = frameOverflow = 0;
+    fakeWrite("", 1);
+    fakeSendEvent(&ready);
+}
+
+/**
+ * @brief This function sends a message like initiateSend. 
+ * @param destination The destination, 0 for broadcast. 
+ * @param flag The flag. 
+ * @param message The message. 
+ * @param length The length of message. 
+ * @return The transport id, or -1 if the message is too long, or -2 if too many messages wait for ACK. 
+ */
+int fakeInitiateSend(unsigned char destination, unsigned char flag, unsigned char *message, int length)
+{
+    int acknowledged = !transportIsDatagram(flag) && destination && !isMulticast(destination);
+    if (length > TRANSPORT_MAX_MESSAGE || (length > TRANSPORT_MAX_SEGMENT && !acknowledged))
+        return -1;
+    if (acknowledged && outstanding >= TRANSPORT_MAX_OUTSTANDING)
+        return -2;
+    stats.framesQueued++;
+    if (destination == address)
+        fakeSchedule(HOSTLINK_EVENT_RECEIVED, address, flag, message, length, 0);
+    if (!acknowledged)
+    {
+        unsigned char id = nextDatagramId++;
+        if (destination == 0)
+            fakeSchedule(HOSTLINK_EVENT_BROADCASTED, id, 0, NULL, -1, 0);
+        else if (isMulticast(destination))
+            fakeSchedule(HOSTLINK_EVENT_BROADCASTED, id, destination, NULL, 0, 0);
+        return id;
+    }
+    unsigned char id = nextId++;
+    outstanding++;
+    if (destination == absent)
+    {
+        stats.failedSends++;
+        fakeSchedule(HOSTLINK_EVENT_FAILED, destination, id, NULL, 0, 1);
+    }
+    else
+    {
+        stats.acksReceived++;
+        fakeSchedule(HOSTLINK_EVENT_ACKED, destination, id, NULL, 0, 1);
+    }
+    return id;
+}
+
+/**
+ * @brief This function processes a decoded frame like hostlinkProcessFrame. 
+ * @param frame The decoded frame. 
+ * @param length The length of the frame. 
+ */
+void fakeProcessFrame(unsigned char *frame, int length)
+{
+    unsigned char seq = length > 1 ? frame[1] : 0;
+    unsigned char response[2] = {HOSTLINK_STATUS_OK, 0};
+    requests++;
+    if (length < 3 || calculateCRC8(frame, length - 1) != frame[length - 1] || (corruptEvery && requests % corruptEvery == 0))
+    {
+        response[0] = HOSTLINK_STATUS_CHECKSUM;
+        fakeSendFrame(HOSTLINK_RESPONSE, seq, response, 1, NULL, 0);
+        return;
+    }
+    unsigned char *body = frame + 2;
+    int bodyLength = length - 3, id = 0;
+    switch (frame[0])
+    {
+        case HOSTLINK_REQUEST_SEND:
+        case HOSTLINK_REQUEST_BROADCAST:
+        {
+            int headLength = frame[0] == HOSTLINK_REQUEST_BROADCAST ? 1 : 2;
+            if (bodyLength < headLength)
+            {
+                response[0] = HOSTLINK_STATUS_INVALID;
+                break;
+            }
+            id = fakeInitiateSend(headLength == 1 ? 0 : body[0], body[headLength - 1], body + headLength, bodyLength - headLength);
+            break;
+        }
+        case HOSTLINK_REQUEST_SEND_PART:
+        {
+            if (bodyLength < 3 || partLength + bodyLength - 3 > TRANSPORT_MAX_MESSAGE)
+            {
+                free(partMessage);
+                partMessage = NULL, partLength = 0;
+                response[0] = HOSTLINK_STATUS_INVALID;
+                break;
+            }
+            if (partMessage == NULL)
+                partMessage = malloc(TRANSPORT_MAX_MESSAGE);
+            memcpy(partMessage + partLength, body + 3, bodyLength - 3);
+            partLength += bodyLength - 3;
+            if (body[2]) // more parts follow
+                break;
+            id = fakeInitiateSend(body[0], body[1], partMessage, partLength);
+            free(partMessage);
+            partMessage = NULL, partLength = 0;
+            break;
+        }
+        case HOSTLINK_REQUEST_STATS:
+        {
+            struct statistics copy = stats;
+            if (bodyLength && body[0])
+                memset(&stats, 0, sizeof(stats));
+            fakeSendFrame(HOSTLINK_RESPONSE_STATS, seq, response, 1, (unsigned char*)&copy, sizeof(copy));
+            return;
+        }
+        case HOSTLINK_REQUEST_CONFIGURE:
+        {
+            unsigned int value = bodyLength >= 3 ? body[1] | (unsigned int)body[2] << 8 : 0;
+            if (bodyLength < 3)
+                response[0] = HOSTLINK_STATUS_INVALID;
+            else if (body[0] == HOSTLINK_CONFIG_MODE && value <= MODE_BINARY)
+            {
+                fakeSendFrame(HOSTLINK_RESPONSE, seq, response, 1, NULL, 0);
+                if (value == MODE_BINARY)
+                    fakeStart();
+                else
+                    binary = 0;
+                return;
+            }
+            else if (body[0] == HOSTLINK_CONFIG_ADDRESS && value && value < 256 && !isMulticast(value))
+                address = value;
+            else if (body[0] < HOSTLINK_CONFIG_TIMEOUT || body[0] > HOSTLINK_CONFIG_AIMD)
+                response[0] = HOSTLINK_STATUS_INVALID;
+            break;
+        }
+        default:
+            response[0] = HOSTLINK_STATUS_INVALID;
+            break;
+    }
+    if (id < 0)
+        response[0] = id == -1 ? HOSTLINK_STATUS_INVALID : HOSTLINK_STATUS_BUSY;
+    else if (response[0] == HOSTLINK_STATUS_OK && (frame[0] == HOSTLINK_REQUEST_SEND || frame[0] == HOSTLINK_REQUEST_BROADCAST || (frame[0] == HOSTLINK_REQUEST_SEND_PART && !body[2])))
+    {
+        response[1] = id;
+        fakeSendFrame(HOSTLINK_RESPONSE, seq, response, 2, NULL, 0);
+        return;
+    }
+    fakeSendFrame(HOSTLINK_RESPONSE, seq, response, 1, NULL, 0);
+}
+
+/**
+ * @brief This function appends a decoded byte to the frame, or marks the frame as too long. 
+ * @param byte The decoded byte. 
+ */
+void fakeAppend(unsigned char byte)
+{
+    if (frameIndex < HOSTLINK_MAX_FRAME)
+        frame[frameIndex++] = byte;
+    else
+        frameOverflow = 1;
+}
+
+/**
+ * @brief This function processes a byte from the gateway, at the console or in the binary host protocol. 
+ * @param byte The byte. 
+ */
+void fakeReceiveByte(unsigned char byte)
+{
+    if (!binary)
+    {
+        if (byte == '\r')
+        {
+            console[consoleIndex] = '\0';
+            if (strcmp(console, "/bin") == 0)
+                fakeStart();
+            else
+            {
+                const char *text = "Invalid input\r\n";
+                fakeWrite(text, strlen(text));
+            }
+            consoleIndex = 0;
+        }
+        else if (byte == '\b')
+        {
+            if (consoleIndex)
+                consoleIndex--;
+        }
+        else if (consoleIndex < (int)sizeof(console) - 1)
+            console[consoleIndex++] = byte;
+        return;
+    }
+    if (byte == 0) // end of frame
+    {
+        if (frameIndex && !frameOverflow)
+            fakeProcessFrame(frame, frameIndex);
+        frameIndex = blockLeft = blockCode = frameOverflow = 0;
+    }
+    else if (blockLeft == 0) // code byte of the next block
+    {
+        if (blockCode != 0 && blockCode != 0xFF) // the previous block stands for a byte of 0
+            fakeAppend(0);
+        blockCode = byte;
+        blockLeft = byte - 1;
+    }
+    else
+    {
+        fakeAppend(byte);
+        blockLeft--;
+    }
+}
+
+/**
+ * @brief This function resets the node: it forgets the messages waiting for ACK and starts at the console, or in binary operating mode as with a stored configuration. 
+ * @param startBinary This flag denotes that the node starts in binary operating mode. 
+ */
+void fakeReset(int startBinary)
+{
+    for (int i = 0; i < FAKE_EVENTS; i++)
+    {
+        free(events[i].data);
+        events[i].due = 0;
+        events[i].data = NULL;
+    }
+    outstanding = consoleIndex = 0;
+    free(partMessage);
+    partMessage = NULL, partLength = 0;
+    binary = startBinary;
+    if (binary)
+        fakeStart();
+}
+
+/**
+ * The slave side is set to raw mode and kept open. A symbolic link at linkPath points to it, so that the gateway finds the new pseudo-terminal after a reset. 
+ * @brief This function opens a pseudo-terminal like a node that has been powered up or reset. 
+ * @param startBinary This flag denotes that the node starts in binary operating mode, as with a stored configuration. 
+ */
+void fakeOpen(int startBinary)
+{
+    struct termios tio;
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+    {
+        perror("posix_openpt");
+        exit(1);
+    }
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave >= 0 && tcgetattr(slave, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    unlink(linkPath);
+    if (symlink(ptsname(master), linkPath) < 0)
+        perror(linkPath);
+    printf("%s -> %s\n", linkPath, ptsname(master));
+    fflush(stdout);
+    fakeReset(startBinary);
+}
+
+/**
+ * @brief This function closes the pseudo-terminal like a USB serial adapter of a node that is reset. 
+ */
+void fakeClose()
+{
+    close(master);
+    close(slave);
+    master = slave = -1;
+}
+
+/**
+ * @brief This function runs the fake node. 
+ * @param argc The number of arguments. 
+ * @param argv The arguments. 
+ * @return 1 on error. 
+ */
+int main(int argc, char **argv)
+{
+    long long resetPeriod = 0, messagePeriod = 0;
+    int option, startBinary = 1, hangUp = 0;
+    unsigned int ticks = 0;
+    while ((option = getopt(argc, argv, "l:a:d:x:r:m:e:cu")) != -1)
+    {
+        if (option == 'l')
+            linkPath = optarg;
+        else if (option == 'a')
+            address = atoi(optarg);
+        else if (option == 'd')
+            delay = atol(optarg);
+        else if (option == 'x')
+            absent = atoi(optarg);
+        else if (option == 'r')
+            resetPeriod = atol(optarg) * 1000LL;
+        else if (option == 'm')
+            messagePeriod = atol(optarg);
+        else if (option == 'e')
+            corruptEvery = atoi(optarg);
+        else if (option == 'c')
+            startBinary = 0;
+        else if (option == 'u')
+            hangUp = 1;
+        else
+        {
+            fprintf(stderr, "usage: %s [-l link] [-a address] [-d event delay in ms] [-x absent address] [-r reset period in s] [-m message period in ms] [-e every nth frame corrupted] [-c] [-u]\n", argv[0]);
+            return 1;
+        }
+    }
+    fakeOpen(startBinary);
+    long long resetAt = resetPeriod ? fakeNow() + resetPeriod : 0, messageAt = messagePeriod ? fakeNow() + messagePeriod : 0;
+    while (1)
+    {
+        struct pollfd fd = {master, POLLIN, 0};
+        unsigned char buffer[4096];
+        poll(&fd, 1, 5);
+        ssize_t length = read(master, buffer, sizeof(buffer));
+        for (ssize_t i = 0; i < length; i++)
+            fakeReceiveByte(buffer[i]);
+        long long now = fakeNow();
+        for (int i = 0; i < FAKE_EVENTS; i++)
+            if (events[i].due && events[i].due <= now)
+            {
+                fakeSendEvent(&events[i]);
+                outstanding -= events[i].outstanding;
+                free(events[i].data);
+                events[i].data = NULL;
+                events[i].due = 0;
+            }
+        if (messageAt && now >= messageAt)
+        {
+            char text[32];
+            int textLength = snprintf(text, sizeof(text), "tick %u", ticks++);
+            struct fake_event message = {0, HOSTLINK_EVENT_RECEIVED, 7, 3, textLength, (unsigned char*)text, 0};
+            stats.framesReceived++;
+            fakeSendEvent(&message);
+            messageAt = now + messagePeriod;
+        }
+        if (resetAt && now >= resetAt)
+        {
+            if (hangUp)
+                fakeClose();
+            usleep(200000); // the node boots
+            if (hangUp)
+                fakeOpen(startBinary);
+            else
+                fakeReset(startBinary);
+            resetAt = now + resetPeriod;
+        }
+    }
+}
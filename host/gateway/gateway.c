@@ -0,0 +1,1396 @@
+/**
+ * @file gateway.c
+ * @author David Ng 550084
+ * @brief This program owns the serial port of a node on the Raspberry Pi, speaks the binary host protocol with it, and serves many local clients over a Unix socket. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ * Build with "make gateway" and run "host/gateway/gateway [-d device] [-s socket] [-b baud] [-a ACK time-out in s]". 
+ * Clients send lines of text and receive lines of text, e.g. with "socat - UNIX-CONNECT:/tmp/raspnet.sock". The commands are: <br>
+ * send &lt;destination&gt; &lt;flag&gt; &lt;text&gt; and sendx &lt;destination&gt; &lt;flag&gt; &lt;hex&gt; send a message, destination 0 broadcasts it. <br>
+ * listen &lt;port&gt; and unlisten &lt;port&gt; choose the ports of which received messages are passed to the client, * for all ports. <br>
+ * stats [r] queries the statistics of the node, config &lt;key&gt; &lt;value&gt; configures it with the keys of the binary host protocol, and counters prints the counters of the gateway. <br>
+ * Requests of a client are numbered from 1 in the order sent. Replies are "ok n [id]", "error n reason", "acked n destination id", "failed n destination id", "lost n destination id", "broadcasted n id [group]", "stats n ..." and "counters n ...". <br>
+ * Events are "received source port hex" and "node online address", "node offline", "node restarted address". 
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../../crc/crc.h"
+#include "../../hostlink/hostlink.h"
+#include "../../stats/stats.h"
+#include "../../layer3/network.h"
+#include "../../layer4/transport_struct.h"
+
+#define GATEWAY_DEVICE "/dev/ttyAMA0" ///< This is the serial port of the node by default. 
+#define GATEWAY_SOCKET "/tmp/raspnet.sock" ///< This is the path of the Unix socket by default. 
+#define GATEWAY_MAX_CLIENTS 16 ///< This denotes how many clients may be connected at the same time. 
+#define GATEWAY_WINDOW 4 ///< This denotes how many frames may be written to the node before it has responded, as the node buffers only UART_RX_BUFFER bytes of input. 
+#define GATEWAY_RESPONSE_TIMEOUT 2000 ///< This denotes how many milliseconds the node may take to respond before the request is written again. 
+#define GATEWAY_RETRY_DELAY 500 ///< This denotes how many milliseconds a request answered with busy or no memory waits before it is written again. 
+#define GATEWAY_MAX_ATTEMPTS 20 ///< This denotes how many times a request is written before it is given up. 
+#define GATEWAY_ACK_ENTRIES 64 ///< This denotes how many sent messages may wait for their ACK, failed or broadcasted event. 
+#define GATEWAY_ACK_TIMEOUT 600 ///< This denotes how many seconds a message waits for its event by default before it is reported as lost. 
+#define GATEWAY_RECONNECT 1000 ///< This denotes how many milliseconds pass between attempts to open the serial port. 
+#define GATEWAY_PROBE_TIMEOUT 1000 ///< This denotes how many milliseconds the node may take to answer the probe or to switch to binary operating mode. 
+#define GATEWAY_FRAME_MAX 1024 ///< This denotes the longest decoded frame from the node, enough for a reassembled message of TRANSPORT_MAX_MESSAGE bytes. 
+#define GATEWAY_LINE_MAX 2048 ///< This denotes the longest line from a client, enough for a message of TRANSPORT_MAX_MESSAGE bytes in hex. 
+#define GATEWAY_CLIENT_OUTPUT 65536 ///< This denotes how many bytes of output may wait for a client before it is dropped as too slow. 
+#define GATEWAY_SEND_MAX (HOSTLINK_MAX_FRAME - 5) ///< This denotes the longest message sent with one send request: the frame without type, sequence number, destination, flag and checksum. 
+#define GATEWAY_PART_MAX (HOSTLINK_MAX_FRAME - 6) ///< This denotes the longest part of a message sent with send part requests, which carry the more flag as well. 
+
+#define NODE_OFFLINE 0 ///< The serial port is closed. 
+#define NODE_PROBING 1 ///< The serial port is open and a statistics query has been written to find out if the node speaks the binary host protocol. 
+#define NODE_SWITCHING 2 ///< The probe has not been answered, and /bin has been typed at the console of the node. 
+#define NODE_ONLINE 3 ///< The node speaks the binary host protocol. 
+
+//! This structure is a client connected to the Unix socket.
+struct gateway_client
+{
+    int fd; ///< This is the socket of the client, -1 if the entry is free. 
+    unsigned long session; ///< This is the number of the connection, so that a reply is not sent to a later client in the same entry. 
+    unsigned int requests; ///< This denotes how many requests the client has sent, which numbers its requests. 
+    char line[GATEWAY_LINE_MAX]; ///< This is the line being received. 
+    int lineLength; ///< This denotes how many bytes of line have been received. 
+    char *output; ///< This is the output waiting to be written to the client. 
+    size_t outputLength; ///< This denotes how many bytes of output are waiting. 
+    unsigned char listen[32]; ///< This is the bitmap of ports of which received messages are passed to the client. 
+    unsigned char listenAll; ///< This flag denotes that received messages of all ports are passed to the client. 
+};
+
+//! This structure is a request of a client waiting to be written to the node or for its response.
+/**
+ * A message longer than GATEWAY_SEND_MAX is written as several send part requests, which must follow each other. So a request stays at the head of the queue until all of its frames have been written. <br>
+ * A part is written only after the previous part has been accepted, as the node would send the remaining parts as a message of their own if an earlier part were refused. The node collects the parts of one message at a time, so that the request stays at the head of the queue until its last part has been answered. 
+ */
+struct gateway_request
+{
+    struct gateway_request *next; ///< This is the next request in the queue. 
+    int client; ///< This is the entry of the client in clients, -1 for the probe. 
+    unsigned long session; ///< This is the session of the client. 
+    unsigned int number; ///< This is the number of the request of the client. 
+    unsigned char type; ///< This is the request type, one of the HOSTLINK_REQUEST definitions. 
+    unsigned char body[3]; ///< This is the body of a statistics or configure request. 
+    unsigned char destination; ///< This is the destination of a message. 
+    unsigned char flag; ///< This is the flag of a message. 
+    unsigned char *message; ///< This is the message to send. 
+    int length; ///< This denotes the length of message. 
+    int frames; ///< This denotes how many frames the request is written as. 
+    int framesWritten; ///< This denotes how many frames have been written in the current attempt. 
+    unsigned char queued; ///< This flag denotes that the request is in the queue. 
+    unsigned char awaiting; ///< This flag denotes that a part has been written and its response is awaited before the next part. 
+    unsigned char resetFirst; ///< This flag denotes that the parts collected by the node are discarded before the message is written. 
+    int attempts; ///< This denotes how many times the request has been written. 
+    long long notBefore; ///< This is the time before which the request is not written again. 
+};
+
+//! This structure is a frame written to the node that waits for its response, indexed by sequence number.
+struct gateway_pending
+{
+    struct gateway_request *request; ///< This is the request of the frame, NULL if the sequence number is free. 
+    long long deadline; ///< This is the time at which the request is written again if no response has arrived. 
+    unsigned char last; ///< This flag denotes that the frame is the last frame of its request. 
+    unsigned char reset; ///< This flag denotes that the frame discards the parts collected by the node, its response is ignored. 
+};
+
+//! This structure is a message accepted by the node that waits for its ACK, failed or broadcasted event.
+struct gateway_ack
+{
+    unsigned char used; ///< This flag denotes that the entry is used. 
+    unsigned char broadcast; ///< This flag denotes that a broadcasted event is expected instead of ACK. 
+    unsigned char destination; ///< This is the destination of the message. 
+    unsigned char id; ///< This is the transport id of the message. 
+    int client; ///< This is the entry of the client in clients. 
+    unsigned long session; ///< This is the session of the client. 
+    unsigned int number; ///< This is the number of the request of the client. 
+    long long deadline; ///< This is the time at which the message is reported as lost. 
+};
+
+//! This structure stores the counters of the gateway, printed by the counters command.
+struct gateway_counters
+{
+    unsigned long connects; ///< This denotes how many times the serial port has been opened. 
+    unsigned long disconnects; ///< This denotes how many times the serial port has been lost. 
+    unsigned long probes; ///< This denotes how many probes have been written. 
+    unsigned long switches; ///< This denotes how many times /bin has been typed at the console of the node. 
+    unsigned long nodeRestarts; ///< This denotes how many times the node has sent a ready event while online, i.e. has been reset. 
+    unsigned long bytesIn; ///< This denotes how many bytes have been read from the node. 
+    unsigned long bytesOut; ///< This denotes how many bytes have been written to the node. 
+    unsigned long framesIn; ///< This denotes how many valid frames have been read from the node. 
+    unsigned long framesOut; ///< This denotes how many frames have been written to the node. 
+    unsigned long writes; ///< This denotes how many writes to the serial port have carried these frames, i.e. batches. 
+    unsigned long frameErrors; ///< This denotes how many frames from the node have failed the checksum. 
+    unsigned long strayResponses; ///< This denotes how many responses have not matched a waiting frame. 
+    unsigned long requests; ///< This denotes how many requests clients have sent. 
+    unsigned long accepted; ///< This denotes how many requests the node has accepted. 
+    unsigned long rejected; ///< This denotes how many requests the node has refused, or that have been given up after GATEWAY_MAX_ATTEMPTS. 
+    unsigned long busyRetries; ///< This denotes how many requests have been written again after busy or no memory. 
+    unsigned long checksumRetries; ///< This denotes how many requests have been written again after the node has found a checksum error. 
+    unsigned long timeoutRetries; ///< This denotes how many requests have been written again after the response has timed out or the node has been lost. 
+    unsigned long acked; ///< This denotes how many ACK events have matched a sent message. 
+    unsigned long failed; ///< This denotes how many failed events have matched a sent message. 
+    unsigned long broadcasted; ///< This denotes how many broadcasted events have matched a sent message. 
+    unsigned long lost; ///< This denotes how many sent messages have been reported as lost. 
+    unsigned long unmatchedEvents; ///< This denotes how many ACK, failed or broadcasted events have not matched a sent message. 
+    unsigned long received; ///< This denotes how many messages have been received from the node. 
+    unsigned long delivered; ///< This denotes how many times a received message has been passed to a client. 
+    unsigned long unclaimed; ///< This denotes how many received messages no client has listened to. 
+    unsigned long clients; ///< This denotes how many clients have connected. 
+    unsigned long clientsDropped; ///< This denotes how many clients have been dropped as their output has not been read. 
+};
+
+//! This structure names a field of a structure for printing.
+struct gateway_field
+{
+    const char *name; ///< This is the name of the field. 
+    size_t offset; ///< This is the offset of the field. 
+    size_t size; ///< This is the size of the field in bytes. 
+};
+
+#define GATEWAY_FIELD(type, field) {#field, offsetof(struct type, field), sizeof(((struct type*)0)->field)} ///< This names a field of a structure. 
+
+const struct gateway_field counterFields[] = {
+    GATEWAY_FIELD(gateway_counters, connects), GATEWAY_FIELD(gateway_counters, disconnects), GATEWAY_FIELD(gateway_counters, probes), GATEWAY_FIELD(gateway_counters, switches),
+    GATEWAY_FIELD(gateway_counters, nodeRestarts), GATEWAY_FIELD(gateway_counters, bytesIn), GATEWAY_FIELD(gateway_counters, bytesOut), GATEWAY_FIELD(gateway_counters, framesIn),
+    GATEWAY_FIELD(gateway_counters, framesOut), GATEWAY_FIELD(gateway_counters, writes), GATEWAY_FIELD(gateway_counters, frameErrors), GATEWAY_FIELD(gateway_counters, strayResponses),
+    GATEWAY_FIELD(gateway_counters, requests), GATEWAY_FIELD(gateway_counters, accepted), GATEWAY_FIELD(gateway_counters, rejected), GATEWAY_FIELD(gateway_counters, busyRetries),
+    GATEWAY_FIELD(gateway_counters, checksumRetries), GATEWAY_FIELD(gateway_counters, timeoutRetries), GATEWAY_FIELD(gateway_counters, acked), GATEWAY_FIELD(gateway_counters, failed),
+    GATEWAY_FIELD(gateway_counters, broadcasted), GATEWAY_FIELD(gateway_counters, lost), GATEWAY_FIELD(gateway_counters, unmatchedEvents), GATEWAY_FIELD(gateway_counters, received),
+    GATEWAY_FIELD(gateway_counters, delivered), GATEWAY_FIELD(gateway_counters, unclaimed), GATEWAY_FIELD(gateway_counters, clients), GATEWAY_FIELD(gateway_counters, clientsDropped)
+}; ///< These are the counters printed by the counters command. 
+
+const struct gateway_field statisticsFields[] = {
+    GATEWAY_FIELD(statistics, framesQueued), GATEWAY_FIELD(statistics, framesSent), GATEWAY_FIELD(statistics, framesReceived), GATEWAY_FIELD(statistics, framesForwarded),
+    GATEWAY_FIELD(statistics, crcFailures), GATEWAY_FIELD(statistics, headerCrcFailures), GATEWAY_FIELD(statistics, retransmits), GATEWAY_FIELD(statistics, failedSends),
+    GATEWAY_FIELD(statistics, acksReceived), GATEWAY_FIELD(statistics, sendBackOffs), GATEWAY_FIELD(statistics, writeBackOffs), GATEWAY_FIELD(statistics, memoryWarnings),
+    GATEWAY_FIELD(statistics, receiveTimeouts), GATEWAY_FIELD(statistics, lengthAborts), GATEWAY_FIELD(statistics, queueDrops), GATEWAY_FIELD(statistics, preemptions),
+    GATEWAY_FIELD(statistics, rateCuts), GATEWAY_FIELD(statistics, portRefusals), GATEWAY_FIELD(statistics, receiveOverruns), GATEWAY_FIELD(statistics, receiveNoMemory),
+    GATEWAY_FIELD(statistics, heapUsed), GATEWAY_FIELD(statistics, sendQueueDepth), GATEWAY_FIELD(statistics, forwardQueueDepth), GATEWAY_FIELD(statistics, sendQueuePeak), GATEWAY_FIELD(statistics, forwardQueuePeak)
+}; ///< These are the fields of the statistics snapshot of the node, which is little endian like the host. 
+
+const char *statusNames[] = {"ok", "checksum", "invalid", "no-memory", "busy"}; ///< These are the names of the HOSTLINK_STATUS definitions. 
+
+struct gateway_client clients[GATEWAY_MAX_CLIENTS]; ///< These are the connected clients. 
+unsigned long sessions = 0; ///< This denotes how many clients have connected, which numbers their sessions. 
+struct gateway_request *queueHead = NULL, *queueTail = NULL; ///< This is the queue of requests to write to the node. 
+struct gateway_pending pending[256]; ///< These are the frames waiting for their response, indexed by sequence number. Sequence number 0 is kept for events. 
+int windowUsed = 0; ///< This denotes how many frames are waiting for their response. 
+unsigned char nextSeq = 1; ///< This is the sequence number of the next frame. 
+struct gateway_ack acks[GATEWAY_ACK_ENTRIES]; ///< These are the messages waiting for their ACK, failed or broadcasted event. 
+struct gateway_counters counters; ///< These are the counters of the gateway. 
+
+const char *devicePath = GATEWAY_DEVICE; ///< This is the path of the serial port. 
+speed_t baud = B9600; ///< This is the baud rate of the serial port. 
+long long ackTimeout = GATEWAY_ACK_TIMEOUT * 1000LL; ///< This denotes how many milliseconds a message waits for its event. 
+int serialFd = -1; ///< This is the serial port, -1 while it is closed. 
+int nodeState = NODE_OFFLINE; ///< This is the state of the node, one of the NODE definitions. 
+int nodeAddress = -1; ///< This is the address of the node from its last ready event, -1 if it is not known. 
+long long stateDeadline = 0; ///< This is the time at which the serial port is opened again, or the probe or the switch has timed out. 
+int probeSeq = -1; ///< This is the sequence number of the probe, whose response is not passed on, -1 if no probe has been written. 
+unsigned char probeReady = 0; ///< This flag denotes that the ready event caused by the probe has not arrived yet, so that it does not count as a reset of the node. 
+int probeLength = 0; ///< This denotes how many bytes the probe has taken, which are erased at the console of the node. 
+unsigned char serialOutput[16384]; ///< This is the output waiting to be written to the serial port. 
+int serialOutputLength = 0; ///< This denotes how many bytes of serialOutput are waiting. 
+unsigned char frameIn[GATEWAY_FRAME_MAX]; ///< This is the frame from the node that is being decoded. 
+int frameInLength = 0; ///< This denotes how many bytes of frameIn have been decoded. 
+unsigned char blockLeft = 0; ///< This denotes how many bytes of the current COBS block are left. 
+unsigned char blockCode = 0; ///< This is the code byte of the current COBS block, 0 if no block of the frame has been read. 
+unsigned char frameOverflow = 0; ///< This flag denotes that the frame is too long and is discarded. 
+volatile sig_atomic_t running = 1; ///< This flag is cleared by SIGINT or SIGTERM to stop the gateway. 
+
+/**
+ * @brief This function returns the time of the monotonic clock. 
+ * @return The time in milliseconds. 
+ */
+long long gatewayNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief This function stops the main loop at SIGINT or SIGTERM. 
+ * @param signal The signal. 
+ */
+void gatewayStop(int signal)
+{
+    running = 0;
+}
+
+/**
+ * @brief This function frees a request. 
+ * @param request The request. 
+ */
+void requestFree(struct gateway_request *request)
+{
+    free(request->message);
+    free(request);
+}
+
+/**
+ * @brief This function appends a request to the queue. 
+ * @param request The request. 
+ */
+void requestQueue(struct gateway_request *request)
+{
+    request->next = NULL;
+    request->queued = 1;
+    if (queueTail)
+        queueTail->next = request;
+    else
+        queueHead = request;
+    queueTail = request;
+}
+
+/**
+ * @brief This function removes a request from the queue. 
+ * @param request The request. 
+ */
+void requestDequeue(struct gateway_request *request)
+{
+    struct gateway_request **link = &queueHead, *previous = NULL;
+    while (*link && *link != request)
+        previous = *link, link = &(*link)->next;
+    if (*link == NULL)
+        return;
+    *link = request->next;
+    if (queueTail == request)
+        queueTail = previous;
+    request->queued = 0;
+}
+
+/**
+ * Requests of the client that have not been written yet are dropped. Replies and events for its other requests are dropped from then on. 
+ * @brief This function closes the connection to a client. 
+ * @param client The client. 
+ */
+void clientClose(struct gateway_client *client)
+{
+    struct gateway_request *request = queueHead, *next;
+    for (; request; request = next)
+    {
+        next = request->next;
+        if (request->client == client - clients && request->session == client->session && request->framesWritten == 0 && !request->awaiting)
+        {
+            requestDequeue(request);
+            requestFree(request);
+        }
+    }
+    close(client->fd);
+    client->fd = -1;
+    free(client->output);
+    client->output = NULL;
+    client->outputLength = 0;
+}
+
+/**
+ * A client whose output grows beyond GATEWAY_CLIENT_OUTPUT is not reading it and is dropped, so that it cannot hold up the other clients. 
+ * @brief This function appends a line to the output of a client. 
+ * @param client The client. 
+ * @param format The format of the line, as for printf, without the line feed. 
+ */
+void clientPrintf(struct gateway_client *client, const char *format, ...)
+{
+    char line[GATEWAY_LINE_MAX * 2];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length < 0 || client->fd < 0)
+        return;
+    if (length > (int)sizeof(line) - 2)
+        length = sizeof(line) - 2;
+    line[length++] = '\n';
+    if (client->outputLength + length > GATEWAY_CLIENT_OUTPUT)
+    {
+        counters.clientsDropped++;
+        clientClose(client);
+        return;
+    }
+    client->output = realloc(client->output, client->outputLength + length);
+    memcpy(client->output + client->outputLength, line, length);
+    client->outputLength += length;
+}
+
+/**
+ * @brief This function finds the client of a request or message, unless it has disconnected meanwhile. 
+ * @param index The entry of the client. 
+ * @param session The session of the client. 
+ * @return The client, or NULL. 
+ */
+struct gateway_client *clientFind(int index, unsigned long session)
+{
+    if (index < 0 || clients[index].fd < 0 || clients[index].session != session)
+        return NULL;
+    return &clients[index];
+}
+
+/**
+ * @brief This function sends a line to all clients. 
+ * @param line The line. 
+ */
+void clientBroadcast(const char *line)
+{
+    for (int i = 0; i < GATEWAY_MAX_CLIENTS; i++)
+        if (clients[i].fd >= 0)
+            clientPrintf(&clients[i], "%s", line);
+}
+
+/**
+ * @brief This function formats bytes in hex for a line to a client. 
+ * @param out The buffer of 2 * length + 1 bytes. 
+ * @param data The bytes. 
+ * @param length The number of bytes. 
+ * @return out. 
+ */
+char *gatewayHex(char *out, unsigned char *data, int length)
+{
+    for (int i = 0; i < length; i++)
+        sprintf(out + 2 * i, "%02x", data[i]);
+    out[2 * length] = '\0';
+    return out;
+}
+
+/**
+ * @brief This function appends a frame, COBS encoded and terminated by a byte of 0, to the serial output, in the same way as hostlinkSendFrame. 
+ * @param frame The decoded frame, including checksum. 
+ * @param length The length of the frame. 
+ * @return The number of bytes appended. 
+ */
+int serialAppendFrame(unsigned char *frame, int length)
+{
+    unsigned char *out = serialOutput + serialOutputLength;
+    int index = 0, start = 0;
+    while (start <= length) // each loop writes one block
+    {
+        int end = start;
+        while (end < length && end - start < 254 && frame[end] != 0)
+            end++;
+        out[index++] = end - start + 1; // code byte
+        memcpy(out + index, frame + start, end - start);
+        index += end - start;
+        if (end - start == 254 && end < length) // a full block does not stand for a byte of 0
+            start = end;
+        else
+            start = end + 1;
+    }
+    out[index++] = 0;
+    serialOutputLength += index;
+    counters.framesOut++;
+    return index;
+}
+
+/**
+ * @brief This function builds a frame of type, sequence number and body with its CRC-8 and appends it to the serial output. 
+ * @param type The request type. 
+ * @param seq The sequence number. 
+ * @param head The bytes of body before data. 
+ * @param headLength The length of head. 
+ * @param data The remaining bytes of body. 
+ * @param dataLength The length of data. 
+ * @return The number of bytes appended. 
+ */
+int serialWriteFrame(unsigned char type, unsigned char seq, unsigned char *head, int headLength, unsigned char *data, int dataLength)
+{
+    unsigned char frame[HOSTLINK_MAX_FRAME];
+    int length = 0;
+    frame[length++] = type;
+    frame[length++] = seq;
+    if (headLength)
+        memcpy(frame + length, head, headLength);
+    length += headLength;
+    if (dataLength)
+        memcpy(frame + length, data, dataLength);
+    length += dataLength;
+    frame[length] = calculateCRC8(frame, length);
+    return serialAppendFrame(frame, length + 1);
+}
+
+/**
+ * All frames appended since the last call are written with one write, so that many requests of many clients share a system call and a burst on the line. 
+ * @brief This function writes as much of the serial output as the serial port takes. 
+ */
+void serialFlush()
+{
+    if (serialFd < 0 || serialOutputLength == 0)
+        return;
+    ssize_t written = write(serialFd, serialOutput, serialOutputLength);
+    if (written <= 0)
+        return; // a lost port is noticed by poll
+    counters.writes++;
+    counters.bytesOut += written;
+    serialOutputLength -= written;
+    memmove(serialOutput, serialOutput + written, serialOutputLength);
+}
+
+/**
+ * @brief This function returns the next sequence number that no frame is waiting with, skipping 0, which is kept for events. 
+ * @return The sequence number. 
+ */
+unsigned char gatewayNextSeq()
+{
+    while (nextSeq == 0 || pending[nextSeq].request != NULL || nextSeq == probeSeq)
+        nextSeq++;
+    return nextSeq++;
+}
+
+/**
+ * @brief This function replies an error to the client of a request and frees the request. 
+ * @param request The request. 
+ * @param reason The reason. 
+ */
+void requestFail(struct gateway_request *request, const char *reason)
+{
+    struct gateway_client *client = clientFind(request->client, request->session);
+    counters.rejected++;
+    if (client)
+        clientPrintf(client, "error %u %s", request->number, reason);
+    requestFree(request);
+}
+
+/**
+ * The frames of the request that still wait for their response are given up, their responses count as stray when they arrive. The request is put at the head of the queue, so that it keeps its place before later requests. A message sent in parts discards the parts collected by the node first. 
+ * @brief This function writes a request again after delay, or replies an error if it has been written too many times. 
+ * @param request The request. 
+ * @param delay The delay in milliseconds. 
+ * @param reason The reason of the error if the request is given up. 
+ */
+void requestRetry(struct gateway_request *request, long long delay, const char *reason)
+{
+    for (int seq = 1; seq < 256; seq++)
+        if (pending[seq].request == request)
+        {
+            pending[seq].request = NULL;
+            windowUsed--;
+        }
+    if (request->queued)
+        requestDequeue(request);
+    if (request->attempts >= GATEWAY_MAX_ATTEMPTS)
+    {
+        requestFail(request, reason);
+        return;
+    }
+    request->framesWritten = request->awaiting = 0;
+    request->resetFirst = request->frames > 1;
+    request->notBefore = gatewayNow() + delay;
+    request->next = queueHead;
+    request->queued = 1;
+    queueHead = request;
+    if (queueTail == NULL)
+        queueTail = request;
+}
+
+/**
+ * @brief This function registers a message accepted by the node to route its ACK, failed or broadcasted event to the client. 
+ * @param request The send request. 
+ * @param id The transport id of the message. 
+ */
+void ackAdd(struct gateway_request *request, unsigned char id)
+{
+    unsigned char broadcast = request->destination == 0 || isMulticast(request->destination);
+    int free = -1, oldest = 0;
+    for (int i = 0; i < GATEWAY_ACK_ENTRIES; i++)
+    {
+        if (acks[i].used && acks[i].broadcast == broadcast && acks[i].destination == request->destination && acks[i].id == id)
+        {
+            acks[i].deadline = 0; // the id is used again, the event of the earlier message has been lost
+            free = i;
+            break;
+        }
+        if (!acks[i].used && free < 0)
+            free = i;
+        if (acks[i].deadline < acks[oldest].deadline)
+            oldest = i;
+    }
+    int i = free >= 0 ? free : oldest;
+    if (acks[i].used)
+    {
+        struct gateway_client *client = clientFind(acks[i].client, acks[i].session);
+        counters.lost++;
+        if (client)
+            clientPrintf(client, "lost %u %u %u", acks[i].number, acks[i].destination, acks[i].id);
+    }
+    acks[i].used = 1;
+    acks[i].broadcast = broadcast;
+    acks[i].destination = request->destination;
+    acks[i].id = id;
+    acks[i].client = request->client;
+    acks[i].session = request->session;
+    acks[i].number = request->number;
+    acks[i].deadline = gatewayNow() + ackTimeout;
+}
+
+/**
+ * @brief This function passes an ACK, failed or broadcasted event to the client that has sent the message. 
+ * @param broadcast This flag denotes a broadcasted event. 
+ * @param destination The destination of the message, or the multicast group, or 0 for broadcast. 
+ * @param id The transport id of the message. 
+ * @param name The name of the event in the line to the client. 
+ * @param counter The counter of the event. 
+ */
+void ackEvent(unsigned char broadcast, unsigned char destination, unsigned char id, const char *name, unsigned long *counter)
+{
+    for (int i = 0; i < GATEWAY_ACK_ENTRIES; i++)
+        if (acks[i].used && acks[i].broadcast == broadcast && acks[i].destination == destination && acks[i].id == id)
+        {
+            struct gateway_client *client = clientFind(acks[i].client, acks[i].session);
+            acks[i].used = 0;
+            (*counter)++;
+            if (client == NULL)
+                return;
+            if (broadcast && destination)
+                clientPrintf(client, "%s %u %u %u", name, acks[i].number, id, destination);
+            else if (broadcast)
+                clientPrintf(client, "%s %u %u", name, acks[i].number, id);
+            else
+                clientPrintf(client, "%s %u %u %u", name, acks[i].number, destination, id);
+            return;
+        }
+    counters.unmatchedEvents++;
+}
+
+/**
+ * @brief This function reports messages as lost whose event has not arrived in time, or all messages if the node has been reset. 
+ * @param now The current time, or 0 to report all messages. 
+ */
+void ackExpire(long long now)
+{
+    for (int i = 0; i < GATEWAY_ACK_ENTRIES; i++)
+        if (acks[i].used && (now == 0 || acks[i].deadline <= now))
+        {
+            struct gateway_client *client = clientFind(acks[i].client, acks[i].session);
+            acks[i].used = 0;
+            counters.lost++;
+            if (client)
+                clientPrintf(client, "lost %u %u %u", acks[i].number, acks[i].destination, acks[i].id);
+        }
+}
+
+/**
+ * @brief This function prints named fields of a structure to a line. 
+ * @param line The line to append to. 
+ * @param size The size of line. 
+ * @param fields The fields. 
+ * @param count The number of fields. 
+ * @param data The structure. 
+ * @param length The length of data, fields beyond it are skipped. 
+ */
+void gatewayPrintFields(char *line, size_t size, const struct gateway_field *fields, int count, unsigned char *data, size_t length)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (fields[i].offset + fields[i].size > length)
+            break;
+        unsigned long value = 0;
+        for (size_t j = fields[i].size; j > 0; j--) // little endian
+            value = value << 8 | data[fields[i].offset + j - 1];
+        size_t used = strlen(line);
+        snprintf(line + used, size - used, " %s=%lu", fields[i].name, value);
+    }
+}
+
+/**
+ * @brief This function marks the node as online and tells all clients. 
+ * @param address The address of the node. 
+ */
+void gatewayOnline(int address)
+{
+    nodeState = NODE_ONLINE;
+    nodeAddress = address;
+    char line[32];
+    snprintf(line, sizeof(line), "node online %d", address);
+    clientBroadcast(line);
+}
+
+/**
+ * @brief This function processes the response to a frame written to the node. 
+ * @param type The response type. 
+ * @param seq The sequence number. 
+ * @param body The body of the response. 
+ * @param length The length of body. 
+ */
+void gatewayResponse(unsigned char type, unsigned char seq, unsigned char *body, int length)
+{
+    struct gateway_pending *frame = &pending[seq];
+    struct gateway_request *request = frame->request;
+    if (seq == probeSeq) // the node speaks the binary host protocol
+    {
+        probeSeq = -1;
+        probeReady = length >= 1 && body[0] == HOSTLINK_STATUS_OK;
+        if (probeReady)
+            stateDeadline = gatewayNow() + GATEWAY_PROBE_TIMEOUT; // the ready event follows
+        else if (nodeState != NODE_ONLINE)
+            gatewayOnline(nodeAddress); // the node cannot tell its address
+        return;
+    }
+    if (request == NULL || length < 1)
+    {
+        counters.strayResponses++;
+        return;
+    }
+    frame->request = NULL;
+    windowUsed--;
+    if (frame->reset)
+        return;
+    request->awaiting = 0;
+    unsigned char status = body[0];
+    if (status == HOSTLINK_STATUS_CHECKSUM)
+    {
+        counters.checksumRetries++;
+        requestRetry(request, 0, "checksum");
+        return;
+    }
+    if (status == HOSTLINK_STATUS_BUSY || status == HOSTLINK_STATUS_NO_MEMORY)
+    {
+        counters.busyRetries++;
+        requestRetry(request, GATEWAY_RETRY_DELAY, statusNames[status]);
+        return;
+    }
+    if (status != HOSTLINK_STATUS_OK)
+    {
+        if (request->queued) // a part has been refused, the remaining parts are not written
+            requestDequeue(request);
+        requestFail(request, status < 5 ? statusNames[status] : "unknown");
+        return;
+    }
+    if (!frame->last)
+        return; // the next part is written by gatewayWriteRequests
+    if (request->queued)
+        requestDequeue(request);
+    counters.accepted++;
+    struct gateway_client *client = clientFind(request->client, request->session);
+    if (request->type == HOSTLINK_REQUEST_SEND && length >= 2)
+    {
+        if (!transportIsDatagram(request->flag) || request->destination == 0 || isMulticast(request->destination))
+            ackAdd(request, body[1]);
+        if (client)
+            clientPrintf(client, "ok %u %u", request->number, body[1]);
+    }
+    else if (request->type == HOSTLINK_REQUEST_STATS)
+    {
+        char line[GATEWAY_LINE_MAX];
+        snprintf(line, sizeof(line), "stats %u", request->number);
+        gatewayPrintFields(line, sizeof(line), statisticsFields, sizeof(statisticsFields) / sizeof(statisticsFields[0]), body + 1, length - 1);
+        if (client)
+            clientPrintf(client, "%s", line);
+    }
+    else
+    {
+        if (request->type == HOSTLINK_REQUEST_CONFIGURE && request->body[0] == HOSTLINK_CONFIG_ADDRESS)
+            nodeAddress = request->body[1];
+        if (client)
+            clientPrintf(client, "ok %u", request->number);
+    }
+    requestFree(request);
+}
+
+/**
+ * A ready event while online means that the node has been reset: it has forgotten the messages waiting for ACK and the parts of a message being collected. Frames waiting for their response are written again after GATEWAY_RESPONSE_TIMEOUT, unless the node answers them. 
+ * @brief This function processes a ready event. 
+ * @param address The address of the node. 
+ */
+void gatewayReady(unsigned char address)
+{
+    if (nodeState != NODE_ONLINE || probeReady)
+    {
+        probeReady = 0;
+        if (nodeState == NODE_ONLINE)
+            nodeAddress = address;
+        else
+            gatewayOnline(address);
+        return;
+    }
+    counters.nodeRestarts++;
+    nodeAddress = address;
+    ackExpire(0);
+    if (queueHead && queueHead->frames > 1 && (queueHead->framesWritten || queueHead->awaiting))
+        requestRetry(queueHead, 0, "restarted");
+    char line[32];
+    snprintf(line, sizeof(line), "node restarted %d", address);
+    clientBroadcast(line);
+}
+
+/**
+ * Received messages are passed to the clients listening to their port. Messages of a port no client listens to are passed to the clients listening to all ports. 
+ * @brief This function passes a received message to the clients. 
+ * @param source The source address. 
+ * @param port The flag of the message. 
+ * @param message The message. 
+ * @param length The length of message. 
+ */
+void gatewayReceived(unsigned char source, unsigned char port, unsigned char *message, int length)
+{
+    char hex[GATEWAY_FRAME_MAX * 2 + 1];
+    int delivered = 0;
+    counters.received++;
+    gatewayHex(hex, message, length);
+    for (int pass = 0; pass < 2 && !delivered; pass++)
+        for (int i = 0; i < GATEWAY_MAX_CLIENTS; i++)
+        {
+            struct gateway_client *client = &clients[i];
+            if (client->fd < 0 || !(pass ? client->listenAll : client->listen[port >> 3] & 1 << (port & 7)))
+                continue;
+            clientPrintf(client, "received %u %u %s", source, port, hex);
+            counters.delivered++;
+            delivered = 1;
+        }
+    if (!delivered)
+        counters.unclaimed++;
+}
+
+/**
+ * @brief This function processes a decoded frame received from the node. 
+ * @param frame The decoded frame. 
+ * @param length The length of the frame. 
+ */
+void gatewayProcessFrame(unsigned char *frame, int length)
+{
+    unsigned char crc = 0;
+    for (int i = 0; i < length - 1; i++)
+        crc = calculateCRC8Update(crc, frame[i]);
+    if (length < 3 || crc != frame[length - 1])
+    {
+        if (nodeState == NODE_ONLINE) // console text is expected before
+            counters.frameErrors++;
+        return;
+    }
+    counters.framesIn++;
+    unsigned char type = frame[0], seq = frame[1];
+    unsigned char *body = frame + 2;
+    int bodyLength = length - 3;
+    if (type == HOSTLINK_EVENT_READY && bodyLength >= 1)
+    {
+        gatewayReady(body[0]);
+        return;
+    }
+    switch (type)
+    {
+        case HOSTLINK_RESPONSE:
+        case HOSTLINK_RESPONSE_STATS:
+            gatewayResponse(type, seq, body, bodyLength);
+            break;
+        case HOSTLINK_EVENT_RECEIVED:
+            if (bodyLength >= 2)
+                gatewayReceived(body[0], body[1], body + 2, bodyLength - 2);
+            break;
+        case HOSTLINK_EVENT_ACKED:
+            if (bodyLength >= 2)
+                ackEvent(0, body[0], body[1], "acked", &counters.acked);
+            break;
+        case HOSTLINK_EVENT_FAILED:
+            if (bodyLength >= 2)
+                ackEvent(0, body[0], body[1], "failed", &counters.failed);
+            break;
+        case HOSTLINK_EVENT_BROADCASTED:
+            if (bodyLength >= 1)
+                ackEvent(1, bodyLength >= 2 ? body[1] : 0, body[0], "broadcasted", &counters.broadcasted);
+            break;
+        default:
+            counters.strayResponses++;
+            break;
+    }
+}
+
+/**
+ * @brief This function appends a decoded byte to the frame from the node, or marks the frame as too long. 
+ * @param byte The decoded byte. 
+ */
+void gatewayAppend(unsigned char byte)
+{
+    if (frameInLength < GATEWAY_FRAME_MAX)
+        frameIn[frameInLength++] = byte;
+    else
+        frameOverflow = 1;
+}
+
+/**
+ * @brief This function decodes a byte received from the node, in the same way as hostlinkReceiveByte. 
+ * @param byte The byte. 
+ */
+void gatewayReceiveByte(unsigned char byte)
+{
+    if (byte == 0) // end of frame
+    {
+        if (frameInLength && !frameOverflow)
+            gatewayProcessFrame(frameIn, frameInLength);
+        frameInLength = blockLeft = blockCode = frameOverflow = 0;
+    }
+    else if (blockLeft == 0) // code byte of the next block
+    {
+        if (blockCode != 0 && blockCode != 0xFF) // the previous block stands for a byte of 0
+            gatewayAppend(0);
+        blockCode = byte;
+        blockLeft = byte - 1;
+    }
+    else
+    {
+        gatewayAppend(byte);
+        blockLeft--;
+    }
+}
+
+/**
+ * The requests at the head of the queue are written until GATEWAY_WINDOW frames wait for their response, so that the UART buffer of the node does not overflow. The frames are written together by serialFlush. 
+ * @brief This function writes requests of the queue to the node. 
+ * @param now The current time. 
+ */
+void gatewayWriteRequests(long long now)
+{
+    while (nodeState == NODE_ONLINE && queueHead && windowUsed < GATEWAY_WINDOW && serialOutputLength < (int)sizeof(serialOutput) - 4 * HOSTLINK_MAX_FRAME)
+    {
+        struct gateway_request *request = queueHead;
+        if (request->notBefore > now || request->awaiting)
+            break;
+        unsigned char seq = gatewayNextSeq();
+        struct gateway_pending *frame = &pending[seq];
+        frame->request = request;
+        frame->deadline = now + GATEWAY_RESPONSE_TIMEOUT;
+        frame->reset = frame->last = 0;
+        windowUsed++;
+        if (request->resetFirst) // a send part request without body discards the collected parts
+        {
+            serialWriteFrame(HOSTLINK_REQUEST_SEND_PART, seq, NULL, 0, NULL, 0);
+            frame->reset = 1;
+            request->resetFirst = 0;
+            continue;
+        }
+        if (request->framesWritten == 0)
+            request->attempts++;
+        frame->last = request->framesWritten == request->frames - 1;
+        if (request->type == HOSTLINK_REQUEST_SEND && request->frames == 1)
+        {
+            unsigned char head[2] = {request->destination, request->flag};
+            serialWriteFrame(HOSTLINK_REQUEST_SEND, seq, head, 2, request->message, request->length);
+        }
+        else if (request->type == HOSTLINK_REQUEST_SEND)
+        {
+            int offset = request->framesWritten * GATEWAY_PART_MAX;
+            int length = request->length - offset < GATEWAY_PART_MAX ? request->length - offset : GATEWAY_PART_MAX;
+            unsigned char head[3] = {request->destination, request->flag, !frame->last};
+            serialWriteFrame(HOSTLINK_REQUEST_SEND_PART, seq, head, 3, request->message + offset, length);
+            request->awaiting = 1;
+        }
+        else
+            serialWriteFrame(request->type, seq, request->body, request->type == HOSTLINK_REQUEST_STATS ? 1 : 3, NULL, 0);
+        if (++request->framesWritten == request->frames && request->frames == 1)
+            requestDequeue(request);
+    }
+    serialFlush();
+}
+
+/**
+ * The probe is a configure request of the binary operating mode after a byte of 0, which ends any partial frame. A node in binary operating mode answers it and sends a ready event with its address. A node in console operating mode takes it as text, so that no carriage return may be part of it. <br>
+ * Output still waiting can only be an earlier probe or switch that the port has not taken, so it is dropped, and repeated probes of a stuck port do not grow the serial output. 
+ * @brief This function writes the probe to find out whether the node speaks the binary host protocol. 
+ * @param now The current time. 
+ */
+void serialProbe(long long now)
+{
+    unsigned char body[3] = {HOSTLINK_CONFIG_MODE, MODE_BINARY, 0};
+    nodeState = NODE_PROBING;
+    counters.probes++;
+    serialOutputLength = 0;
+    serialOutput[serialOutputLength++] = 0;
+    int start = serialOutputLength;
+    while (1)
+    {
+        probeSeq = gatewayNextSeq();
+        serialOutputLength = start;
+        serialWriteFrame(HOSTLINK_REQUEST_CONFIGURE, probeSeq, body, 3, NULL, 0);
+        if (memchr(serialOutput + start, '\r', serialOutputLength - start) == NULL)
+            break;
+        counters.framesOut--;
+    }
+    probeLength = serialOutputLength - start + 1;
+    stateDeadline = now + GATEWAY_PROBE_TIMEOUT;
+    serialFlush();
+}
+
+/**
+ * The probe is erased with backspaces, so that the console of the node reads only /bin, which switches it to the binary host protocol. <br>
+ * Like in serialProbe, output still waiting is dropped. Backspaces for the part of the probe that has not been written are ignored by the console. 
+ * @brief This function switches the node from console operating mode to the binary host protocol. 
+ * @param now The current time. 
+ */
+void serialSwitch(long long now)
+{
+    nodeState = NODE_SWITCHING;
+    counters.switches++;
+    serialOutputLength = 0;
+    for (int i = 0; i < probeLength; i++)
+        serialOutput[serialOutputLength++] = '\b';
+    memcpy(serialOutput + serialOutputLength, "/bin\r", 5);
+    serialOutputLength += 5;
+    stateDeadline = now + GATEWAY_PROBE_TIMEOUT;
+    serialFlush();
+}
+
+/**
+ * @brief This function opens the serial port and probes the node. 
+ * @param now The current time. 
+ */
+void serialOpen(long long now)
+{
+    stateDeadline = now + GATEWAY_RECONNECT;
+    int fd = open(devicePath, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+        return;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baud);
+        cfsetospeed(&tio, baud);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    tcflush(fd, TCIOFLUSH); // output of the node from before is stale
+    counters.connects++;
+    serialFd = fd;
+    serialOutputLength = frameInLength = blockLeft = blockCode = frameOverflow = 0;
+    serialProbe(now);
+}
+
+/**
+ * The frames waiting for their response are written again after reconnecting. Messages waiting for their event are kept, as the node may still send it. 
+ * @brief This function closes the serial port when it has been lost. 
+ * @param now The current time. 
+ */
+void serialClose(long long now)
+{
+    close(serialFd);
+    serialFd = -1;
+    counters.disconnects++;
+    for (int seq = 1; seq < 256; seq++)
+        if (pending[seq].request)
+        {
+            if (!pending[seq].reset)
+                counters.timeoutRetries++;
+            requestRetry(pending[seq].request, 0, "timeout");
+        }
+    probeSeq = -1;
+    probeReady = 0;
+    stateDeadline = now + GATEWAY_RECONNECT;
+    if (nodeState == NODE_ONLINE)
+        clientBroadcast("node offline");
+    nodeState = NODE_OFFLINE;
+}
+
+/**
+ * @brief This function reads from the serial port. 
+ * @param now The current time. 
+ */
+void serialRead(long long now)
+{
+    unsigned char buffer[4096];
+    ssize_t length = read(serialFd, buffer, sizeof(buffer));
+    if (length == 0 || (length < 0 && errno != EAGAIN && errno != EINTR))
+    {
+        serialClose(now);
+        return;
+    }
+    for (ssize_t i = 0; i < length; i++)
+        gatewayReceiveByte(buffer[i]);
+    if (length > 0)
+        counters.bytesIn += length;
+}
+
+/**
+ * @brief This function handles the time-outs of the serial port, the frames written and the messages sent. 
+ * @param now The current time. 
+ */
+void gatewayTimers(long long now)
+{
+    if (nodeState == NODE_OFFLINE && now >= stateDeadline)
+        serialOpen(now);
+    else if (nodeState == NODE_PROBING && now >= stateDeadline)
+        serialSwitch(now);
+    else if (nodeState == NODE_SWITCHING && now >= stateDeadline)
+        serialProbe(now);
+    if (nodeState == NODE_ONLINE)
+        for (int seq = 1; seq < 256; seq++)
+            if (pending[seq].request && pending[seq].deadline <= now)
+            {
+                if (!pending[seq].reset)
+                    counters.timeoutRetries++;
+                requestRetry(pending[seq].request, 0, "timeout");
+            }
+    ackExpire(now);
+}
+
+/**
+ * @brief This function parses a number of a command. 
+ * @param text The text of the number. 
+ * @param max The largest allowed value. 
+ * @param value The parsed value. 
+ * @return 1 if the number is valid, otherwise 0. 
+ */
+int gatewayParse(const char *text, unsigned long max, unsigned long *value)
+{
+    char *end;
+    if (text == NULL || *text == '\0')
+        return 0;
+    *value = strtoul(text, &end, 10);
+    return *end == '\0' && *value <= max;
+}
+
+/**
+ * @brief This function queues a request of a client. 
+ * @param client The client. 
+ * @param type The request type. 
+ * @return The request, whose fields are filled in by the caller. 
+ */
+struct gateway_request *gatewayRequest(struct gateway_client *client, unsigned char type)
+{
+    struct gateway_request *request = calloc(1, sizeof(struct gateway_request));
+    request->client = client - clients;
+    request->session = client->session;
+    request->number = client->requests;
+    request->type = type;
+    request->frames = 1;
+    requestQueue(request);
+    return request;
+}
+
+/**
+ * @brief This function processes a command line of a client. 
+ * @param client The client. 
+ * @param line The line, without line feed. 
+ */
+void clientCommand(struct gateway_client *client, char *line)
+{
+    unsigned int number = ++client->requests;
+    unsigned long destination, flag, key, value;
+    char *command = strtok(line, " ");
+    counters.requests++;
+    if (command == NULL)
+    {
+        clientPrintf(client, "error %u empty", number);
+        return;
+    }
+    if (strcmp(command, "send") == 0 || strcmp(command, "sendx") == 0)
+    {
+        char *destinationText = strtok(NULL, " "), *flagText = strtok(NULL, " "), *text = strtok(NULL, "");
+        int length = text ? strlen(text) : 0;
+        if (!gatewayParse(destinationText, 255, &destination) || !gatewayParse(flagText, 255, &flag))
+        {
+            clientPrintf(client, "error %u usage: %s <destination> <flag> <message>", number, command);
+            return;
+        }
+        unsigned char *message = malloc(length ? length : 1);
+        if (command[4] == 'x') // hex
+        {
+            int valid = length % 2 == 0;
+            for (int i = 0; valid && i < length / 2; i++)
+            {
+                unsigned int byte;
+                valid = sscanf(text + 2 * i, "%2x", &byte) == 1;
+                message[i] = byte;
+            }
+            if (!valid)
+            {
+                free(message);
+                clientPrintf(client, "error %u invalid hex", number);
+                return;
+            }
+            length /= 2;
+        }
+        else
+            memcpy(message, text, length);
+        if (length > TRANSPORT_MAX_MESSAGE)
+        {
+            free(message);
+            clientPrintf(client, "error %u too long", number);
+            return;
+        }
+        struct gateway_request *request = gatewayRequest(client, HOSTLINK_REQUEST_SEND);
+        request->destination = destination;
+        request->flag = flag;
+        request->message = message;
+        request->length = length;
+        if (length > GATEWAY_SEND_MAX) // parts left by a message given up are discarded first
+            request->frames = (length + GATEWAY_PART_MAX - 1) / GATEWAY_PART_MAX, request->resetFirst = 1;
+    }
+    else if (strcmp(command, "listen") == 0 || strcmp(command, "unlisten") == 0)
+    {
+        char *port = strtok(NULL, " ");
+        unsigned char on = command[0] == 'l';
+        if (port && strcmp(port, "*") == 0)
+            client->listenAll = on;
+        else if (gatewayParse(port, 255, &value))
+        {
+            if (on)
+                client->listen[value >> 3] |= 1 << (value & 7);
+            else
+                client->listen[value >> 3] &= ~(1 << (value & 7));
+        }
+        else
+        {
+            clientPrintf(client, "error %u usage: %s <port>|*", number, command);
+            return;
+        }
+        clientPrintf(client, "ok %u", number);
+    }
+    else if (strcmp(command, "stats") == 0)
+    {
+        char *reset = strtok(NULL, " ");
+        struct gateway_request *request = gatewayRequest(client, HOSTLINK_REQUEST_STATS);
+        request->body[0] = reset && reset[0] == 'r';
+    }
+    else if (strcmp(command, "config") == 0)
+    {
+        char *keyText = strtok(NULL, " "), *valueText = strtok(NULL, " ");
+        if (!gatewayParse(keyText, 255, &key) || !gatewayParse(valueText, 65535, &value))
+        {
+            clientPrintf(client, "error %u usage: config <key> <value>", number);
+            return;
+        }
+        if (key == HOSTLINK_CONFIG_MODE) // the gateway needs the binary host protocol
+        {
+            clientPrintf(client, "error %u reserved", number);
+            return;
+        }
+        struct gateway_request *request = gatewayRequest(client, HOSTLINK_REQUEST_CONFIGURE);
+        request->body[0] = key;
+        request->body[1] = value & 0xFF;
+        request->body[2] = value >> 8;
+    }
+    else if (strcmp(command, "counters") == 0)
+    {
+        char line[GATEWAY_LINE_MAX];
+        int queued = 0, waiting = 0, connected = 0;
+        for (struct gateway_request *request = queueHead; request; request = request->next)
+            queued++;
+        for (int i = 0; i < GATEWAY_ACK_ENTRIES; i++)
+            waiting += acks[i].used;
+        for (int i = 0; i < GATEWAY_MAX_CLIENTS; i++)
+            connected += clients[i].fd >= 0;
+        snprintf(line, sizeof(line), "counters %u online=%d address=%d queued=%d window=%d waiting=%d connected=%d", number, nodeState == NODE_ONLINE, nodeAddress, queued, windowUsed, waiting, connected);
+        gatewayPrintFields(line, sizeof(line), counterFields, sizeof(counterFields) / sizeof(counterFields[0]), (unsigned char*)&counters, sizeof(counters));
+        clientPrintf(client, "%s", line);
+    }
+    else
+        clientPrintf(client, "error %u unknown command", number);
+}
+
+/**
+ * @brief This function reads command lines from a client. 
+ * @param client The client. 
+ */
+void clientRead(struct gateway_client *client)
+{
+    char buffer[4096];
+    ssize_t length = read(client->fd, buffer, sizeof(buffer));
+    if (length == 0 || (length < 0 && errno != EAGAIN && errno != EINTR))
+    {
+        clientClose(client);
+        return;
+    }
+    for (ssize_t i = 0; i < length && client->fd >= 0; i++)
+    {
+        if (buffer[i] == '\n')
+        {
+            if (client->lineLength > 0 && client->line[client->lineLength - 1] == '\r')
+                client->lineLength--;
+            if (client->lineLength >= 0)
+            {
+                client->line[client->lineLength] = '\0';
+                clientCommand(client, client->line);
+            }
+            else
+                clientPrintf(client, "error %u too long", ++client->requests);
+            client->lineLength = 0;
+        }
+        else if (client->lineLength >= 0 && client->lineLength < GATEWAY_LINE_MAX - 1)
+            client->line[client->lineLength++] = buffer[i];
+        else
+            client->lineLength = -1; // the line is discarded up to its line feed
+    }
+}
+
+/**
+ * @brief This function writes as much output to a client as its socket takes. 
+ * @param client The client. 
+ */
+void clientFlush(struct gateway_client *client)
+{
+    if (client->fd < 0 || client->outputLength == 0)
+        return;
+    ssize_t written = write(client->fd, client->output, client->outputLength);
+    if (written < 0)
+    {
+        if (errno != EAGAIN && errno != EINTR)
+            clientClose(client);
+        return;
+    }
+    client->outputLength -= written;
+    memmove(client->output, client->output + written, client->outputLength);
+}
+
+/**
+ * @brief This function accepts a client at the Unix socket. 
+ * @param listener The Unix socket. 
+ */
+void clientAccept(int listener)
+{
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+        return;
+    for (int i = 0; i < GATEWAY_MAX_CLIENTS; i++)
+        if (clients[i].fd < 0)
+        {
+            struct gateway_client *client = &clients[i];
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            memset(client, 0, sizeof(struct gateway_client));
+            client->fd = fd;
+            client->session = ++sessions;
+            counters.clients++;
+            if (nodeState == NODE_ONLINE)
+                clientPrintf(client, "node online %d", nodeAddress);
+            else
+                clientPrintf(client, "node offline");
+            return;
+        }
+    close(fd); // too many clients
+}
+
+/**
+ * @brief This function opens the Unix socket for clients. 
+ * @param path The path of the socket. 
+ * @return The socket, or -1 on error. 
+ */
+int gatewayListen(const char *path)
+{
+    struct sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || strlen(path) >= sizeof(address.sun_path))
+        return -1;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 8) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+/**
+ * @brief This function converts a baud rate to its termios constant. 
+ * @param rate The baud rate. 
+ * @return The constant, or B0 if the rate is not supported. 
+ */
+speed_t gatewayBaud(long rate)
+{
+    switch (rate)
+    {
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        default: return B0;
+    }
+}
+
+/**
+ * The gateway runs one loop: it polls the serial port, the Unix socket and the clients, then handles time-outs and writes the queued requests. 
+ * @brief This function runs the gateway. 
+ * @param argc The number of arguments. 
+ * @param argv The arguments. 
+ * @return 0 when stopped by a signal, 1 on error. 
+ */
+int main(int argc, char **argv)
+{
+    const char *socketPath = GATEWAY_SOCKET;
+    int option;
+    while ((option = getopt(argc, argv, "d:s:b:a:")) != -1)
+    {
+        if (option == 'd')
+            devicePath = optarg;
+        else if (option == 's')
+            socketPath = optarg;
+        else if (option == 'b' && (baud = gatewayBaud(atol(optarg))) != B0)
+            continue;
+        else if (option == 'a' && atol(optarg) > 0)
+            ackTimeout = atol(optarg) * 1000LL;
+        else
+        {
+            fprintf(stderr, "usage: %s [-d device] [-s socket] [-b baud] [-a ACK time-out in s]\n", argv[0]);
+            return 1;
+        }
+    }
+    int listener = gatewayListen(socketPath);
+    if (listener < 0)
+    {
+        perror(socketPath);
+        return 1;
+    }
+    for (int i = 0; i < GATEWAY_MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, gatewayStop);
+    signal(SIGTERM, gatewayStop);
+    while (running)
+    {
+        long long now = gatewayNow();
+        gatewayTimers(now);
+        gatewayWriteRequests(now);
+        struct pollfd fds[GATEWAY_MAX_CLIENTS + 2];
+        int count = 0, serialIndex = -1;
+        fds[count].fd = listener;
+        fds[count++].events = POLLIN;
+        if (serialFd >= 0)
+        {
+            serialIndex = count;
+            fds[count].fd = serialFd;
+            fds[count++].events = POLLIN | (serialOutputLength ? POLLOUT : 0);
+        }
+        int first = count;
+        for (int i = 0; i < GATEWAY_MAX_CLIENTS; i++)
+        {
+            fds[count].fd = clients[i].fd; // negative descriptors are ignored by poll
+            fds[count++].events = POLLIN | (clients[i].outputLength ? POLLOUT : 0);
+        }
+        if (poll(fds, count, 50) < 0)
+            continue;
+        now = gatewayNow();
+        if (serialIndex >= 0 && fds[serialIndex].revents)
+        {
+            if (fds[serialIndex].revents & POLLOUT)
+                serialFlush();
+            if (fds[serialIndex].revents & (POLLIN | POLLHUP | POLLERR))
+                serialRead(now);
+        }
+        for (int i = 0; i < GATEWAY_MAX_CLIENTS; i++)
+        {
+            if (clients[i].fd >= 0 && fds[first + i].revents & (POLLIN | POLLHUP | POLLERR))
+                clientRead(&clients[i]);
+        }
+        if (fds[0].revents & POLLIN)
+            clientAccept(listener);
+        for (int i = 0; i < GATEWAY_MAX_CLIENTS; i++)
+            clientFlush(&clients[i]);
+    }
+    unlink(socketPath);
+    return 0;
+}
@@ -0,0 +1,224 @@
+/**
+ * @file hostsim.c
+ * @author David Ng 550084
+ * @brief This program runs the firmware natively on the host, as a single board in loopback. It calls the interrupt handlers of rasp_net.c in turn and wires each sent bit back to the receiving pins, or with PHY_HW_SHIFT each shifted byte back to SPDR. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ * Build with "make hostsim", which builds hostsim, hostsim_trace (TRACE_CAPTURE), hostsim_shift (PHY_HW_SHIFT master) and hostsim_shift_slave (PHY_HW_SHIFT slave), and runs every scenario. <br>
+ * Run "host/hostsim/hostsim <scenario> [<lag>]", where the scenario is one of: <br>
+ * preempt: an ACK preempts a 120-byte frame, followed by a frame of escape bytes. <br>
+ * bench: benchmark runs to the own address, as datagrams, as broadcast and to a missing destination. <br>
+ * soak: rounds of looped-back benchmark messages, printing the heap in use after each round. <br>
+ * ping: ring ping probes. <br>
+ * trace: the preempt scenario with a trace capture, dumped for host/trace/trace_decode (hostsim_trace only). <br>
+ * In the hardware-shifted builds, the main loop runs only after every lag-th byte, to let the receive queue fill up. <br>
+ * The simulation is deterministic and counts periods at speed 1, but not CPU cycles, so it checks the data paths and the heap, not rates or timing. The heap is the one of the host, i.e. only differences between rounds are meaningful. 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <avr/io.h>
+#include "../../layer2/data_struct.h"
+#include "../../layer2/data_link.h"
+#include "../../layer4/transport.h"
+#include "../../scheduler/scheduler.h"
+#include "../../stats/stats.h"
+#include "../../traffic/traffic.h"
+#include "../../ping/ping.h"
+#include "../../irq/clock_init.h"
+#ifdef TRACE_CAPTURE
+#include "../../trace/trace.h"
+#endif
+
+#define HOSTSIM_BYTES_PER_PERIOD 10 ///< This is how many bytes are shifted per timer period in the hardware-shifted builds. 
+#define HOSTSIM_RUNS_PER_PERIOD 4 ///< This is how many times the main loop runs per timer period or byte. 
+
+volatile uint8_t PORTB, PORTC, PORTD, DDRB, DDRC, DDRD, PINB, PINC, PIND;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UDR0, UBRR0H, UBRR0L;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, TIMSK0, TIFR0, OCR0A;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, TIMSK2, OCR2A, GTCCR;
+volatile uint8_t PCICR, PCIFR, PCMSK0, PCMSK2, SPCR, SPSR, SPDR, SMCR, MCUSR, SREG;
+volatile uint16_t UBRR0, OCR1A, OCR1B, TCNT1, SP = RAMEND;
+char __heap_start, __bss_end, _end;
+char *__brkval;
+size_t __malloc_margin;
+
+extern struct receive_buffer bufferReceive;
+extern struct statistics stats;
+extern int ADDRESS;
+extern int printMode;
+
+void TIMER1_COMPA_vect(void);
+#ifdef PHY_HW_SHIFT
+void SPI_STC_vect(void);
+#ifdef PHY_SHIFT_MASTER
+void TIMER2_COMPA_vect(void);
+#endif
+#else
+void PCINT2_vect(void);
+#endif
+
+int hostsimLag = 0; ///< This denotes after how many shifted bytes the main loop runs. 0 means after every byte. 
+
+void _delay_ms(double ms)
+{
+}
+
+void eeprom_read_block(void *destination, const void *source, size_t length)
+{
+    memset(destination, 0xFF, length); // erased, i.e. no stored configuration
+}
+
+void eeprom_update_block(const void *source, void *destination, size_t length)
+{
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+}
+
+/**
+ * @brief This function returns how many bytes of the heap of the host are in use. 
+ * @return The bytes in use. 
+ */
+size_t hostsimHeap()
+{
+    return mallinfo2().uordblks;
+}
+
+/**
+ * In the bit-level build, PB4 and PB5 are wired back to PD4 and PD5 after every timer interrupt, which always toggles the clock, so the pin change interrupt follows. <br>
+ * In the hardware-shifted builds, MOSI is wired back to MISO, i.e. SPDR keeps the byte shifted out, and the SPI interrupt follows every byte clock. 
+ * @brief This function runs the firmware for a number of timer periods. 
+ * @param periods The number of timer periods. 
+ */
+void hostsimRun(int periods)
+{
+    for (int period = 0; period < periods; period++)
+    {
+        TIMER1_COMPA_vect();
+#ifdef PHY_HW_SHIFT
+        for (int byte = 0; byte < HOSTSIM_BYTES_PER_PERIOD; byte++)
+        {
+#ifdef PHY_SHIFT_MASTER
+            TIMER2_COMPA_vect();
+#endif
+            SPI_STC_vect();
+            if (hostsimLag == 0 || byte % hostsimLag == 0)
+                for (int run = 0; run < HOSTSIM_RUNS_PER_PERIOD; run++)
+                    schedulerRun();
+        }
+#else
+        PIND = (PIND & ~(1 << PD4 | 1 << PD5)) | (PORTB & (1 << PB4 | 1 << PB5));
+        PCINT2_vect();
+        for (int run = 0; run < HOSTSIM_RUNS_PER_PERIOD; run++)
+            schedulerRun();
+#endif
+    }
+}
+
+/**
+ * @brief This function builds a message to the own address from address 3. 
+ * @param length The length of the payload, including the network and transport header. 
+ * @param flag The transport flag. 
+ * @param fill The byte to fill the message with, or 0 for letters mixed with escape bytes. 
+ * @return The payload. 
+ */
+unsigned char *hostsimMessage(int length, unsigned char flag, unsigned char fill)
+{
+    unsigned char *payload = malloc(length);
+    payload[0] = ADDRESS, payload[1] = 3, payload[2] = 7, payload[3] = flag;
+    for (int i = 4; i < length; i++)
+        payload[i] = fill ? fill : (i % 3 ? 'a' + i % 26 : ESCAPE);
+    return payload;
+}
+
+/**
+ * @brief This function queues a long frame, lets an urgent ACK preempt it, and then sends a frame of escape bytes. 
+ * @param length The length of the long frame. 
+ */
+void hostsimPreempt(int length)
+{
+    prepareDataNodeForSending(length, hostsimMessage(length, 2, 0), 0);
+    hostsimRun(length * 2);
+#ifdef TRACE_CAPTURE
+    traceTrigger(1);
+#endif
+    unsigned char *ack = malloc(5);
+    ack[0] = ADDRESS, ack[1] = 3, ack[2] = 9, ack[3] = 1, ack[4] = 0x83;
+    prepareDataNodeForSending(5, ack, 1);
+    hostsimRun(length * 8 * 2);
+    prepareDataNodeForSending(length / 3, hostsimMessage(length / 3, 2, ESCAPE), 0);
+    hostsimRun(length * 8);
+}
+
+/**
+ * @brief This function runs one benchmark run to the own address, one as datagrams, one as broadcast and one to a missing destination. 
+ */
+void hostsimBench()
+{
+    trafficStart(ADDRESS, 6, 8, 32, 0, 0);
+    hostsimRun(6000);
+    trafficStart(ADDRESS, 4, 10, 10, 20, 1);
+    hostsimRun(3000);
+    trafficStart(0, 3, 12, 12, 0, 0);
+    hostsimRun(3000);
+    trafficStart(33, 2, 5, 5, 0, 0);
+    hostsimRun(3000);
+}
+
+/**
+ * @brief This function runs rounds of looped-back benchmark messages, alternating with broadcast and datagram rounds, and prints the heap in use after each round. 
+ * @param rounds The number of rounds. 
+ */
+void hostsimSoak(int rounds)
+{
+    size_t start = hostsimHeap();
+    for (int round = 0; round < rounds; round++)
+    {
+        trafficStart(round % 2 ? 0 : ADDRESS, 5, 8, 100, 0, round % 3 == 2);
+        hostsimRun(20000);
+        printf("\r\nhostsim: round %d heap %+ld\r\n", round, (long)(hostsimHeap() - start));
+    }
+}
+
+#undef main // main of rasp_net.c is renamed to rasp_main by the build, as generalInit waits for the console
+int main(int argc, char **argv)
+{
+    const char *scenario = argc > 1 ? argv[1] : "bench";
+    hostsimLag = argc > 2 ? atoi(argv[2]) : 0;
+    bufferReceive.buffer = calloc(5, 1);
+    transportCacheArrayInit();
+#ifdef PHY_HW_SHIFT
+    shiftInterruptInit();
+#endif
+    if (!strcmp(scenario, "preempt"))
+        hostsimPreempt(120);
+    else if (!strcmp(scenario, "bench"))
+        hostsimBench();
+    else if (!strcmp(scenario, "soak"))
+        hostsimSoak(6);
+    else if (!strcmp(scenario, "ping"))
+    {
+        pingStart(3);
+        hostsimRun(3000);
+    }
+#ifdef TRACE_CAPTURE
+    else if (!strcmp(scenario, "trace"))
+    {
+        hostsimPreempt(30);
+        traceDump(0);
+    }
+#endif
+    else
+    {
+        fprintf(stderr, "Unknown scenario %s\n", scenario);
+        return 1;
+    }
+    printf("\r\nhostsim: %s received %u crc failures %u header crc failures %u overruns %u preemptions %u sent %u\r\n", scenario, stats.framesReceived, stats.crcFailures, stats.headerCrcFailures, stats.receiveOverruns, stats.preemptions, stats.framesSent);
+    return 0;
+}
@@ -0,0 +1,7 @@
+// Host stand-in for <avr/eeprom.h>. The EEPROM is erased, as in simavr.
+#include <stdint.h>
+#include <stddef.h>
+#define EEMEM
+void eeprom_read_block(void *destination, const void *source, size_t length);
+void eeprom_update_block(const void *source, void *destination, size_t length);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
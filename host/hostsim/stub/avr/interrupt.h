@@ -0,0 +1,4 @@
+// Host stand-in for <avr/interrupt.h>. hostsim.c calls the interrupt functions itself.
+#define ISR(vector) void vector(void); void vector(void)
+#define sei()
+#define cli()
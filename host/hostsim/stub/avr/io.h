@@ -0,0 +1,55 @@
+// Host stand-in for <avr/io.h>. The registers are plain variables defined in hostsim.c, the bit numbers are those of the ATmega328p.
+#include <stdint.h>
+
+#define HOSTSIM_REG8(name) extern volatile uint8_t name
+#define HOSTSIM_REG16(name) extern volatile uint16_t name
+
+HOSTSIM_REG8(PORTB); HOSTSIM_REG8(PORTC); HOSTSIM_REG8(PORTD);
+HOSTSIM_REG8(DDRB); HOSTSIM_REG8(DDRC); HOSTSIM_REG8(DDRD);
+HOSTSIM_REG8(PINB); HOSTSIM_REG8(PINC); HOSTSIM_REG8(PIND);
+HOSTSIM_REG8(UCSR0A); HOSTSIM_REG8(UCSR0B); HOSTSIM_REG8(UCSR0C); HOSTSIM_REG8(UDR0);
+HOSTSIM_REG8(UBRR0H); HOSTSIM_REG8(UBRR0L); HOSTSIM_REG16(UBRR0);
+HOSTSIM_REG8(TCCR0A); HOSTSIM_REG8(TCCR0B); HOSTSIM_REG8(TCNT0); HOSTSIM_REG8(TIMSK0); HOSTSIM_REG8(TIFR0); HOSTSIM_REG8(OCR0A);
+HOSTSIM_REG8(TCCR1A); HOSTSIM_REG8(TCCR1B); HOSTSIM_REG8(TIMSK1); HOSTSIM_REG8(TIFR1);
+HOSTSIM_REG16(OCR1A); HOSTSIM_REG16(OCR1B); HOSTSIM_REG16(TCNT1);
+HOSTSIM_REG8(TCCR2A); HOSTSIM_REG8(TCCR2B); HOSTSIM_REG8(TCNT2); HOSTSIM_REG8(TIMSK2); HOSTSIM_REG8(OCR2A);
+HOSTSIM_REG8(GTCCR);
+HOSTSIM_REG8(PCICR); HOSTSIM_REG8(PCIFR); HOSTSIM_REG8(PCMSK0); HOSTSIM_REG8(PCMSK2);
+HOSTSIM_REG8(SPCR); HOSTSIM_REG8(SPSR); HOSTSIM_REG8(SPDR);
+HOSTSIM_REG8(SMCR); HOSTSIM_REG8(MCUSR); HOSTSIM_REG8(SREG);
+HOSTSIM_REG16(SP);
+
+enum {PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7};
+enum {PC0, PC1, PC2, PC3, PC4, PC5};
+enum {PD0, PD1, PD2, PD3, PD4, PD5, PD6, PD7};
+enum {DDB0, DDB1, DDB2, DDB3, DDB4, DDB5};
+enum {DDC0, DDC1, DDC2, DDC3};
+enum {DDD0, DDD1, DDD2, DDD3, DDD4, DDD5, DDD6, DDD7};
+enum {MPCM0, U2X0, UPE0, DOR0, FE0, UDRE0, TXC0, RXC0};
+enum {TXB80, RXB80, UCSZ02, TXEN0, RXEN0, UDRIE0, TXCIE0, RXCIE0};
+enum {UCPOL0, UCSZ00, UCSZ01, USBS0, UPM00, UPM01, UMSEL00, UMSEL01};
+#define UCPHA0 1
+#define UDORD0 2
+enum {CS00, CS01, CS02};
+enum {CS10, CS11, CS12, WGM12, WGM13};
+enum {TOIE1, OCIE1A, OCIE1B};
+enum {TOV1, OCF1A, OCF1B};
+enum {CS20, CS21, CS22};
+enum {WGM20, WGM21};
+enum {TOIE2, OCIE2A, OCIE2B};
+enum {PSRSYNC, PSRASY, TSM = 7};
+enum {PCIE0, PCIE1, PCIE2};
+enum {PCIF0, PCIF1, PCIF2};
+enum {PCINT16, PCINT17, PCINT18, PCINT19, PCINT20, PCINT21, PCINT22, PCINT23};
+enum {SPR0, SPR1, CPHA, CPOL, MSTR, DORD, SPE, SPIE};
+enum {SPI2X, WCOL = 6, SPIF = 7};
+#define SREG_I 7
+
+#define RAMSTART 0x100
+#define RAMEND 0x8FF
+#define E2END 0x3FF
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(reg, bit) ((reg) & _BV(bit))
+#define bit_is_clear(reg, bit) (!bit_is_set(reg, bit))
+#define loop_until_bit_is_set(reg, bit) do {} while (!bit_is_set(reg, bit))
@@ -0,0 +1,5 @@
+// Host stand-in for <avr/pgmspace.h>, flash and SRAM are the same on the host.
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const unsigned char *)(address))
+#define printf_P printf
@@ -0,0 +1,7 @@
+// Host stand-in for <avr/sleep.h>, the main loop never sleeps on the host.
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()
+#define sleep_mode()
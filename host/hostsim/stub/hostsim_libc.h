@@ -0,0 +1,10 @@
+// Host stand-in for the avr-libc parts of <stdio.h> and the heap symbols of the linker, included before every file.
+#include <stdio.h>
+#include <stddef.h>
+#define _FDEV_SETUP_READ 1
+#define _FDEV_SETUP_WRITE 2
+#define _FDEV_SETUP_RW 3
+#define FDEV_SETUP_STREAM(put, get, flags) {0}
+extern char __heap_start, __bss_end, _end;
+extern char *__brkval;
+extern size_t __malloc_margin;
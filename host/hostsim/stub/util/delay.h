@@ -0,0 +1,2 @@
+// Host stand-in for <util/delay.h>, time only passes through hostsim.c.
+void _delay_ms(double ms);
@@ -0,0 +1,3 @@
+// Host stand-in for <util/setbaud.h>.
+#define UBRRH_VALUE 0
+#define UBRRL_VALUE 77
@@ -0,0 +1,67 @@
+/**
+ * @file loopback.c
+ * @author David Ng 550084
+ * @brief This program runs rasp_net.elf in simavr with PB4 and PB5 wired back to PD4 and PD5, as a single board in loopback, and prints its UART output. With LOOPBACK_SHIFT, the SPI output is wired back to its input instead, as a master of the hardware-shifted physical layer without slaves. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ * Build and run with "make traffic_sim", which builds the firmware with TRAFFIC_AT_BOOT, so that a benchmark run starts at boot, or with "make shift_sim" for the hardware-shifted physical layer. 
+ * The simulation is deterministic, so every run with the same firmware prints the same results. 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+#include <simavr/avr_spi.h>
+
+#define LOOPBACK_FREQUENCY 12000000 ///< This is F_CPU of the firmware. 
+#define LOOPBACK_SPEED '5' ///< This is the answer to the speed prompt, as the EEPROM of simavr is empty. 
+
+/**
+ * @brief This function prints a byte written to UART by the firmware. 
+ * @param irq The UART output IRQ. 
+ * @param value The byte. 
+ * @param param Not used. 
+ */
+void loopbackUartOutput(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    putchar(value);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    const char *firmware = argc > 1 ? argv[1] : "rasp_net.elf";
+    unsigned long seconds = argc > 2 ? strtoul(argv[2], NULL, 0) : 600;
+    elf_firmware_t elf = {{0}};
+    if (elf_read_firmware(firmware, &elf) != 0)
+    {
+        fprintf(stderr, "Cannot read %s\n", firmware);
+        return 1;
+    }
+    avr_t *avr = avr_make_mcu_by_name("atmega328p");
+    if (avr == NULL)
+        return 1;
+    avr_init(avr);
+    avr->frequency = LOOPBACK_FREQUENCY;
+    avr_load_firmware(avr, &elf);
+#ifdef LOOPBACK_SHIFT
+    // MOSI to MISO, i.e. every byte shifted out is shifted in again
+    avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ('0'), SPI_IRQ_OUTPUT), avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ('0'), SPI_IRQ_INPUT));
+#else
+    // clock PB4 to PD4 and data PB5 to PD5, as wired on the board
+    avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 4), avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 4));
+    avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 5), avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 5));
+#endif
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), loopbackUartOutput, NULL);
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT), LOOPBACK_SPEED);
+    avr_cycle_count_t end = (avr_cycle_count_t)seconds * LOOPBACK_FREQUENCY;
+    int state = cpu_Running;
+    while (state != cpu_Done && state != cpu_Crashed && avr->cycle < end)
+        state = avr_run(avr);
+    printf("\nSimulated %lu s\n", (unsigned long)(avr->cycle / LOOPBACK_FREQUENCY));
+    return 0;
+}
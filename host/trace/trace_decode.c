@@ -0,0 +1,281 @@
+/**
+ * @file trace_decode.c
+ * @author David Ng 550084
+ * @brief This program decodes on the host a trace dump of the trace build into frames, triggers and timing faults. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ * Build with "make trace_decode". Capture the serial output of /trace into a file and run "host/trace/trace_decode file", or pipe it to standard input. 
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../layer2/data_struct.h"
+#include "../../crc/crc.h"
+#include "../../trace/trace.h"
+
+#define DUMP_MAX 65536 ///< This denotes how many bytes of input are read at most. 
+#define TIMING_TOLERANCE 1 ///< This denotes how many periods an entry may be early or late before it is reported, as received bits follow the clock of the previous node. 
+
+/// This structure is a frame being decoded.
+struct trace_frame
+{
+    unsigned char header[HEADER_MAX_LENGTH]; ///< This is the received header. 
+    unsigned char payload[256]; ///< This is the received payload. 
+    unsigned char type; ///< 0 while receiving header, 1 while receiving payload. 
+    unsigned char index; ///< This is the position in header or payload. 
+    unsigned int startStamp; ///< This is the period stamp of the last bit of the premeable. 
+};
+
+/// This structure is the receiver of a channel, which follows receiveByte and receiveByteManagement of data link layer.
+struct trace_decoder
+{
+    const char *name; ///< This is the name of the channel in the output. 
+    unsigned char active; ///< This flag denotes that a frame is being decoded. 
+    unsigned char window; ///< This is the shift register for premeable detection. 
+    unsigned char byte; ///< This is the byte being collected. 
+    unsigned char bitCount; ///< This denotes how many bits of the byte have been collected. 
+    unsigned char escaped; ///< This flag denotes that the last byte was ESCAPE. 
+    unsigned char depth; ///< 1 while an urgent frame preempts the frame in frames[0]. 
+    struct trace_frame frames[2]; ///< These are the preempted frame and the urgent frame. 
+    int seen; ///< This flag denotes that the channel has had an entry, so that lastStamp is valid. 
+    unsigned int lastStamp; ///< This is the period stamp of the last entry of the channel. 
+    int framesGood; ///< This denotes how many frames with a matching CRC32 have been decoded. 
+    int framesBad; ///< This denotes how many frames have been dropped or failed the CRC32. 
+    int timingFaults; ///< This denotes how many entries have arrived too early or too late. 
+};
+
+const char *triggerNames[] = {"none", "manual", "header CRC", "CRC", "length", "time-out"}; ///< These are the names of the TRACE_TRIGGER definitions. 
+const int periodsPerSecond[] = {5, 25, 50, 100, 200}; ///< These are the periods per second at speed 1 to 5. 
+
+/**
+ * @brief This function ends the frame being decoded, so that the decoder hunts for the premeable again. 
+ * @param decoder The decoder of the channel. 
+ * @param stamp The period stamp of the last bit. 
+ * @param reason Why the frame is dropped. 
+ */
+void decoderAbort(struct trace_decoder *decoder, unsigned int stamp, const char *reason)
+{
+    printf("%5u %s frame from %u dropped: %s\n", stamp, decoder->name, decoder->frames[0].startStamp, reason);
+    decoder->framesBad++;
+    decoder->active = decoder->depth = decoder->escaped = decoder->window = 0;
+}
+
+/**
+ * The CRC32, CRC-16 or CRC-8 of the payload, as given by the check type, is compared with the check in the header, as receiveProcess does. <br>
+ * If the frame has preempted another one, the preempted frame is resumed. 
+ * @brief This function prints a completely decoded frame. 
+ * @param decoder The decoder of the channel. 
+ * @param stamp The period stamp of the last bit. 
+ */
+void decoderFinish(struct trace_decoder *decoder, unsigned int stamp)
+{
+    struct trace_frame *frame = &decoder->frames[decoder->depth];
+    unsigned char length = frame->header[1];
+    unsigned char type = headerCheckType(frame->header);
+    unsigned long receivedCRC = 0;
+    for (int i = 0; i < checkLength(type); i++)
+        receivedCRC = receivedCRC << 8 | frame->header[2 + i];
+    unsigned long crc = type == CHECK_CRC8 ? calculateCRC8(frame->payload, length) : type == CHECK_CRC16 ? calculateCRC16(frame->payload, length) : calculateCRC(frame->payload, length);
+    int good = crc == receivedCRC;
+    printf("%5u %s %sframe from %u: destination %u, source %u, length %u, CRC%s %s\n     ", stamp, decoder->name, decoder->depth ? "urgent " : "", frame->startStamp, frame->payload[0], frame->payload[1], length, type == CHECK_CRC8 ? "-8" : type == CHECK_CRC16 ? "-16" : "32", good ? "ok" : "failed");
+    for (int i = 2; i < length; i++)
+        printf(" %02X", frame->payload[i]);
+    printf("\n");
+    if (good)
+        decoder->framesGood++;
+    else
+        decoder->framesBad++;
+    if (decoder->depth)
+        decoder->depth = 0;
+    else
+        decoder->active = decoder->window = 0;
+}
+
+/**
+ * ESCAPE is not stored, but marks the next byte: ESCAPE_LITERAL stands for ESCAPE, ESCAPE_PREEMPT starts an urgent frame, and ESCAPE_FILL is ignored. <br>
+ * The check type is checked with the first byte of the header, the length when the header is complete, and the header CRC when the 2 addresses have arrived. 
+ * @brief This function decodes a byte of a frame. 
+ * @param decoder The decoder of the channel. 
+ * @param byte The byte. 
+ * @param stamp The period stamp of the last bit of the byte. 
+ */
+void decoderByte(struct trace_decoder *decoder, unsigned char byte, unsigned int stamp)
+{
+    struct trace_frame *frame = &decoder->frames[decoder->depth];
+    if (!decoder->escaped && byte == ESCAPE)
+    {
+        decoder->escaped = 1;
+        return;
+    }
+    if (decoder->escaped)
+    {
+        decoder->escaped = 0;
+        if (byte == ESCAPE_PREEMPT)
+        {
+            if (frame->type != 1 || decoder->depth)
+            {
+                decoderAbort(decoder, stamp, "invalid preemption");
+                return;
+            }
+            printf("%5u %s frame from %u preempted after %u bytes of payload\n", stamp, decoder->name, frame->startStamp, frame->index);
+            decoder->depth = 1;
+            memset(&decoder->frames[1], 0, sizeof(struct trace_frame));
+            decoder->frames[1].startStamp = stamp;
+            return;
+        }
+        if (byte == ESCAPE_FILL)
+            return;
+        if (byte != ESCAPE_LITERAL)
+        {
+            decoderAbort(decoder, stamp, "invalid escape");
+            return;
+        }
+        byte = ESCAPE;
+    }
+    if (frame->type == 0)
+    {
+        frame->header[frame->index++] = byte;
+        if (frame->index == 1 && headerCheckType(frame->header) > CHECK_CRC8)
+            decoderAbort(decoder, stamp, "invalid check type");
+        else if (frame->index == headerLength(frame->header))
+        {
+            if (frame->header[1] < 2)
+            {
+                decoderAbort(decoder, stamp, "length out of range");
+                return;
+            }
+            frame->type = 1;
+            frame->index = 0;
+        }
+        return;
+    }
+    frame->payload[frame->index++] = byte;
+    if (frame->index == 2 && (calculateCRC8((unsigned char[]){headerCheckType(frame->header), frame->header[1], frame->payload[0], frame->payload[1]}, 4) & 0x3F) != (frame->header[0] & 0x3F))
+        decoderAbort(decoder, stamp, "header CRC not matched");
+    else if (frame->index == frame->header[1])
+        decoderFinish(decoder, stamp);
+}
+
+/**
+ * Outside of a frame, the bit is shifted into the window until the premeable is found. Inside, bits are collected into bytes. 
+ * @brief This function decodes a bit of a channel. 
+ * @param decoder The decoder of the channel. 
+ * @param bit The bit. 
+ * @param stamp The period stamp of the bit. 
+ */
+void decoderBit(struct trace_decoder *decoder, unsigned char bit, unsigned int stamp)
+{
+    if (!decoder->active)
+    {
+        decoder->window = decoder->window << 1 | bit;
+        if (decoder->window == PREMEABLE)
+        {
+            decoder->active = 1;
+            decoder->depth = decoder->escaped = decoder->bitCount = 0;
+            memset(&decoder->frames[0], 0, sizeof(struct trace_frame));
+            decoder->frames[0].startStamp = stamp;
+        }
+        return;
+    }
+    decoder->byte = decoder->byte << 1 | bit;
+    if (++decoder->bitCount == 8)
+    {
+        decoder->bitCount = 0;
+        decoderByte(decoder, decoder->byte, stamp);
+    }
+}
+
+/**
+ * One bit is sent or received per period, so an entry of n bits is expected n periods after the previous entry of its channel. <br>
+ * The bits are spread backwards over the periods before the stamp of the entry. 
+ * @brief This function checks the timing of an entry and decodes its bits. 
+ * @param decoder The decoder of the channel. 
+ * @param stamp The period stamp of the entry. 
+ * @param data The 8 bits of the entry. 
+ * @param bytes How many bytes the entry stands for: 1 for bits, the length of the run for a run of bytes of 0. 
+ */
+void decoderEntry(struct trace_decoder *decoder, unsigned int stamp, unsigned char data, unsigned int bytes)
+{
+    unsigned int bits = bytes * 8;
+    if (decoder->seen)
+    {
+        int elapsed = (uint16_t)(stamp - decoder->lastStamp);
+        if (elapsed < (int)bits - TIMING_TOLERANCE || elapsed > (int)bits + TIMING_TOLERANCE)
+        {
+            printf("%5u %s timing fault: %u bits in %d periods\n", stamp, decoder->name, bits, elapsed);
+            decoder->timingFaults++;
+        }
+    }
+    decoder->seen = 1;
+    decoder->lastStamp = stamp;
+    for (unsigned int i = 0; i < bits; i++)
+        decoderBit(decoder, bytes == 1 ? data >> (7 - i) & 1 : 0, (uint16_t)(stamp - bits + 1 + i));
+}
+
+/**
+ * The dump is searched for TRACE_DUMP_MARKER followed by a matching CRC-8, as the console output around it may contain the marker as well. 
+ * @brief This function finds a valid dump in the input. 
+ * @param input The input. 
+ * @param length The length of the input. 
+ * @return The position of the byte after the marker, or -1 if there is no valid dump. 
+ */
+long findDump(unsigned char *input, long length)
+{
+    for (long i = 0; i + 6 <= length; i++)
+    {
+        if (input[i] != TRACE_DUMP_MARKER || input[i + 1] != TRACE_DUMP_VERSION)
+            continue;
+        long size = 4 + input[i + 4] * 4L;
+        if (i + 1 + size + 1 > length)
+            continue;
+        unsigned char crc = 0;
+        for (long j = 0; j < size; j++)
+            crc = calculateCRC8Update(crc, input[i + 1 + j]);
+        if (crc == input[i + 1 + size])
+            return i + 1;
+    }
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *file = argc > 1 ? fopen(argv[1], "rb") : stdin;
+    if (file == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    unsigned char *input = malloc(DUMP_MAX);
+    long length = fread(input, 1, DUMP_MAX, file);
+    long start = findDump(input, length);
+    if (start < 0)
+    {
+        fprintf(stderr, "No valid trace dump found\n");
+        return 1;
+    }
+    unsigned char speed = input[start + 1], reason = input[start + 2], count = input[start + 3];
+    printf("Speed %u, %d periods per second, trigger %s, %u entries\n", speed, speed >= 1 && speed <= 5 ? periodsPerSecond[speed - 1] : 0, reason < 6 ? triggerNames[reason] : "unknown", count);
+    struct trace_decoder decoders[2] = {{.name = "RX"}, {.name = "TX"}};
+    for (int i = 0; i < count; i++)
+    {
+        unsigned char *entry = &input[start + 4 + i * 4];
+        unsigned int stamp = entry[0] | entry[1] << 8;
+        unsigned char kind = entry[2];
+        if (kind == TRACE_KIND_TRIGGER)
+            printf("%5u trigger: %s\n", stamp, entry[3] < 6 ? triggerNames[entry[3]] : "unknown");
+        else if ((kind & ~1) == TRACE_KIND_BITS)
+            decoderEntry(&decoders[kind & 1], stamp, entry[3], 1);
+        else if ((kind & ~1) == TRACE_KIND_IDLE)
+            decoderEntry(&decoders[kind & 1], stamp, 0, entry[3]);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (decoders[i].active)
+            printf("%s frame from %u incomplete at end of capture\n", decoders[i].name, decoders[i].frames[0].startStamp);
+        printf("%s: %d frames ok, %d dropped or failed, %d timing faults\n", decoders[i].name, decoders[i].framesGood, decoders[i].framesBad, decoders[i].timingFaults);
+    }
+    return 0;
+}
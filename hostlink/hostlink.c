@@ -0,0 +1,368 @@
+/**
+ * @file hostlink.c
+ * @author David Ng 550084
+ * @brief This component is responsible for the binary host protocol, which exchanges COBS framed requests and events with the host over UART
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "../layer4/transport_struct.h"
+#include "../config/config.h"
+#include "../layer2/rate_limit.h"
+#include "hostlink.h"
+
+extern int ADDRESS;
+extern unsigned char sendQueueLimit;
+extern unsigned char forwardQueueLimit;
+extern unsigned int rateLimit;
+extern unsigned char rateBurst;
+extern unsigned char rateAimdThreshold;
+extern int sendSpeed;
+extern int operatingMode;
+extern unsigned int msgWaitingPeriod;
+extern unsigned int receiveTimeoutPeriods;
+extern unsigned char receiveMaxLength;
+extern unsigned char uartTextOutput;
+
+unsigned char hostFrame[HOSTLINK_MAX_FRAME]; ///< This is the buffer of the host frame that is being decoded. 
+int hostFrameIndex = 0; ///< This denotes how many bytes of the host frame have been decoded. 
+unsigned char hostBlockLeft = 0; ///< This denotes how many bytes of the current COBS block are left. 
+unsigned char hostBlockCode = 0; ///< This is the code byte of the current COBS block. 0 means that no block of the frame has been read. 
+unsigned char hostFrameOverflow = 0; ///< This flag denotes that the host frame is too long and will be discarded. 
+unsigned char *hostPartMessage = NULL; ///< This is the message being collected from send part requests. 
+int hostPartLength = 0; ///< This denotes how many bytes of hostPartMessage have been collected. 
+
+/**
+ * Text output of printf is disabled, so that only complete frames are written to UART. Then a byte of 0 ends the text printed before as a frame the host discards, and a ready event is sent to the host. 
+ * @brief This function switches the operating mode to the binary host protocol. 
+ */
+void hostlinkStart()
+{
+    operatingMode = MODE_BINARY;
+    uartTextOutput = 0;
+    hostFrameIndex = hostBlockLeft = hostBlockCode = hostFrameOverflow = 0;
+    uart_write(0);
+    hostlinkEvent(HOSTLINK_EVENT_READY, ADDRESS, 0, NULL, -1);
+}
+
+/**
+ * @brief This function appends a decoded byte to the host frame, or marks the frame as too long. 
+ * @param byte The decoded byte. 
+ */
+void hostlinkAppend(unsigned char byte)
+{
+    if (hostFrameIndex < HOSTLINK_MAX_FRAME)
+        hostFrame[hostFrameIndex++] = byte;
+    else
+        hostFrameOverflow = 1;
+}
+
+/**
+ * Every frame is encoded with COBS, thus it contains no byte of 0, and is terminated by a byte of 0. <br>
+ * A code byte n is followed by n - 1 data bytes, and stands for a byte of 0 after them unless n is 0xFF or it is the last block of the frame. <br>
+ * When a frame is terminated, it is passed to hostlinkProcessFrame. Frames longer than HOSTLINK_MAX_FRAME are discarded. 
+ * @brief This function decodes a byte received from the host. 
+ * @param byte The byte received from UART. 
+ */
+void hostlinkReceiveByte(unsigned char byte)
+{
+    if (byte == 0) // end of frame
+    {
+        if (hostFrameIndex && !hostFrameOverflow)
+            hostlinkProcessFrame(hostFrame, hostFrameIndex);
+        hostFrameIndex = hostBlockLeft = hostBlockCode = hostFrameOverflow = 0;
+    }
+    else if (hostBlockLeft == 0) // code byte of the next block
+    {
+        if (hostBlockCode != 0 && hostBlockCode != 0xFF) // the previous block stands for a byte of 0
+            hostlinkAppend(0);
+        hostBlockCode = byte;
+        hostBlockLeft = byte - 1;
+    }
+    else
+    {
+        hostlinkAppend(byte);
+        hostBlockLeft--;
+    }
+}
+
+/**
+ * @brief This function gives the response status of a send request refused by initiateSend. 
+ * @param error One of the TRANSPORT_ERROR definitions. 
+ * @return One of the HOSTLINK_STATUS definitions. 
+ */
+unsigned char hostlinkSendStatus(int error)
+{
+    if (error == TRANSPORT_ERROR_TOO_LONG)
+        return HOSTLINK_STATUS_INVALID;
+    if (error == TRANSPORT_ERROR_NO_MEMORY)
+        return HOSTLINK_STATUS_NO_MEMORY;
+    return HOSTLINK_STATUS_BUSY;
+}
+
+/**
+ * The last byte of the frame is a CRC-8 over all other bytes. The first 2 bytes are type and sequence number, the remaining bytes are the body of the request. <br>
+ * Every request is answered with a response carrying the same sequence number, so that the host can send many requests without waiting for responses. 
+ * @brief This function processes a decoded frame received from the host. 
+ * @param frame The decoded frame. 
+ * @param length The length of the frame. 
+ */
+void hostlinkProcessFrame(unsigned char *frame, int length)
+{
+    unsigned char seq = length > 1 ? frame[1] : 0;
+    unsigned char response[2] = {HOSTLINK_STATUS_OK, 0};
+    if (length < 3 || calculateCRC8(frame, length - 1) != frame[length - 1])
+    {
+        response[0] = HOSTLINK_STATUS_CHECKSUM;
+        hostlinkSendFrame(HOSTLINK_RESPONSE, seq, response, 1, NULL, 0);
+        return;
+    }
+    unsigned char *body = frame + 2;
+    int bodyLength = length - 3;
+    switch (frame[0])
+    {
+        case HOSTLINK_REQUEST_SEND:
+        case HOSTLINK_REQUEST_BROADCAST:
+        {
+            unsigned char broadcast = frame[0] == HOSTLINK_REQUEST_BROADCAST;
+            int headLength = broadcast ? 1 : 2; // destination is not given for broadcast
+            if (bodyLength < headLength)
+            {
+                response[0] = HOSTLINK_STATUS_INVALID;
+                break;
+            }
+            int messageLength = bodyLength - headLength;
+            unsigned char *message = memoryMalloc(MEMORY_MAIN, messageLength ? messageLength : 1); // kept by transport layer until ACK
+            if (message == NULL)
+            {
+                response[0] = HOSTLINK_STATUS_NO_MEMORY;
+                break;
+            }
+            memcpy(message, body + headLength, messageLength);
+            int id = initiateSend(broadcast ? 0 : body[0], body[headLength - 1], message, messageLength);
+            if (id < 0)
+            {
+                memoryFree(message);
+                response[0] = hostlinkSendStatus(id);
+                break;
+            }
+            response[1] = id;
+            hostlinkSendFrame(HOSTLINK_RESPONSE, seq, response, 2, NULL, 0);
+            return;
+        }
+        case HOSTLINK_REQUEST_SEND_PART:
+        {
+            int partLength = bodyLength - 3;
+            if (bodyLength < 3 || hostPartLength + partLength > TRANSPORT_MAX_MESSAGE)
+            {
+                memoryFree(hostPartMessage);
+                hostPartMessage = NULL, hostPartLength = 0;
+                response[0] = HOSTLINK_STATUS_INVALID;
+                break;
+            }
+            if (hostPartMessage == NULL)
+                hostPartMessage = memoryMalloc(MEMORY_MAIN, TRANSPORT_MAX_MESSAGE);
+            if (hostPartMessage == NULL)
+            {
+                response[0] = HOSTLINK_STATUS_NO_MEMORY;
+                break;
+            }
+            memcpy(hostPartMessage + hostPartLength, body + 3, partLength);
+            hostPartLength += partLength;
+            if (body[2]) // more parts follow
+                break;
+            unsigned char *message = memoryRealloc(MEMORY_MAIN, hostPartMessage, hostPartLength ? hostPartLength : 1); // kept by transport layer until ACK
+            if (message == NULL)
+                message = hostPartMessage;
+            int id = initiateSend(body[0], body[1], message, hostPartLength);
+            hostPartMessage = NULL, hostPartLength = 0;
+            if (id < 0)
+            {
+                memoryFree(message);
+                response[0] = hostlinkSendStatus(id);
+                break;
+            }
+            response[1] = id;
+            hostlinkSendFrame(HOSTLINK_RESPONSE, seq, response, 2, NULL, 0);
+            return;
+        }
+        case HOSTLINK_REQUEST_STATS:
+        {
+            struct statistics copy;
+            statsSnapshot(&copy, bodyLength && body[0]);
+            hostlinkSendFrame(HOSTLINK_RESPONSE_STATS, seq, response, 1, (unsigned char*)&copy, sizeof(struct statistics));
+            return;
+        }
+        case HOSTLINK_REQUEST_CONFIGURE:
+        {
+            if (bodyLength < 3)
+            {
+                response[0] = HOSTLINK_STATUS_INVALID;
+                break;
+            }
+            unsigned int value = body[1] | (unsigned int)body[2] << 8;
+            if (body[0] == HOSTLINK_CONFIG_MODE && value == MODE_CONSOLE)
+            {
+                hostlinkSendFrame(HOSTLINK_RESPONSE, seq, response, 1, NULL, 0); // respond before text output is enabled again
+                operatingMode = MODE_CONSOLE;
+                uartTextOutput = 1;
+                return;
+            }
+            else if (body[0] == HOSTLINK_CONFIG_MODE && value == MODE_BINARY) // sends the ready event again, so that a host can probe the node
+            {
+                hostlinkSendFrame(HOSTLINK_RESPONSE, seq, response, 1, NULL, 0);
+                hostlinkStart();
+                return;
+            }
+            else if (body[0] == HOSTLINK_CONFIG_TIMEOUT && value && value <= CONFIG_TIMEOUT_MAX)
+                msgWaitingPeriod = value;
+            else if (body[0] == HOSTLINK_CONFIG_RECEIVE_TIMEOUT && value)
+                receiveTimeoutPeriods = value;
+            else if (body[0] == HOSTLINK_CONFIG_MAX_LENGTH && value >= 2 && value <= 255)
+                receiveMaxLength = value;
+            else if (body[0] == HOSTLINK_CONFIG_ADDRESS && value && value < 256 && !isMulticast(value) && value != PING_ADDRESS)
+                ADDRESS = value;
+            else if (body[0] == HOSTLINK_CONFIG_SEND_QUEUE && value && value < 256)
+                sendQueueLimit = value;
+            else if (body[0] == HOSTLINK_CONFIG_FORWARD_QUEUE && value && value < 256)
+                forwardQueueLimit = value;
+            else if (body[0] == HOSTLINK_CONFIG_RATE)
+            {
+                rateLimit = value;
+                rateReset();
+            }
+            else if (body[0] == HOSTLINK_CONFIG_BURST && value && value < 256)
+            {
+                rateBurst = value;
+                rateReset();
+            }
+            else if (body[0] == HOSTLINK_CONFIG_AIMD && value < 256)
+                rateAimdThreshold = value;
+            else if (body[0] == HOSTLINK_CONFIG_SAVE)
+            {
+                if (value)
+                    configSave();
+                else
+                    configErase();
+            }
+            else if (body[0] == HOSTLINK_CONFIG_SPEED && value >= 1 && value <= 5)
+            {
+                sendSpeed = value;
+                timeInterruptInit(value);
+            }
+            else
+                response[0] = HOSTLINK_STATUS_INVALID;
+            break;
+        }
+        default:
+            response[0] = HOSTLINK_STATUS_INVALID;
+            break;
+    }
+    hostlinkSendFrame(HOSTLINK_RESPONSE, seq, response, 1, NULL, 0);
+}
+
+/**
+ * @brief This function returns a byte of a frame to send, which consists of the given parts. 
+ * @param index The index of the byte in the frame. 
+ * @param head The type and sequence number. 
+ * @param prefix The bytes of body before data. 
+ * @param prefixLength The length of prefix. 
+ * @param data The remaining bytes of body. 
+ * @param dataLength The length of data. 
+ * @param crc The CRC-8 as the last byte. 
+ * @return The byte at index. 
+ */
+unsigned char hostlinkFrameByte(int index, unsigned char *head, unsigned char *prefix, int prefixLength, unsigned char *data, int dataLength, unsigned char crc)
+{
+    if (index < 2)
+        return head[index];
+    index -= 2;
+    if (index < prefixLength)
+        return prefix[index];
+    index -= prefixLength;
+    if (index < dataLength)
+        return data[index];
+    return crc;
+}
+
+/**
+ * The frame consists of type, sequence number, prefix, data, and a CRC-8 over all of them. <br>
+ * It is COBS encoded while being written to UART: before each block, the bytes up to the next byte of 0 are counted to get the code byte. 
+ * @brief This function sends a frame to the host. 
+ * @param type The type of the frame, one of the HOSTLINK_RESPONSE or HOSTLINK_EVENT definitions. 
+ * @param seq The sequence number of the request being responded, or 0 for events. 
+ * @param prefix The bytes of body before data. 
+ * @param prefixLength The length of prefix. 
+ * @param data The remaining bytes of body. 
+ * @param dataLength The length of data. 
+ */
+void hostlinkSendFrame(unsigned char type, unsigned char seq, unsigned char *prefix, int prefixLength, unsigned char *data, int dataLength)
+{
+    unsigned char head[2] = {type, seq};
+    unsigned char crc = calculateCRC8(head, 2);
+    int i, total = 2 + prefixLength + dataLength + 1;
+    for (i = 0; i < prefixLength; i++) // continue CRC-8 over the remaining bytes
+        crc = calculateCRC8Update(crc, prefix[i]);
+    for (i = 0; i < dataLength; i++)
+        crc = calculateCRC8Update(crc, data[i]);
+    int start = 0;
+    while (start <= total) // each loop writes one block
+    {
+        int end = start;
+        while (end < total && end - start < 254 && hostlinkFrameByte(end, head, prefix, prefixLength, data, dataLength, crc) != 0)
+            end++;
+        uart_write(end - start + 1); // code byte
+        for (i = start; i < end; i++)
+            uart_write(hostlinkFrameByte(i, head, prefix, prefixLength, data, dataLength, crc));
+        if (end - start == 254 && end < total) // a full block does not stand for a byte of 0
+            start = end;
+        else
+            start = end + 1; // skip the byte of 0, or finish after the last block
+    }
+    uart_write(0);
+}
+
+/**
+ * @brief This function sends an event to the host when the operating mode is binary. 
+ * @param type The type of the event, one of the HOSTLINK_EVENT definitions. 
+ * @param address The first byte of the event body. 
+ * @param value The second byte of the event body, it is skipped when length is -1. 
+ * @param data The remaining bytes of the event body. 
+ * @param length The length of data, or -1 for an event body of only 1 byte. 
+ */
+void hostlinkEvent(unsigned char type, unsigned char address, unsigned char value, unsigned char *data, int length)
+{
+    if (operatingMode != MODE_BINARY)
+        return;
+    unsigned char prefix[2] = {address, value};
+    if (length < 0)
+        hostlinkSendFrame(type, 0, prefix, 1, NULL, 0);
+    else
+        hostlinkSendFrame(type, 0, prefix, 2, data, length);
+}
@@ -0,0 +1,54 @@
+#define MODE_CONSOLE 0 ///< This denotes the interactive console as operating mode. 
+#define MODE_BINARY 1 ///< This denotes the binary host protocol as operating mode. 
+#define MODE_STREAM 2 ///< This denotes a stream transfer, where UART input is sent as it is. 
+
+#define HOSTLINK_MAX_FRAME 136 ///< This denotes the longest decoded host frame in bytes: type, sequence number, up to 133 bytes of body, and checksum. 
+
+#define HOSTLINK_REQUEST_SEND 0x01 ///< Request body: destination, flag, message. 
+#define HOSTLINK_REQUEST_BROADCAST 0x02 ///< Request body: flag, message. 
+#define HOSTLINK_REQUEST_STATS 0x03 ///< Request body: reset flag. 
+#define HOSTLINK_REQUEST_CONFIGURE 0x04 ///< Request body: key, value low byte, value high byte. 
+#define HOSTLINK_REQUEST_SEND_PART 0x05 ///< Request body: destination, flag, more flag, part of message. The message is sent when more flag is 0. 
+
+#define HOSTLINK_RESPONSE 0x80 ///< Response body: status, transport id for send requests. 
+#define HOSTLINK_RESPONSE_STATS 0x83 ///< Response body: status, statistics struct. 
+#define HOSTLINK_EVENT_READY 0x90 ///< Event body: address of this device. 
+#define HOSTLINK_EVENT_RECEIVED 0x91 ///< Event body: source address, flag, message. 
+#define HOSTLINK_EVENT_ACKED 0x92 ///< Event body: destination address, transport id. 
+#define HOSTLINK_EVENT_FAILED 0x93 ///< Event body: destination address, transport id. 
+#define HOSTLINK_EVENT_BROADCASTED 0x94 ///< Event body: transport id. 
+
+#define HOSTLINK_STATUS_OK 0 ///< The request has been accepted. 
+#define HOSTLINK_STATUS_CHECKSUM 1 ///< The checksum of the request does not match. 
+#define HOSTLINK_STATUS_INVALID 2 ///< The request is unknown or too short. 
+#define HOSTLINK_STATUS_NO_MEMORY 3 ///< There is not enough memory to accept the request. 
+#define HOSTLINK_STATUS_BUSY 4 ///< Too many messages are waiting for ACK, or the receiver has no credit, the request may be sent again later. 
+
+#define HOSTLINK_CONFIG_MODE 1 ///< Configuration key of the operating mode. 
+#define HOSTLINK_CONFIG_TIMEOUT 2 ///< Configuration key of msgWaitingPeriod. 
+#define HOSTLINK_CONFIG_SPEED 3 ///< Configuration key of sendSpeed. 
+#define HOSTLINK_CONFIG_RECEIVE_TIMEOUT 4 ///< Configuration key of receiveTimeoutPeriods. 
+#define HOSTLINK_CONFIG_MAX_LENGTH 5 ///< Configuration key of receiveMaxLength. 
+#define HOSTLINK_CONFIG_ADDRESS 6 ///< Configuration key of ADDRESS. 
+#define HOSTLINK_CONFIG_SEND_QUEUE 7 ///< Configuration key of sendQueueLimit. 
+#define HOSTLINK_CONFIG_FORWARD_QUEUE 8 ///< Configuration key of forwardQueueLimit. 
+#define HOSTLINK_CONFIG_SAVE 9 ///< Configuration key to write the settings to EEPROM, or to erase them with value 0. 
+#define HOSTLINK_CONFIG_RATE 10 ///< Configuration key of rateLimit. 
+#define HOSTLINK_CONFIG_BURST 11 ///< Configuration key of rateBurst. 
+#define HOSTLINK_CONFIG_AIMD 12 ///< Configuration key of rateAimdThreshold. 
+
+void hostlinkStart();
+
+void hostlinkReceiveByte(unsigned char byte);
+
+void hostlinkAppend(unsigned char byte);
+
+unsigned char hostlinkSendStatus(int error);
+
+void hostlinkProcessFrame(unsigned char *frame, int length);
+
+unsigned char hostlinkFrameByte(int index, unsigned char *head, unsigned char *prefix, int prefixLength, unsigned char *data, int dataLength, unsigned char crc);
+
+void hostlinkSendFrame(unsigned char type, unsigned char seq, unsigned char *prefix, int prefixLength, unsigned char *data, int dataLength);
+
+void hostlinkEvent(unsigned char type, unsigned char address, unsigned char value, unsigned char *data, int length);
@@ -30,6 +30,7 @@
 #include "../layer2/data_link.h"
 #include "interrupt_handler.h"
 #include "../layer1/physical.h"
+#include "../profiler/profiler.h"
 
 /**
 * This function enables and initiates the clock interrupt with following settings: <br>
@@ -66,14 +67,18 @@ void timeInterruptInit(int mode)
         break;
     }
     // OCR1A = 9374; // executes every 0.2 second -> 9374 every 0.008 -> 374 0.04 -> 1874
-    OCR1A = valueToPut; 
     TCCR1B |= (1 << WGM12);
     // Mode 4, CTC on OCR1A
     // No Normal mode as it wastes CPU resource
     TIMSK1 |= (1 << OCIE1A);
     //Set interrupt on compare match
+#ifdef PROFILE_ISR
+    profilerTimerInit(valueToPut); // finer prescaler for timestamps, same period
+#else
+    OCR1A = valueToPut; 
     TCCR1B |= (1 << CS12);
     // set prescaler to 256 and start the timer
+#endif
 }
 
 /*
@@ -88,13 +93,39 @@ void pinInterruptInit(void)
 }
 
 /**
- * This function triggers the pinInterruptInit and timeInterruptInit functions. 
+* This function enables the SPI with its serial transfer complete interrupt, so that a byte is shifted by the hardware on PB5 (SCK), PB3 (MOSI) and PB4 (MISO) and only one interrupt is taken per byte. <br>
+* The master drives SCK at F_CPU / 16, i.e. a byte takes 10.7 us, and SS on PB2. Its byte clock is Timer 2 on Mode 2, CTC on OCR2A, at prescaler 128. <br>
+* A slave takes SCK, MOSI and SS as inputs and drives MISO. Its first byte to send is 0. 
+* @brief This method initialises the SPI and, on the master, the byte clock of the hardware-shifted physical layer. 
+*/
+void shiftInterruptInit(void)
+{
+#ifdef PHY_SHIFT_MASTER
+    DDRB |= 1 << PB5 | 1 << PB3 | 1 << PB2; // SCK, MOSI and SS as output, MISO is input in master mode
+    SPCR = 1 << SPIE | 1 << SPE | 1 << MSTR | 1 << SPR0; // SPI interrupt, master, F_CPU / 16
+    TCCR2A = 1 << WGM21; // Mode 2, CTC on OCR2A
+    OCR2A = PHY_SHIFT_CLOCK_TOP;
+    TIMSK2 = 1 << OCIE2A;
+    TCCR2B = 1 << CS22 | 1 << CS20; // set prescaler to 128 and start the byte clock
+#else
+    DDRB = (DDRB & ~(1 << PB5 | 1 << PB3 | 1 << PB2)) | 1 << PB4; // MISO as output
+    SPCR = 1 << SPIE | 1 << SPE; // SPI interrupt, slave
+    SPDR = 0;
+#endif
+}
+
+/**
+ * This function triggers the pinInterruptInit and timeInterruptInit functions. In the hardware-shifted build, shiftInterruptInit is triggered instead of pinInterruptInit. 
  * @brief This method initialises time and pin change interrupt. 
  * @param mode This dictates the frequency of triggering an interrupt <br>
  * 1 denotes 0.2 sec, 2 denotes 0.04 sec, 3 denotes 0.02 sec, 4 denotes 0.01 sec, and 5 denotes 0.005 sec, per interrupt
  */
 void interruptInit(int mode)
 {
+#ifdef PHY_HW_SHIFT
+    shiftInterruptInit();
+#else
     pinInterruptInit();
+#endif
     timeInterruptInit(mode);
 }
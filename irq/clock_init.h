@@ -5,4 +5,6 @@ void timeInterruptInit(int mode);
 
 void pinInterruptInit(void);
 
+void shiftInterruptInit(void);
+
 void interruptInit(int mode);
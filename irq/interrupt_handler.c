@@ -29,6 +29,7 @@
 #include "../layer2/data_link.h"
 #include "../irq/interrupt_handler.h"
 #include "../layer1/physical.h"
+#include "../scheduler/scheduler.h"
 
 extern int printMode;
 extern unsigned int globalPeriodStamp;
@@ -36,12 +37,15 @@ extern unsigned int globalPeriodStamp;
 /**
 * This function is triggered whenever a timer interrupt is triggered. 
 * When called, this function negates the clock signal and toggle LED output. 
-* After that, it increments the globalPeriodStamp, and triggers clockTickSendDecisionMaker and periodClockUpdate functions. 
+* After that, it triggers clockTickSendDecisionMaker, increments the globalPeriodStamp, and posts the timers task of the main loop. <br>
+* In the hardware-shifted build, the bytes are clocked by the SPI, so only the LED output, globalPeriodStamp and the timers task are served. 
 * @brief This method handles actions to be taken when a timer interrupt is fired. 
 */
 void timeInterruptFunction()
 {
+#ifndef PHY_HW_SHIFT
     PORTB ^= (1 << PB4);
+#endif
     PORTC = ~PORTC; // negate LED output
     /*
     static int counter = 0;
@@ -58,8 +62,11 @@ void timeInterruptFunction()
 		printf("\r\n");	
 	}
     */
+#ifndef PHY_HW_SHIFT
     clockTickSendDecisionMaker();
+#endif
     globalPeriodStamp++;
+    schedulerPost(SCHEDULER_TASK_TIMERS);
 }
 
 /**
@@ -70,11 +77,11 @@ void timeInterruptFunction()
 */
 void pinInterruptFunction()
 {
-	static int counter = 0;
     volatile int data = (PIND >> PD5) & 1;
     unsigned char data1 = data;
-    unsigned volatile char clock = (PIND >> PD4) & 1;
     /*
+	static int counter = 0;
+    unsigned volatile char clock = (PIND >> PD4) & 1;
     if (printMode == 2)
     {
 	    printf("R%d%d", data1, clock);
@@ -90,3 +97,18 @@ void pinInterruptFunction()
     */
     receiveBitClassification(data1);
 }
+
+#ifdef PHY_HW_SHIFT
+/**
+* This function is triggered whenever the SPI has shifted a byte in and out. 
+* When called, this function reads the received byte from SPDR. 
+* After that, it passes the next byte to send from prepareSendByte to sendByte first, as a slave must write it to SPDR before the next byte clock, and then the received byte to receiveByteClassification. 
+* @brief This method handles actions to be taken when a SPI serial transfer complete interrupt is fired. 
+*/
+void shiftInterruptFunction()
+{
+    unsigned char data = SPDR;
+    sendByte(prepareSendByte());
+    receiveByteClassification(data);
+}
+#endif
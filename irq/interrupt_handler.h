@@ -1,4 +1,6 @@
 
 void timeInterruptFunction();
 
-void pinInterruptFunction();
\ No newline at end of file
+void pinInterruptFunction();
+
+void shiftInterruptFunction();
\ No newline at end of file
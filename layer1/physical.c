@@ -29,9 +29,12 @@
 #include "../layer2/data_link.h"
 #include "../irq/interrupt_handler.h"
 #include "physical.h"
+#include "../profiler/profiler.h"
+#include "../trace/trace.h"
 
 extern struct comm_control sendControl;
 extern struct comm_control receiveControl;
+extern struct receive_buffer bufferReceive;
 
 extern struct data_node *forwardDataQueue, *forwardDataQueueEnd; 
 extern struct data_node *sendDataQueue, *sendDataQueueEnd;
@@ -40,18 +43,24 @@ extern struct data_node *receiveDataNode;
 
 extern int sendSpeed;
 extern int printMode;
-extern const int ADDRESS;
+extern int ADDRESS;
+
+#ifdef PHY_SHIFT_MASTER
+unsigned char shiftNextByte = 0; ///< This is the byte that the master shifts out at its next byte clock. 
+#endif
 
 /*
 * This function is responsible for sending bit to neighbour node. <br>
 * This function receives a parameter of char as the data bit to be sent. <br>
 * When it is called, it delays for 37.5% of the length of the time interrupt period. <br>
-* After that, the data bit is written to port PB5 as output. 
+* After that, the data bit is written to port PB5 as output. In the trace build, the bit is recorded first. 
 * @brief This method sends a bit to the next node. 
 * @param bit The bit to be sent. 
 */
 void sendBit(unsigned char bit)
 {
+    PROFILE_BEGIN(PROFILE_SEND_BIT);
+    TRACE_BIT(TRACE_TX, bit);
     int i;
     int sendSpeedComparator = 0;
     switch(sendSpeed)
@@ -94,20 +103,66 @@ void sendBit(unsigned char bit)
     }
     */
     PORTB = (bit << PB5) | (clockNow << PB4);
+    PROFILE_END(PROFILE_SEND_BIT);
 }
 
 /*
 * This function receives a parameter of char as the received data bit. <br>
 * When it is called, if this device is in the process of receiving packet, writeBitToBuffer function is triggered. <br>
-* else, detectPremeable function is invoked. 
+* else, detectPremeable function is invoked. In the trace build, the bit is recorded first. 
 * @brief This method is executed whenenver a bit is read from pin change interrupt. 
 * @param bit The bit that has just been read from pin change interrupt. 
 */
 void receiveBitClassification(unsigned char bit)
 {
     // printf("%d", bit);
+    TRACE_BIT(TRACE_RX, bit);
     if (receiveControl.active) // don't check for premeable when receiving contents of packet
         writeBitToBuffer(bit);
     else
         detectPremeable(bit); // check if possible sending starts
 }
+
+#ifdef PHY_HW_SHIFT
+/**
+ * In the hardware-shifted build, the SPI shifts the byte out while the next received byte is shifted in. <br>
+ * A slave writes it to SPDR at once, so that it is ready before the next byte clock of the master. The master keeps it in shiftNextByte until its next byte clock. 
+ * @brief This method hands over the next byte to be sent to the next node. 
+ * @param byte The byte to be sent. 
+ */
+void sendByte(unsigned char byte)
+{
+#ifdef PHY_SHIFT_MASTER
+    shiftNextByte = byte;
+#else
+    SPDR = byte;
+#endif
+}
+
+#ifdef PHY_SHIFT_MASTER
+/**
+ * SS is pulsed high first, which resets the bit counter of every slave, so that a slave that has missed a clock edge, e.g. at reset, is in step again at the next byte. <br>
+ * Writing SPDR then starts the transfer of 8 bits on SCK. 
+ * @brief This method starts shifting the next byte around the ring. It is invoked at every byte clock of the master. 
+ */
+void shiftByteClock()
+{
+    PORTB |= 1 << PB2;
+    PORTB &= ~(1 << PB2);
+    SPDR = shiftNextByte;
+}
+#endif
+
+/**
+ * The SPI keeps the bytes aligned, so the premeable is detected at byte boundaries by the main loop, and every byte is queued by writeByteToBuffer. <br>
+ * Only bytes of 0 on an idle line, i.e. while no packet is being received and no byte is waiting, are not queued. 
+ * @brief This method is executed whenever a byte is read from the SPI interrupt. 
+ * @param byte The byte that has just been read from the SPI interrupt. 
+ */
+void receiveByteClassification(unsigned char byte)
+{
+    if (byte == 0 && !receiveControl.active && !bufferReceive.writeToStructFlag) // idle line
+        return;
+    writeByteToBuffer(byte);
+}
+#endif
@@ -1,5 +1,15 @@
+#ifndef PHY_SHIFT_BYTE_RATE
+#define PHY_SHIFT_BYTE_RATE 1000 ///< This denotes how many bytes per second the master of the hardware-shifted physical layer clocks around the ring. It must be at least 367. The default is not measured. 
+#endif
+#define PHY_SHIFT_CLOCK_TOP (F_CPU / 128 / PHY_SHIFT_BYTE_RATE - 1) ///< This is the compare value of Timer 2 at prescaler 128 for the byte clock. 
 
 
 void sendBit(unsigned char bit);
 
-void receiveBitClassification(unsigned char bit);
\ No newline at end of file
+void receiveBitClassification(unsigned char bit);
+
+void sendByte(unsigned char byte);
+
+void shiftByteClock();
+
+void receiveByteClassification(unsigned char byte);
\ No newline at end of file
@@ -29,9 +29,15 @@
 #include "data_link.h"
 #include "../irq/interrupt_handler.h"
 #include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "../profiler/profiler.h"
+#include "../trace/trace.h"
+#include "../scheduler/scheduler.h"
 
 extern struct comm_control sendControl;
 extern struct comm_control receiveControl;
+extern struct send_register sendRegister;
 
 extern struct receive_buffer bufferReceive;
 
@@ -39,54 +45,212 @@ extern struct data_node *forwardDataQueue, *forwardDataQueueEnd;
 extern struct data_node *sendDataQueue, *sendDataQueueEnd; 
 extern struct data_node *sendDataNode; 
 extern struct data_node *receiveDataNode; 
+extern struct data_node *urgentDataQueue; 
+extern struct data_node *sendPausedNode; 
+extern struct send_register sendPausedRegister; 
+extern struct data_node *receivePausedNode; 
+extern struct comm_control receivePausedControl; 
 
-extern const int ADDRESS;
+extern int ADDRESS;
+extern struct statistics stats;
+extern unsigned int globalPeriodStamp;
+extern unsigned int receiveTimeoutPeriods;
+extern unsigned char receiveMaxLength;
+extern unsigned char sendQueueLimit;
+
+const unsigned char premeableByte = PREMEABLE; ///< This is the premeable as the first part of the byte stream to send. 
+
+/**
+ * The destination and source addresses are the first 2 bytes of payload, which are put there on network layer. <br>
+ * They are covered together with the check type and the length, so that a forwarding node can reject a corrupted packet before forwarding it. <br>
+ * Only the lower 6 bits are kept, as the upper 2 bits of the header byte carry the check type. 
+ * @brief This method calculates the header CRC over the check type, the length and the destination and source addresses. 
+ * @param type This is the check type of the packet. 
+ * @param length This is the length of the payload data.
+ * @param payload This is the payload data, of which the first 2 bytes are the addresses. 
+ * @return The header CRC of 6 bits. 
+ */
+unsigned char calculateHeaderCRC(unsigned char type, unsigned char length, unsigned char *payload)
+{
+    unsigned char headerData[4] = {type, length, payload[0], payload[1]};
+    return calculateCRC8(headerData, 4) & 0x3F;
+}
+
+/**
+ * @brief This method picks the check type of a packet by its length, so that short packets such as ACK do not carry a check longer than their data. 
+ * @param length This is the length of the payload data, including addresses. 
+ * @return One of the CHECK definitions. 
+ */
+unsigned char frameCheckType(unsigned char length)
+{
+    if (length <= CHECK_CRC8_MAX_LENGTH)
+        return CHECK_CRC8;
+    if (length <= CHECK_CRC16_MAX_LENGTH)
+        return CHECK_CRC16;
+    return CHECK_CRC32;
+}
+
+/**
+ * @brief This method calculates the check of a payload. 
+ * @param type This is the check type, one of the CHECK definitions. 
+ * @param payload This is the payload data for calculation.
+ * @param length This is the length of the payload data.
+ * @return The CRC32, CRC-16 or CRC-8 of the payload. 
+ */
+unsigned long frameCheck(unsigned char type, unsigned char *payload, unsigned char length)
+{
+    if (type == CHECK_CRC8)
+        return calculateCRC8(payload, length);
+    if (type == CHECK_CRC16)
+        return calculateCRC16(payload, length);
+    return calculateCRC(payload, length);
+}
+
+/** 
+ * The header starts with the check type and header CRC, followed by the length and the check of the payload, which is chosen by frameCheckType. 
+ * @brief This method writes the header of a payload. 
+ * @param header This is the header to write, of headerLength bytes for the check type of the length. 
+ * @param length This is the length of the payload data.
+ * @param payload This is the payload data for calculation.
+ */
+void dataNodeHeader(unsigned char *header, unsigned char length, unsigned char *payload)
+{
+    unsigned char type = frameCheckType(length);
+    unsigned char size = checkLength(type);
+    unsigned long crc = frameCheck(type, payload, length);
+    header[0] = type << 6 | calculateHeaderCRC(type, length, payload);
+    header[1] = length;
+    int i;
+    for (i = 0; i < size; i++)
+    {
+        header[2 + i] = (crc >> ((size - 1 - i) * 8)) & 0xFF; // dismantle crc into characters, highest first
+    }
+}
 
 /** 
+ * If there is no memory for header or node, nothing is kept and the payload is left to the caller. 
  * @brief This method constructs an instance of data node struct. 
 * @param payload This is the payload data for calculation.
 * @param length This is the length of the payload data.
-* @return An instance of struct of data_node. 
+* @return An instance of struct of data_node, or NULL if there is no memory. 
 */
 struct data_node* dataNodeConstructor(unsigned char length, unsigned char *payload)
 {
-    unsigned long crc = calculateCRC(payload, length);
-    unsigned char *header = calloc(5, sizeof(char));
-    int i;
-    for (i = 0; i < 4; i++)
+    unsigned char *header = memoryCalloc(MEMORY_DATALINK, 2 + checkLength(frameCheckType(length)), sizeof(char));
+    if (header == NULL)
+        return NULL;
+    struct data_node *node = memoryCalloc(MEMORY_DATALINK, 1, sizeof(struct data_node));
+    if (node == NULL)
     {
-        header[i] = (crc >> (24 - i * 8)) & 0xFF; // dismantle crc into 4 characters
+        memoryFree(header);
+        return NULL;
     }
-    header[4] = length;
-    struct data_node *node = calloc(1, sizeof(struct data_node));
-    node->length = length;
+    dataNodeHeader(header, length, payload);
+    node->length = node->receivedLength = length;
     node->payload = payload;
     node->header = header;
+    node->periodStamp = globalPeriodStamp;
+    node->references = 1; // held by the send queue until sendWrapUp, or by the in-flight table of transport layer
 		//printf("Len%d", node->length);
     return node;
 }
 
+/**
+ * @brief This method takes a reference to a packet, so that it is not freed before the matching dataNodeRelease. 
+ * @param node The packet. 
+ */
+void dataNodeRetain(struct data_node *node)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        node->references++;
+    }
+}
+
+/**
+ * The reference count is changed with interrupts disabled, because packets are released both at timer interrupt by sendWrapUp and in the main loop by the receiver. 
+ * @brief This method gives up a reference to a packet, and frees its header, payload and the node itself when it was the last one. 
+ * @param node The packet, or NULL. 
+ */
+void dataNodeRelease(struct data_node *node)
+{
+    if (node == NULL)
+        return;
+    unsigned char left;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        left = --node->references;
+    }
+    if (left)
+        return;
+    memoryFree(node->header);
+    memoryFree(node->payload);
+    memoryFree(node);
+}
+
 /** 
+* If sendDataQueue already holds sendQueueLimit packets, the packet is dropped. Messages waiting for ACK are sent again after time-out. 
 * @brief This method prepares to construct a data node struct and push the node to send queue. 
 * @param payload This is the payload data for calculation.
 * @param length This is the length of the payload data.
+* @param urgent This is a flag to denote whether the packet is pushed to urgentDataQueue, so that it preempts other packets. 
 */
-void prepareDataNodeForSending(unsigned char length, unsigned char *payload) 
+void prepareDataNodeForSending(unsigned char length, unsigned char *payload, unsigned char urgent) 
 {
     // printf("Now send: %s\n", payload+2);
+    if (stats.sendQueueDepth >= sendQueueLimit)
+    {
+        printf("Send queue full, packet dropped\r\n");
+        statIncrement(queueDrops);
+        memoryFree(payload);
+        return;
+    }
     struct data_node *node = dataNodeConstructor(length, payload);
+    if (node == NULL) // dropped like a full queue, a message that needs ACK is sent again after time-out
+    {
+        memoryFree(payload);
+        return;
+    }
+    node->urgent = urgent;
+    statIncrement(framesQueued);
     pushSendQueue(node); // put it to normal queue
 }
 
+/**
+ * The packet is kept by transport layer with its header and CRC, so nothing is calculated or copied again. The send queue takes its own reference, which is released by sendWrapUp. <br>
+ * While the previous copy is still queued or being sent, the packet holds a second reference and is not queued again, so that a slow line does not fill the queue with copies of the same packet. <br>
+ * If sendDataQueue already holds sendQueueLimit packets, the packet is not queued either, and is tried again at the next time-out. 
+ * @brief This method queues a packet built before once more, for retransmission after time-out. 
+ * @param node The packet to queue. 
+ * @return 1 if the packet has been queued, 0 otherwise. 
+ */
+int requeueDataNode(struct data_node *node)
+{
+    if (node->references > 1) // the previous copy has not been sent yet
+        return 0;
+    if (stats.sendQueueDepth >= sendQueueLimit)
+    {
+        printf("Send queue full, packet dropped\r\n");
+        statIncrement(queueDrops);
+        return 0;
+    }
+    dataNodeRetain(node);
+    node->sendBackOff = 0;
+    statIncrement(framesQueued);
+    pushSendQueue(node);
+    return 1;
+}
+
 /**
  * When sendControl.active is true, i.e. The device is sending a packet, the function invokes prepareSendBit method to send the next bit. <br>
  * Else when the device is not sending a packet, the function checks whether there is packet in queue waiting to be sent. <br>
- * If yes, the sendControl.active is set to true and the program invokes prepareSendBit to send the first bit of premeable. <br>
+ * If yes, sendStart is invoked to load the first byte and the program invokes prepareSendBit to send the first bit of premeable. <br>
  * If no, then 0 is sent.
  * @brief This method makes bit send decision whenever a timer interrup is triggered. 
  */
 void clockTickSendDecisionMaker() 
 { 
+    PROFILE_BEGIN(PROFILE_SEND_DECISION);
     if (sendControl.active) // when sending packet not finished
         prepareSendBit();
     else
@@ -94,8 +258,7 @@ void clockTickSendDecisionMaker()
         struct data_node *tempNode = popSendQueue(); // check if something has been added to queue and sends it
         if (tempNode != NULL)
         {
-            sendControl.active = 1;
-            sendDataNode = tempNode;
+            sendStart(tempNode);
             prepareSendBit();
         }
         else
@@ -104,80 +267,223 @@ void clockTickSendDecisionMaker()
         }
 
     }
+    PROFILE_END(PROFILE_SEND_DECISION);
+}
+
+#ifdef PHY_HW_SHIFT
+/**
+ * This is the counterpart of clockTickSendDecisionMaker and prepareSendBit for the hardware-shifted physical layer, which takes a whole byte at each SPI interrupt. <br>
+ * When the device is not sending a packet, the next packet is taken from the queues by sendStart and its premeable is returned. Otherwise the byte in the shift register is returned and the next byte is loaded. <br>
+ * The SPI shifts a byte at every byte clock of the master whether one is ready or not. So if loading the byte has backed off again, ESCAPE is returned and followed by ESCAPE_FILL, which the receiver ignores, and the byte is loaded afterwards. 
+ * @brief This method takes the next byte to send. 
+ * @return The byte to send, or 0 if no packet is being sent. 
+ */
+unsigned char prepareSendByte()
+{
+    if (!sendControl.active)
+    {
+        struct data_node *tempNode = popSendQueue();
+        if (tempNode == NULL)
+            return 0;
+        sendStart(tempNode);
+    }
+    else if (sendRegister.bitsLeft == 0) // loading the byte has backed off and main loop has not retried yet
+    {
+        sendDataNode->sendBackOff = 0;
+        loadNextSendByte();
+    }
+    if (sendRegister.bitsLeft == 0)
+    {
+        sendRegister.escapeByte = ESCAPE_FILL;
+        return ESCAPE;
+    }
+    unsigned char byte = sendRegister.shiftRegister;
+    sendRegister.bitsLeft = 0;
+    loadNextSendByte();
+    return byte;
 }
+#endif
 
 /**
- * Whenever this function is triggered, a bit is given as parameter. <br>
- * Then the premeableRead is updated by shifting the existing value to left by 1 bit and disjunct it with the newly received bit.<br>
- * When 0x7E presents at the premeableRead variable, premeableRead is reset to 0 and receiveControl.active is set to one, thus the procedures to receive a packet starts. <br>
- * A new instance of data_node is assigned to receiveDataNode to prepare for receiving packet. 
+ * If memory cannot be allocated, the packet is counted in receiveNoMemory and receiving stays inactive, so that the receiver keeps hunting for the premeable. 
+ * @brief This method prepares a new instance of data_node in receiveDataNode to receive the header of a packet. 
+ * @return Whether receiving has started. 
+ */
+int receiveStart()
+{
+    struct data_node *node = (struct data_node*)memoryCalloc(MEMORY_DATALINK, 1, sizeof(struct data_node)); // initialise the data_node struct to store the receiving packet
+    unsigned char *header = (unsigned char*)memoryCalloc(MEMORY_DATALINK, HEADER_MAX_LENGTH, sizeof(char)); // the check type is not known yet
+    if (node == NULL || header == NULL)
+    {
+        memoryFree(node);
+        memoryFree(header);
+        receiveDataNode = NULL;
+        statIncrement(receiveNoMemory);
+        return 0;
+    }
+    receiveControl.active = 1; // activate the receiving logic
+    receiveControl.type = receiveControl.index = 0;
+    receiveDataNode = node;
+    receiveDataNode->next = NULL;
+    receiveDataNode->header = header;
+    receiveDataNode->toRead = 1;
+    receiveDataNode->references = 1; // held by the receiver until the packet has been read or dropped
+    receiveDataNode->periodStamp = globalPeriodStamp;
+    bufferReceive.lastBitPeriodStamp = bufferReceive.lastBytePeriodStamp = globalPeriodStamp;
+    return 1;
+}
+
+/** 
  * @brief This method detects whether a premeable is received. 
  * @param bit The bit that has just been received at pin change interrupt. 
  */
 void detectPremeable(unsigned char bit)
 {
+    PROFILE_BEGIN(PROFILE_DETECT_PREMEABLE);
 
     receiveControl.premeableRead = (receiveControl.premeableRead << 1) | bit;
-    if (receiveControl.active == 0);
+    // if (receiveControl.active == 0)
         // printf("%d", bit);
-    if (receiveControl.premeableRead == 0x7E) // if premeable detected, start receiving header
+    if (receiveControl.premeableRead == PREMEABLE) // if premeable detected, start receiving header
     {
-        receiveControl.active = 1; // activate the receiving logic
         receiveControl.premeableRead = 0;
-        receiveDataNode = (struct data_node*)calloc(1, sizeof(struct data_node)); // initialise the data_node struct to store the receiving packet
-        receiveDataNode->next = NULL;
-        receiveDataNode->header = (char*)calloc(5, sizeof(char));
-        receiveDataNode->toRead = 1;
+        receiveStart();
     }
-		
+    PROFILE_END(PROFILE_DETECT_PREMEABLE);
 }
 
 /** 
+ * The reference of the send queue to the packet is released, which frees it unless it is still being received or read. <br>
+ * If the packet is urgent and has preempted another packet, the preempted packet is resumed at the byte where it was paused, and its next byte is loaded at once. 
  * @brief This method resets control data after a data_node is completely sent. 
 */
 void sendWrapUp()
 {
+    statIncrement(framesSent);
+    dataNodeRelease(sendDataNode);
+    if (sendPausedNode != NULL)
+    {
+        sendDataNode = sendPausedNode;
+        sendPausedNode = NULL;
+        sendRegister = sendPausedRegister;
+        sendControl.type = 2;
+        loadNextSendByte();
+        return;
+    }
     sendControl.type = sendControl.index = sendControl.active = 0;
+    sendRegister.bitsLeft = sendRegister.bytesLeft = 0;
     sendDataNode = NULL;
 }
 
 /**
- * This function controls the incrementation of bit index at sending process. <br>
- * When premeable is completely sent, sendControl.type will be set to 1 and bit index is reset to 0. <br>
- * When header is completely sent, sendControl.type will be set to 2 and bit index is reset to 0. <br>
- * When payload is completely sent, sendWrapUp will be invoked to reset all send control settings. 
- * @brief This function checks if the bit index needs to be reset and the send control type needs to be incremented. 
+ * The position in the payload is kept in sendPausedRegister, and the urgent packet continues from its header, as the escape sequence replaces its premeable. 
+ * @brief This method pauses the packet being sent in favour of the first packet of urgentDataQueue. 
+ */
+void sendPreempt()
+{
+    sendPausedNode = sendDataNode;
+    sendPausedRegister = sendRegister;
+    sendDataNode = popUrgentQueue();
+    sendControl.type = 1;
+    sendRegister.cursor = sendDataNode->header;
+    sendRegister.bytesLeft = headerLength(sendDataNode->header);
+    sendRegister.shiftRegister = ESCAPE;
+    sendRegister.escapeByte = ESCAPE_PREEMPT;
+    sendRegister.bitsLeft = 8;
+    statIncrement(preemptions);
+}
+
+/**
+ * The premeable is the first part of the byte stream, so the cursor points to premeableByte with 1 byte left. <br>
+ * If the packet carries a stamp, such as a ping probe, the time it has spent in this device is only known now, so the stamp is written and the header is calculated again before the header is sent. The packet is short, so this takes a fraction of a period. <br>
+ * The first byte is loaded at once, so that the first bit can be sent at the same timer interrupt. 
+ * @brief This method activates the sending process of a data_node. 
+ * @param node The data_node to send. 
  */
-void sendBitManagement()
+void sendStart(struct data_node *node)
 {
-    if (sendControl.type == 2) // when sending payload
+    if (node->stampOffset)
     {
-        if (sendControl.index == sendDataNode->length * 8) // when everything in payload is sent
-            sendWrapUp();
+        unsigned int elapsed = globalPeriodStamp - node->periodStamp;
+        node->payload[node->stampOffset] = elapsed & 0xFF;
+        node->payload[node->stampOffset + 1] = elapsed >> 8;
+        dataNodeHeader(node->header, node->length, node->payload);
+    }
+    sendControl.active = 1;
+    sendControl.type = 0;
+    sendDataNode = node;
+    sendRegister.cursor = &premeableByte;
+    sendRegister.bytesLeft = 1;
+    loadNextSendByte();
+}
+
+/**
+ * If the second byte of an escape sequence is pending, it is loaded without touching the packet. <br>
+ * If an urgent packet is waiting while at least PREEMPT_MIN_BYTES of a payload are left, and no packet is paused yet, sendPreempt pauses the payload. <br>
+ * Otherwise this function tries to get a mutex, if it fails to get one, it terminates and leaves bitsLeft at 0. <br>
+ * When the current part of the byte stream is finished, the cursor is moved to the next part: from premeable to header, and from header to payload. <br>
+ * When payload is finished, sendWrapUp will be invoked to reset all send control settings. <br>
+ * If the next payload byte of a forwarded packet has not been received yet, ESCAPE and ESCAPE_FILL are sent instead. <br>
+ * Otherwise the byte at the cursor is loaded into the shift register, a header or payload byte of ESCAPE as ESCAPE and ESCAPE_LITERAL. Then it will release the mutex. 
+ * @brief This function loads the next byte of the packet into the shift register. 
+ */
+void loadNextSendByte()
+{
+    if (sendRegister.escapeByte) // second byte of an escape sequence
+    {
+        sendRegister.shiftRegister = sendRegister.escapeByte;
+        sendRegister.escapeByte = 0;
+        sendRegister.bitsLeft = 8;
+        return;
     }
-    else if (sendControl.type == 1) // when sending header
+    if (sendControl.type == 2 && urgentDataQueue != NULL && sendPausedNode == NULL && sendRegister.bytesLeft >= PREEMPT_MIN_BYTES && !sendDataNode->urgent)
     {
-        if (sendControl.index == 40) // when everything in header is sent (8 * 5 = 40 bits))
-        {
-            sendControl.type = 2;
-            sendControl.index = 0;
-            //
-        }
+        sendPreempt();
+        return;
     }
-    else // when sending premeable
+    getMutex(0, sendDataNode); // only invoked at timer interrupt or with interrupts disabled
+    if (sendDataNode->sendBackOff) // sendBackOff means fail to get mutex, then back off
+        return;
+    if (sendRegister.bytesLeft == 0) // when the current part is completely sent
     {
-        if (sendControl.index == 8) // when premeable is sent
+        if (sendControl.type == 0) // when premeable is sent
+        {
+            sendRegister.cursor = sendDataNode->header;
+            sendRegister.bytesLeft = headerLength(sendDataNode->header);
+        }
+        else if (sendControl.type == 1) // when header is sent
         {
-            sendControl.type = 1;
-            sendControl.index = 0;
+            sendRegister.cursor = sendDataNode->payload;
+            sendRegister.bytesLeft = sendDataNode->length;
         }
+        else // when everything in payload is sent
+        {
+            sendDataNode->datalock = 0;
+            sendWrapUp();
+            return;
+        }
+        sendControl.type++;
+    }
+    if (sendControl.type == 2 && sendDataNode->length - sendRegister.bytesLeft >= sendDataNode->receivedLength) // forwarded byte has not arrived yet
+    {
+        sendRegister.shiftRegister = ESCAPE;
+        sendRegister.escapeByte = ESCAPE_FILL;
+    }
+    else
+    {
+        sendRegister.shiftRegister = *sendRegister.cursor++;
+        sendRegister.bytesLeft--;
+        if (sendControl.type && sendRegister.shiftRegister == ESCAPE)
+            sendRegister.escapeByte = ESCAPE_LITERAL;
     }
+    sendRegister.bitsLeft = 8;
+    sendDataNode->datalock = 0; // release mutex
 }
 
 /**
  * When the datalock of the node is 1, it represents that the mutex has already been locked. <br>
- * Then, if the method calling getMutex is handling bit receiving, writeBackOff in the data_node will be set to 1. <br>
- * Else if the method calling getMutex is handling bit sending, sendBackOff in the data_node will be set to 1. <br>
+ * Then, if the method calling getMutex is handling bit receiving, writeBackOff in the data_node will be set to 1 and the receive task is posted to retry. <br>
+ * Else if the method calling getMutex is handling bit sending, sendBackOff in the data_node will be set to 1 and the send task is posted to retry. <br>
  * When the datalock of the node is 0, it is set to 1 to complete the mutex lock process. 
  * @brief This method is triggered whenever a mutex is needed for accessing protected area. 
  * @param receiving This is a flag to denote whether the method calling this function is receiving a bit. 
@@ -188,9 +494,17 @@ void getMutex(unsigned char receiving, struct data_node *node)
     if (node->datalock) // if failed to get mutex
     {
         if (receiving) // prepare another attempt to rewrite
+        {
             node->writeBackOff = 1;    // prompt sending program to resend after sending this bit is finished
+            statIncrement(writeBackOffs);
+            schedulerPost(SCHEDULER_TASK_RECEIVE);
+        }
         else
+        {
             node->sendBackOff = 1;
+            statIncrement(sendBackOffs);
+            schedulerPost(SCHEDULER_TASK_SEND);
+        }
     }
     else
         node->datalock = 1; // get mutex
@@ -199,14 +513,16 @@ void getMutex(unsigned char receiving, struct data_node *node)
 /**
  * Whenever a bit is received, it is stored to a temporary bit buffer. <br>
  * When 8 bits are written to the temporary bit buffer, the freshly written byte will become ready for processing at receiveByte. <br>
- * Then the program sets the writeToStructFlag in receive_node, so that at next loop in main, the device will invoke writeByteToStruct to properly invoke receiveByte. 
+ * Then the program sets the writeToStructFlag in receive_node and posts the receive task, so that the main loop will invoke writeByteToStruct to properly invoke receiveByte. 
  * @brief This method writes a received bit to a temporary byte buffer. 
  * @param bit This is the bit to be written to a temporary byte buffer. 
  */
 void writeBitToBuffer(unsigned char bit)
 {
-    bufferReceive.buffer[bufferReceive.receiveByteIndex] |= bit << 7 - bufferReceive.receiveBitIndex; // push the new bit to the byte buffer
+    PROFILE_BEGIN(PROFILE_WRITE_BIT);
+    bufferReceive.buffer[bufferReceive.receiveByteIndex] |= bit << (7 - bufferReceive.receiveBitIndex); // push the new bit to the byte buffer
     bufferReceive.receiveBitIndex++;
+    bufferReceive.lastBitPeriodStamp = globalPeriodStamp;
     if (bufferReceive.receiveBitIndex == 8) // when a byte is completely read
     {
         bufferReceive.receiveBitIndex = 0; // reset receive bit index
@@ -216,93 +532,265 @@ void writeBitToBuffer(unsigned char bit)
         else
             bufferReceive.receiveByteIndex++;
         bufferReceive.writeToStructFlag = 1; // to allow main loop to process the freshly ready byte
+        schedulerPost(SCHEDULER_TASK_RECEIVE);
+    }
+    PROFILE_END(PROFILE_WRITE_BIT);
+}
+
+#ifdef PHY_HW_SHIFT
+/**
+ * In the hardware-shifted build, the temporary byte buffer is a queue of 5 bytes, and writeToStructFlag counts the bytes waiting in it. So the main loop may fall behind by a few bytes, e.g. while it checks the CRC of a received packet. <br>
+ * If the queue is full, the byte is lost and counted as receive overrun. 
+ * @brief This method queues a byte received by the SPI and posts the receive task. 
+ * @param byte This is the received byte. 
+ */
+void writeByteToBuffer(unsigned char byte)
+{
+    if (bufferReceive.writeToStructFlag == 5)
+    {
+        statIncrement(receiveOverruns);
+        return;
     }
+    bufferReceive.buffer[bufferReceive.receiveByteIndex] = byte;
+    if (bufferReceive.receiveByteIndex == 4)
+        bufferReceive.receiveByteIndex = 0;
+    else
+        bufferReceive.receiveByteIndex++;
+    bufferReceive.writeToStructFlag++;
+    bufferReceive.lastBitPeriodStamp = globalPeriodStamp;
+    schedulerPost(SCHEDULER_TASK_RECEIVE);
 }
+#endif
 
 /**
  * This function triggers receiveByte to process the newly ready byte. <br>
- * If 0 is returned as failflag, writeToStructFlag in receive_node, and temporary buffer storing the newly ready byte are reset to 0. 
+ * If 0 is returned as failflag, writeToStructFlag in receive_node, and temporary buffer storing the newly ready byte are reset to 0. <br>
+ * In the hardware-shifted build, the oldest byte of the queue is taken instead. While no packet is being received, it is compared with the premeable, as the SPI keeps the bytes aligned. The byte is removed from the queue unless writing has backed off, or the packet has been aborted, which empties the queue. 
  * @brief This method writes a byte to a data_node instance whenever the byte in temporary buffer is completed. 
  */
 void writeByteToStruct()
 {
+#ifdef PHY_HW_SHIFT
+    unsigned char byte = bufferReceive.buffer[bufferReceive.writeByteIndex];
+    if (!receiveControl.active)
+    {
+        if (byte == PREMEABLE)
+            receiveStart();
+    }
+    else
+    {
+        receiveDataNode->writeBackOff = 0;
+        if (receiveByte(byte) || receiveDataNode == NULL) // backed off or aborted
+            return;
+    }
+    ATOMIC_BLOCK(ATOMIC_FORCEON)
+    {
+        if (bufferReceive.writeByteIndex == 4)
+            bufferReceive.writeByteIndex = 0;
+        else
+            bufferReceive.writeByteIndex++;
+        bufferReceive.writeToStructFlag--;
+    }
+#else
     unsigned char failFlag = receiveByte(bufferReceive.buffer[bufferReceive.writeByteIndex]);
     if (!failFlag)
     {
         bufferReceive.buffer[bufferReceive.writeByteIndex] = 0;
         bufferReceive.writeToStructFlag = 0;
-        receiveDataNode->writeBackOff = 0;
+        if (receiveDataNode != NULL) // the packet may have been dropped by receiveAbort
+            receiveDataNode->writeBackOff = 0;
     }
+#endif
 }
 
 /**
- * This function firstly tries to get a mutex, if it fails to get one, it terminates. <br>
- * Then it will look for the next available bit from either payload, header, or premeable, based on sendControl.type. <br>
- * Then it will invoke sendBitManagement to manage sendBitIndex and sendControl.type. <br>
- * After that, it will release the mutex, and invoke sendBit. 
+ * If the last byte load has backed off, it is tried again first. If it backs off again, the previous bit is sent again. <br>
+ * Then the highest bit of the shift register is taken and the shift register is shifted left by 1 bit. <br>
+ * When all 8 bits are taken, loadNextSendByte is invoked to load the next byte. <br>
+ * After that, it will invoke sendBit. 
  * @brief This method extracts a bit from the node that is being sent. 
  */
 void prepareSendBit() 
 {
     // printf("Sending");
-    unsigned char dataBit = 0;
-    ATOMIC_BLOCK(ATOMIC_FORCEON) // atomic in entire action of getting mutex
+    PROFILE_BEGIN(PROFILE_PREPARE_SEND_BIT);
+    if (sendRegister.bitsLeft == 0) // loading the byte has backed off and main loop has not retried yet
     {
-        getMutex(0, sendDataNode);
+        sendDataNode->sendBackOff = 0;
+        loadNextSendByte();
+        if (sendRegister.bitsLeft == 0)
+        {
+            PROFILE_END(PROFILE_PREPARE_SEND_BIT);
+            sendBit((PORTB >> PB5) & 1);
+            return;
+        }
     }
-    if (sendDataNode->sendBackOff) // sendBackOff means fail to get mutex, then back off
-        return;
-    if (sendControl.type == 2) // send payload
-        dataBit = (sendDataNode->payload[sendControl.index / 8] >> (7 - (sendControl.index % 8))) & 1;
-    else if (sendControl.type == 1) // send header
-        dataBit = (sendDataNode->header[sendControl.index / 8] >> (7 - (sendControl.index % 8))) & 1;
-    else // send premeable
-    {
-        const int header = 0x7E;
-        dataBit = (header >> (7 - sendControl.index)) & 1;
-    }
-    // printf("%d", sendControl.bitIndex);
-    sendControl.index++;
-    sendBitManagement(); // check if need to reset send bit, or if sending has finished
-    sendDataNode->datalock = 0; // release mutex
+    unsigned char dataBit = sendRegister.shiftRegister >> 7;
+    sendRegister.shiftRegister <<= 1;
+    if (--sendRegister.bitsLeft == 0) // when a byte is completely sent
+        loadNextSendByte();
+    PROFILE_END(PROFILE_PREPARE_SEND_BIT);
     sendBit(dataBit);
 }
 
 /**
- * Firstly this function resets control data for receiving packets. <br>
+ * Firstly this function resets control data for receiving packets. If the packet has preempted another packet, the preempted packet is resumed instead, and the bits that have arrived meanwhile are kept, as they belong to it. <br>
  * Then if the newly received packet is to read, the CRC Value of the payload will be calculated and compared with the received CRC Value. <br>
  * Finally the data packet will be passed to layer 3 by invoking networkDataProcessing. 
  * @brief This method resets control data and invokes function on layer 3 when needed after a packet has been received in its entirety. 
  */
 void receiveWrapUp()
 {
-    receiveControl.active = receiveControl.type = bufferReceive.receiveBitIndex = bufferReceive.receiveByteIndex = receiveControl.index = 0; // reset data receiving parameters
-    if (receiveDataNode->toRead) // if need to pass received data to network
+    struct data_node *node = receiveDataNode;
+    if (receivePausedNode != NULL)
+    {
+        receiveDataNode = receivePausedNode;
+        receivePausedNode = NULL;
+        receiveControl.type = receivePausedControl.type;
+        receiveControl.index = receivePausedControl.index;
+    }
+    else
+    {
+        receiveDataNode = NULL; // released by receiveProcess
+#ifdef PHY_HW_SHIFT
+        receiveControl.active = receiveControl.type = receiveControl.index = 0; // the bytes queued meanwhile belong to what follows the packet
+#else
+        receiveControl.active = receiveControl.type = bufferReceive.receiveBitIndex = bufferReceive.receiveByteIndex = receiveControl.index = 0; // reset data receiving parameters
+#endif
+    }
+    statIncrement(framesReceived);
+    receiveProcess(node);
+}
+
+/**
+ * The check is a CRC32, CRC-16 or CRC-8 as given by the check type in the header. <br>
+ * Layer 3 reads the packet before this method returns, so the reference of the receiver is released afterwards. If the packet is still being forwarded, it is freed after it has been sent. 
+ * @brief This method checks the CRC of a completely received packet and passes it to layer 3 if it is to read. 
+ * @param node The received packet. 
+ */
+void receiveProcess(struct data_node *node)
+{
+    if (node->toRead) // if need to pass received data to network
     {
-        unsigned char i = receiveDataNode->length;
-        unsigned long receivedCRC = (unsigned long)receiveDataNode->header[0] << 24 | (unsigned long)receiveDataNode->header[1] << 16 | (unsigned long)receiveDataNode->header[2] << 8 | (unsigned long)receiveDataNode->header[3];
-        unsigned long crc = calculateCRC(receiveDataNode->payload, i);
+        unsigned char i = node->length;
+        unsigned char type = headerCheckType(node->header);
+        unsigned long receivedCRC = 0;
+        unsigned char j;
+        for (j = 0; j < checkLength(type); j++) // the check follows type and length, highest byte first
+            receivedCRC = receivedCRC << 8 | (unsigned char)node->header[2 + j];
+        unsigned long crc = frameCheck(type, node->payload, i);
         printCRCByByte(crc);
         printCRCByByte(receivedCRC);
-        // printf("%s\r\n", receiveDataNode->payload + 2);
+        // printf("%s\r\n", node->payload + 2);
 /*
         for (i = 0; i < 4; i++)
-            printf("%X ", receiveDataNode->header[i]);
+            printf("%X ", node->header[i]);
         printf("KFC %X %X", calculatedCRC, receivedCRC);
 */
         if (crc == receivedCRC)
-            networkDataProcessing(receiveDataNode, 1);
+            networkDataProcessing(node, 1);
         else
-            networkDataProcessing(receiveDataNode, 0);
+            networkDataProcessing(node, 0);
     }
-    // receiveDataNode = NULL;
+    dataNodeRelease(node);
     
 }
 
 /**
+ * The reference of the receiver to the packet is released. If the packet has been pushed to forwardDataQueue, it is still to be sent, and its receivers will find its CRC not matched. Its missing bytes are then sent as they are, instead of ESCAPE_FILL. <br>
+ * A preempted packet is dropped the same way, as the bytes that follow cannot be assigned to it any more. <br>
+ * All receive control data and the temporary byte buffers are reset, so that the next bit is used for premeable detection again. 
+ * @brief This method drops the packet that is being received and resynchronises the receiver. 
+ */
+void receiveAbort()
+{
+    ATOMIC_BLOCK(ATOMIC_FORCEON) // the pin change interrupt must not write bits while resetting
+    {
+        receiveControl.active = receiveControl.type = receiveControl.index = receiveControl.premeableRead = receiveControl.escaped = 0;
+        bufferReceive.receiveBitIndex = bufferReceive.receiveByteIndex = bufferReceive.writeByteIndex = bufferReceive.writeToStructFlag = 0;
+        int i;
+        for (i = 0; i < 5; i++)
+            bufferReceive.buffer[i] = 0;
+        receiveDrop(receiveDataNode);
+        receiveDrop(receivePausedNode);
+        receiveDataNode = receivePausedNode = NULL;
+    }
+}
+
+/**
+ * @brief This method releases a packet that is dropped while being received, which frees it unless it is being forwarded. 
+ * @param node The packet to drop, or NULL. 
+ */
+void receiveDrop(struct data_node *node)
+{
+    if (node == NULL)
+        return;
+    node->receivedLength = node->length;
+    dataNodeRelease(node);
+}
+
+/**
+ * Preemption is only valid in the payload of a packet that has not preempted another one. Otherwise, or if the urgent packet cannot be allocated, the packet is dropped by receiveAbort. 
+ * @brief This method pauses the packet being received when ESCAPE and ESCAPE_PREEMPT arrive, and starts receiving the header of the urgent packet. 
+ */
+void receivePreempt()
+{
+    if (receiveControl.type != 1 || receivePausedNode != NULL)
+    {
+        receiveAbort();
+        return;
+    }
+    receivePausedNode = receiveDataNode;
+    receivePausedControl = receiveControl;
+    if (!receiveStart())
+    {
+        receiveAbort();
+        return;
+    }
+    receiveDataNode->urgent = 1;
+}
+
+/**
+ * When no bit has arrived for receiveTimeoutPeriods periods, the upstream node has stopped its clock, e.g. by a reset in the middle of a packet. <br>
+ * When bits arrive but no byte has been written for 8 times as long, writing keeps backing off. <br>
+ * In both cases the packet is aborted by receiveAbort, so that the receiver hunts for the premeable again instead of taking the following bits as payload. 
+ * @brief This method aborts the packet being received when its reception has stalled. It is invoked once per period from the main loop. 
+ */
+void receiveWatchdog()
+{
+    if (!receiveControl.active)
+        return;
+    unsigned int bitSilence, byteSilence;
+    ATOMIC_BLOCK(ATOMIC_FORCEON) // stamps are written at pin change interrupt
+    {
+        bitSilence = globalPeriodStamp - bufferReceive.lastBitPeriodStamp;
+        byteSilence = globalPeriodStamp - bufferReceive.lastBytePeriodStamp;
+    }
+    if (bitSilence >= receiveTimeoutPeriods || byteSilence >= receiveTimeoutPeriods * 8)
+    {
+        printf("Receive timed out, packet dropped\r\n");
+        statIncrement(receiveTimeouts);
+        TRACE_TRIGGER(TRACE_TRIGGER_TIMEOUT);
+        receiveAbort();
+    }
+}
+
+/**
+ * @brief This method checks the received header CRC against the received check type, length and addresses. 
+ * @return Whether the header CRC matches. 
+ */
+int checkHeaderCRC()
+{
+    unsigned char type = headerCheckType(receiveDataNode->header);
+    return calculateHeaderCRC(type, receiveDataNode->header[1], receiveDataNode->payload) == (receiveDataNode->header[0] & 0x3F);
+}
+
+/**
+ * The length of the header is known from the check type in its first byte. An invalid check type drops the packet at once. <br>
  * This function resets receive bit index when header has been completely read. <br>
  * Then it initialises the buffer for receiving payload depending on the length from received header value. <br>
- * When first 2 bytes of payload has been received, they are sent to network layer to check if the packet is to read. <br>
+ * When first 2 bytes of payload has been received, the header CRC is checked. If it does not match, the packet is dropped by receiveAbort. <br>
+ * Otherwise they are sent to network layer to check if the packet is to read. <br>
  * When the entire payload has been received, receiveWrapUp is called for final processing. 
  * @brief This function checks if the bit index needs to be reset and the receive control type needs to be incremented. 
  */ 
@@ -311,25 +799,56 @@ void receiveByteManagement()
     if (receiveControl.type == 1) // when receiving payload
     {
         if (receiveControl.index == 2) // when both destination and source addresses have been received
+        {
+            if (!checkHeaderCRC()) // corrupted length or address, do not forward
+            {
+                printf("Header CRC not matched, packet dropped\r\n");
+                statIncrement(headerCrcFailures);
+                TRACE_TRIGGER(TRACE_TRIGGER_HEADER_CRC);
+                receiveAbort();
+                return;
+            }
             checkIfNeedForwardOrRead(receiveDataNode->payload);
+            if (receiveDataNode == NULL) // dropped as forward queue is full
+                return;
+        }
         if (receiveControl.index == receiveDataNode->length) // when finished receiving the entirety of payload
             receiveWrapUp();
     }
     else
     {
-        if (receiveControl.index == 5) // when finished receiving header
+        if (receiveControl.index == 1 && headerCheckType(receiveDataNode->header) > CHECK_CRC8) // invalid check type, the first byte is corrupted
+        {
+            printf("Header CRC not matched, packet dropped\r\n");
+            statIncrement(headerCrcFailures);
+            TRACE_TRIGGER(TRACE_TRIGGER_HEADER_CRC);
+            receiveAbort();
+        }
+        else if (receiveControl.index == headerLength(receiveDataNode->header)) // when finished receiving header
         {
+            if (receiveDataNode->header[1] < 2 || receiveDataNode->header[1] > receiveMaxLength) // a packet carries at least the 2 addresses, and a longer length than accepted is most likely corrupted
+            {
+                statIncrement(lengthAborts);
+                TRACE_TRIGGER(TRACE_TRIGGER_LENGTH);
+                receiveAbort();
+                return;
+            }
             receiveControl.type = 1; // change to receive payload
             receiveControl.index = 0; // reset bit index for receiving payload
-            receiveDataNode->length = receiveDataNode->header[4]; // put length into proper field in structure
-            receiveDataNode->payload = calloc(receiveDataNode->length, 1); // initialise memory to receive payload
-            
+            receiveDataNode->length = receiveDataNode->header[1]; // put length into proper field in structure
+            receiveDataNode->payload = memoryCalloc(MEMORY_DATALINK, receiveDataNode->length, 1); // initialise memory to receive payload
+            if (receiveDataNode->payload == NULL)
+            {
+                statIncrement(receiveNoMemory);
+                receiveAbort();
+            }
         }
     }
 }
 
 /**
  * Firstly this function gets a mutex. In case it fails, the function terminates. <br>
+ * ESCAPE is not written, but marks the next byte: ESCAPE_LITERAL is written as ESCAPE, ESCAPE_PREEMPT starts an urgent packet by receivePreempt, and ESCAPE_FILL is ignored. <br>
  * Then the newly read byte is put to either payload or header buffer depending on the value in receiveControl.type <br>
  * After that it releases the mutex, and invoke receiveByteManagement. 
  * @brief This method writes a byte from temporary buffer to an instance of the data_node. 
@@ -348,11 +867,32 @@ int receiveByte(unsigned char byte)
     {
         return 1;
     }
+    bufferReceive.lastBytePeriodStamp = globalPeriodStamp;
+    if (!receiveControl.escaped && byte == ESCAPE)
+    {
+        receiveControl.escaped = 1;
+        receiveDataNode->datalock = 0;
+        return 0;
+    }
+    if (receiveControl.escaped)
+    {
+        receiveControl.escaped = 0;
+        if (byte != ESCAPE_LITERAL) // preemption or fill
+        {
+            receiveDataNode->datalock = 0;
+            if (byte == ESCAPE_PREEMPT)
+                receivePreempt();
+            return 0;
+        }
+        byte = ESCAPE;
+    }
     if (receiveControl.type) // when receiving payload
         receiveDataNode->payload[receiveControl.index] = byte;
     else // when receiving header
         receiveDataNode->header[receiveControl.index] = byte;
     receiveControl.index++;
+    if (receiveControl.type)
+        receiveDataNode->receivedLength = receiveControl.index;
     receiveDataNode->datalock = 0; // release mutex
     receiveByteManagement();
     /*
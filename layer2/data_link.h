@@ -1,26 +1,62 @@
 
+unsigned char calculateHeaderCRC(unsigned char type, unsigned char length, unsigned char *payload);
+
+unsigned char frameCheckType(unsigned char length);
+
+unsigned long frameCheck(unsigned char type, unsigned char *payload, unsigned char length);
+
+void dataNodeHeader(unsigned char *header, unsigned char length, unsigned char *payload);
+
 struct data_node* dataNodeConstructor(unsigned char length, unsigned char *payload);
 
-void prepareDataNodeForSending(unsigned char length, unsigned char *payload);
+void dataNodeRetain(struct data_node *node);
+
+void dataNodeRelease(struct data_node *node);
+
+void prepareDataNodeForSending(unsigned char length, unsigned char *payload, unsigned char urgent);
+
+int requeueDataNode(struct data_node *node);
 
 void clockTickSendDecisionMaker();
 
+int receiveStart();
+
 void detectPremeable(unsigned char bit);
 
 void sendWrapUp();
 
+void sendPreempt();
+
+void sendStart(struct data_node *node);
+
+void loadNextSendByte();
+
 void prepareSendBit();
 
 void getMutex(unsigned char receiving, struct data_node *node);
 
 void writeBitToBuffer(unsigned char bit);
 
-void writeByteToStruct();
+void writeByteToBuffer(unsigned char byte);
 
-void sendBitManagement();
+unsigned char prepareSendByte();
+
+void writeByteToStruct();
 
 void receiveWrapUp();
 
+void receiveProcess(struct data_node *node);
+
+void receivePreempt();
+
+void receiveAbort();
+
+void receiveDrop(struct data_node *node);
+
+void receiveWatchdog();
+
+int checkHeaderCRC();
+
 void receiveByteManagement();
 
 int receiveByte(unsigned char byte);
\ No newline at end of file
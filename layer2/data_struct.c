@@ -29,23 +29,49 @@
 #include "data_link.h"
 #include "../irq/interrupt_handler.h"
 #include "../layer1/physical.h"
+#include "../stats/stats.h"
 
 extern struct comm_control sendControl;
 extern struct comm_control receiveControl;
 
 extern struct data_node *forwardDataQueue, *forwardDataQueueEnd; 
 extern struct data_node *sendDataQueue, *sendDataQueueEnd; 
+extern struct data_node *urgentDataQueue, *urgentDataQueueEnd; 
 extern struct data_node *sendDataNode; 
 extern struct data_node *receiveDataNode; 
 
-extern const int ADDRESS;
+extern int ADDRESS;
+extern struct statistics stats;
+extern unsigned int rateLimit;
+extern struct token_bucket rateBucket;
+
+/**
+ * Urgent packets are counted in the depth of forward queue if they are forwarded, and of send queue otherwise. They are not limited by the token bucket. 
+ * @brief This function pops the first node of urgentDataQueue. It is only invoked at timer interrupt or with interrupts disabled. 
+ * @return The pointer to the urgent data node, or NULL if there is none. 
+ */
+struct data_node* popUrgentQueue()
+{
+    struct data_node *temp = urgentDataQueue;
+    if (temp == NULL)
+        return NULL;
+    if (urgentDataQueue == urgentDataQueueEnd)
+        urgentDataQueue = urgentDataQueueEnd = NULL;
+    else
+        urgentDataQueue = urgentDataQueue->next;
+    if (temp->forwarded)
+        stats.forwardQueueDepth--;
+    else
+        stats.sendQueueDepth--;
+    return temp;
+}
 
 /**
 * This function checks if there is any node left to be sent. <br>
-* Firstly it looks for queue dedicated to nodes being forwarded as they are prioritised. <br>
+* Firstly it looks for queue dedicated to urgent nodes, such as ACK messages, then for queue dedicated to nodes being forwarded as they are prioritised. <br>
 * Function pops first node and returns it if there is node in such queue. <br>
 * Then it looks for queue dedicated to nodes that originates in this device. <br>
-* Function pops first node and returns it if there is node in such queue. <br>
+* Function pops first node and returns it if there is node in such queue and the token bucket has tokens left, or rateLimit is 0. The bytes of the packet are taken from the bucket. <br>
 * If both queues are empty, null is returned.
 * @brief This function returns an instance of data_node if there exists data node to be sent. 
 * @return The pointer to the data node which will be sent soon. 
@@ -53,7 +79,9 @@ extern const int ADDRESS;
 struct data_node* popSendQueue() // return null when no more node to send; return the node when need sending
 {
     struct data_node *temp = NULL;
-    if (forwardDataQueue != NULL) // check forward queue as these nodes are prioritised
+    if (urgentDataQueue != NULL)
+        temp = popUrgentQueue();
+    else if (forwardDataQueue != NULL) // check forward queue as these nodes are prioritised
     {
 		//// printf("Pop Forward\r\n");
         temp = forwardDataQueue;
@@ -61,8 +89,9 @@ struct data_node* popSendQueue() // return null when no more node to send; retur
             forwardDataQueue = forwardDataQueueEnd = NULL;
         else
             forwardDataQueue = forwardDataQueue->next;
+        stats.forwardQueueDepth--;
     }
-    else if (sendDataQueue != NULL) // check sent queue later as they are of lower priority
+    else if (sendDataQueue != NULL && (!rateLimit || rateBucket.tokens > 0)) // check sent queue later as they are of lower priority
     {
 		//// printf("Pop Normal\r\n");
         temp = sendDataQueue;
@@ -70,37 +99,81 @@ struct data_node* popSendQueue() // return null when no more node to send; retur
             sendDataQueue = sendDataQueueEnd = NULL;
         else
             sendDataQueue = sendDataQueue->next;
+        stats.sendQueueDepth--;
+        if (rateLimit)
+            rateBucket.tokens -= temp->length + headerLength(temp->header) + 1; // payload, header and premeable
     }
     return temp;
 }
 
 
 /**
+ * The queue is modified with interrupts disabled, because popSendQueue is invoked at timer interrupt. 
+ * @brief This function pushes a data node to urgentDataQueue. 
+ * @param node Pointer to the instance of data_node which will be sent before other nodes. 
+ */
+void pushUrgentQueue(struct data_node *node)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        node->next = NULL;
+        if (urgentDataQueue == NULL)
+            urgentDataQueue = urgentDataQueueEnd = node;
+        else
+        {
+            urgentDataQueueEnd->next = node;
+            urgentDataQueueEnd = node;
+        }
+    }
+}
+
+/**
+ * The queue is modified with interrupts disabled, because popSendQueue is invoked at timer interrupt. <br>
+ * An urgent packet, i.e. one that has preempted another packet while being received, is pushed to urgentDataQueue instead. <br>
+ * The queue takes its own reference to the node, which is released when the node has been sent, as the receiver still holds one. 
  * @brief This function pushes a data node to forwardDataQueue. This is only invoked when a node is to forward. 
  * @param node Pointer to the instance of data_node which will be forwarded. 
  */
 void jumpSendQueue(struct data_node *node) // for forwarding packet
 {
-    if (forwardDataQueue == NULL)
-        forwardDataQueue = forwardDataQueueEnd = node;
-    else
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-        forwardDataQueueEnd->next = node;
-        forwardDataQueueEnd = node;
+        node->forwarded = 1;
+        dataNodeRetain(node);
+        if (node->urgent)
+            pushUrgentQueue(node);
+        else if (forwardDataQueue == NULL)
+            forwardDataQueue = forwardDataQueueEnd = node;
+        else
+        {
+            forwardDataQueueEnd->next = node;
+            forwardDataQueueEnd = node;
+        }
+        if (++stats.forwardQueueDepth > stats.forwardQueuePeak)
+            stats.forwardQueuePeak = stats.forwardQueueDepth;
     }
 }
 
 /**
+ * The queue is modified with interrupts disabled, because popSendQueue is invoked at timer interrupt. <br>
+ * An urgent packet is pushed to urgentDataQueue instead. 
  * @brief This function pushes a data node to sendDataQueue. This is only invoked when a node is sent by user action. 
  * @param node Pointer to the instance of data_node which will be sent. 
  */
 void pushSendQueue(struct data_node *node) // for sending packet
 {
-    if (sendDataQueue == NULL)
-        sendDataQueue = sendDataQueueEnd = node;
-    else
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-        sendDataQueueEnd->next = node;
-        sendDataQueueEnd = node;
+        if (node->urgent)
+            pushUrgentQueue(node);
+        else if (sendDataQueue == NULL)
+            sendDataQueue = sendDataQueueEnd = node;
+        else
+        {
+            sendDataQueueEnd->next = node;
+            sendDataQueueEnd = node;
+        }
+        if (++stats.sendQueueDepth > stats.sendQueuePeak)
+            stats.sendQueuePeak = stats.sendQueueDepth;
     }
 }
@@ -1,3 +1,26 @@
+#define PREMEABLE 0x7E ///< This is the premeable which starts every packet. 
+#define HEADER_MAX_LENGTH 6 ///< This denotes the longest packet header in bytes: 1 byte of check type and header CRC, 1 byte of payload length, and 4 bytes of CRC32. 
+#define CHECK_CRC32 0 ///< This check type denotes a CRC32 of the payload in the header. 
+#define CHECK_CRC16 1 ///< This check type denotes a CRC-16 of the payload in the header. 
+#define CHECK_CRC8 2 ///< This check type denotes a CRC-8 of the payload in the header. Check type 3 is invalid. 
+#ifndef CHECK_CRC8_MAX_LENGTH
+#define CHECK_CRC8_MAX_LENGTH 8 ///< This denotes the longest payload, including addresses, sent with CRC-8, such as ACK and credit updates. 
+#endif
+#ifndef CHECK_CRC16_MAX_LENGTH
+#define CHECK_CRC16_MAX_LENGTH 64 ///< This denotes the longest payload, including addresses, sent with CRC-16. Longer payloads are sent with CRC32. 
+#endif
+#define headerCheckType(header) ((unsigned char)(header)[0] >> 6) ///< This takes the check type from the first byte of a header. 
+#define checkLength(type) ((type) == CHECK_CRC32 ? 4 : (type) == CHECK_CRC16 ? 2 : 1) ///< This denotes the bytes of the payload check of a check type. 
+#define headerLength(header) (2 + checkLength(headerCheckType(header))) ///< This denotes the length of a header, which depends on its check type. 
+
+#define ESCAPE 0x7D ///< This is the escape byte in header and payload. It is always followed by one of the ESCAPE definitions below. 
+#define ESCAPE_LITERAL 0x5D ///< This follows ESCAPE in place of a header or payload byte of 0x7D. 
+#define ESCAPE_PREEMPT 0x7E ///< This follows ESCAPE when an urgent packet preempts the payload being sent. The header and payload of the urgent packet follow, then the rest of the preempted payload. 
+#define ESCAPE_FILL 0x7D ///< This follows ESCAPE when the next byte of a forwarded packet has not been received yet. It is ignored by the receiver. 
+#define PREEMPT_MIN_BYTES 8 ///< This denotes how many payload bytes must be left for a packet to be preempted. A shorter rest is sent first. 
+
+#define RATE_INCREASE 1 ///< This denotes the bytes per second added to the rate in AIMD mode, once per msgWaitingPeriod without congestion. 
+
 //! This structure is used as a temporary buffer for bit receiving before the bits are written to data_node instance (i.e. The packet). 
 /**
  * This struct stores temporarily the bits received before a byte is accumulated and further processed. <br>
@@ -9,14 +32,16 @@ struct receive_buffer
     unsigned char receiveBitIndex; ///< This denotes the index of the incoming bit. 
     unsigned char receiveByteIndex; ///< This denotes the index on the location of the currently using byte buffer in array. 
     unsigned char writeByteIndex; ///< This denotes which bytes in the buffer array is ready to be processed. 
-    unsigned char writeToStructFlag; ///< This flag represents that a byte is ready to be processed. 
+    unsigned char writeToStructFlag; ///< This flag represents that a byte is ready to be processed. In the hardware-shifted build, it counts the bytes waiting in buffer. 
+    unsigned int lastBitPeriodStamp; ///< This is the period stamp at which the last bit of the packet being received has arrived. 
+    unsigned int lastBytePeriodStamp; ///< This is the period stamp at which the last byte of the packet being received has been written to receiveDataNode. 
 };
 
 //! This structure is used for controlling the flow of the receiving or sending process. 
 /**
  * This structure stores control data for the purpose of controlling sending and receiving processes. <br>
- * for receivng: type 0 is header, type 1 is payload. <br>
- * for sending: type 0 is premeable, type 1 is header, type 2 is payload. <br>
+ * for receivng: type 0 is header, type 1 is payload. escaped denotes that the last byte received was ESCAPE. <br>
+ * for sending: type 0 is premeable, type 1 is header, type 2 is payload. The position in each part is kept in send_register. <br>
  * premeableRead is used to store the last 8 bits received when the device is not receiving a packet. <br>
  * premeableRead is used to compare with the pattern of premeable at every pinInterrupt, whenever a premeable is detected, premeableRead is reset. <br>
  * active denotes whether the sending or receiving process is active.
@@ -25,13 +50,31 @@ struct comm_control
 {
     int active; ///< This denotes whether sending or receiving is active. 
     int type; ///< This denotes which part of the message is being read or sent. 
-    int index; ///< This denotes, for receiving the byte index of incoming byte, or for sending the bit index of the next bit to send. 
+    int index; ///< This denotes, for receiving the byte index of incoming byte. It is not used for sending. 
     unsigned char premeableRead; ///< This is only for managing receiving process. This is the buffer for storing read bits at premeable detection when receiving procedure is not activated. 
+    unsigned char escaped; ///< This is only for managing receiving process. This flag denotes that the last received byte was ESCAPE. 
+};
+
+//! This structure is used as the shift register of the sending process. 
+/**
+ * The premeable, header, and payload of a packet are sent as one stream of bytes. <br>
+ * cursor points to the next byte to load and bytesLeft denotes how many bytes are left in the current part, which is denoted by type in sendControl. <br>
+ * At each timer interrupt the highest bit of shiftRegister is sent and shiftRegister is shifted left by 1 bit, so that a byte is only loaded once every 8 bits. <br>
+ * When ESCAPE is loaded, the byte that follows it is kept in escapeByte and loaded next without moving the cursor. 
+*/
+struct send_register
+{
+    unsigned char shiftRegister; ///< This is the byte that is being sent, highest bit first. 
+    unsigned char bitsLeft; ///< This denotes how many bits of shiftRegister are left to send. 0 means that loading the next byte has backed off. 
+    unsigned char bytesLeft; ///< This denotes how many bytes of the current part are left to load. 
+    const unsigned char *cursor; ///< This points to the next byte to load. 
+    unsigned char escapeByte; ///< This is the second byte of an escape sequence that is still to load, 0 if there is none. 
 };
 
 //! This structure represents a data link level packet and acts as a node in a linked list at the send queue. 
 /**
- * 
+ * A received packet that is both forwarded and read is shared by forwardDataQueue and the receiver without copying, so it is reference counted. <br>
+ * It is taken by dataNodeRetain and given up by dataNodeRelease, which frees header, payload and node when no reference is left. 
  */
 struct data_node
 {
@@ -43,14 +86,38 @@ struct data_node
     int toRead; ///< This is the flag on whether this packet should be read after receiving this packet in its entirety. 
     int sendBackOff; ///< This denotes whether a send method has failed to get the mutex. 
     int writeBackOff; ///< This denotes whether a receive method has failed to get the mutex. 
+    int forwarded; ///< This flag denotes that the packet has been pushed to forwardDataQueue while being received. 
+    unsigned char references; ///< This denotes how many owners hold the packet: the receiver, forwardDataQueue until the packet has been sent, and a send queue until the packet has been sent. The last release frees it. 
+    unsigned char urgent; ///< This flag denotes that the packet is sent from urgentDataQueue and preempts other packets. 
+    unsigned char receivedLength; ///< This denotes how many payload bytes are present. It only differs from length while the packet is being received, so that forwarding does not send bytes that have not arrived. 
+    unsigned int periodStamp; ///< This is the period stamp at which receiving the packet has started, or at which it has been built. 
+    unsigned char stampOffset; ///< This is the offset of 2 payload bytes which sendStart sets to the periods elapsed since periodStamp, before the check is calculated again. 0 if the packet is sent as it is. 
 };
 
 
 
+//! This structure is the token bucket which limits the packets originated by this device. 
+/**
+ * Tokens are bytes. They are added at every period according to rate, up to rateBurst, and taken when a packet leaves sendDataQueue. <br>
+ * A packet may leave whenever tokens are positive, so tokens become negative after a packet longer than the remaining tokens. This lets packets longer than rateBurst pass at the configured rate. 
+*/
+struct token_bucket
+{
+    int tokens; ///< This denotes how many bytes may be sent. It is taken at timer interrupt, so it is only added to with interrupts disabled. 
+    unsigned int rate; ///< This denotes the current rate in bytes per second. It equals rateLimit, unless it has been cut in AIMD mode. 
+    unsigned int remainder; ///< This is the part of rate times elapsed periods which has not amounted to a whole byte yet. 
+    unsigned int lastPeriodStamp; ///< This is the period stamp of the last refill. 
+    unsigned int lastChangePeriodStamp; ///< This is the period stamp of the last change of rate in AIMD mode. 
+};
+
+struct data_node* popUrgentQueue();
+
 struct data_node* popSendQueue();
 
 
 
+void pushUrgentQueue(struct data_node *node);
+
 void pushSendQueue(struct data_node *node);
 
 
@@ -0,0 +1,140 @@
+/**
+ * @file rate_limit.c
+ * @author David Ng 550084
+ * @brief This component limits the rate of packets originated by this device with a token bucket, so that forward queues of downstream nodes do not grow without bound 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "rate_limit.h"
+
+extern int sendSpeed;
+extern unsigned int globalPeriodStamp;
+extern unsigned int msgWaitingPeriod;
+extern unsigned int rateLimit;
+extern unsigned char rateBurst;
+extern unsigned char rateAimdThreshold;
+extern struct statistics stats;
+
+struct token_bucket rateBucket = {0, 0, 0, 0, 0}; ///< This is the token bucket of packets originated by this device. 
+
+/**
+ * @brief This function returns how many timer interrupts occur in one second at the current speed. 
+ * @return The number of periods per second. 
+ */
+unsigned char ratePeriodsPerSecond()
+{
+    switch (sendSpeed)
+    {
+        case 1:
+        return 5;
+        case 2:
+        return 25;
+        case 3:
+        return 50;
+        case 4:
+        return 100;
+        default:
+        return 200;
+    }
+}
+
+/**
+ * This is invoked at startup and whenever rateLimit or rateBurst is changed. 
+ * @brief This function sets the rate to rateLimit and fills the token bucket. 
+ */
+void rateReset()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        rateBucket.tokens = rateBurst;
+    }
+    rateBucket.rate = rateLimit;
+    rateBucket.remainder = 0;
+    rateBucket.lastPeriodStamp = rateBucket.lastChangePeriodStamp = globalPeriodStamp;
+}
+
+/**
+ * Firstly, in AIMD mode, the rate is cut when forward queue has reached rateAimdThreshold, or else raised by RATE_INCREASE once per msgWaitingPeriod until it reaches rateLimit. <br>
+ * Then the bytes earned at the current rate since the last refill are added to the bucket, up to rateBurst. The periods may be more than one, as the main loop can be delayed. 
+ * @brief This function refills the token bucket at every period. 
+ */
+void ratePeriodUpdate()
+{
+    unsigned int elapsed = globalPeriodStamp - rateBucket.lastPeriodStamp; // correct on wrap around as well
+    rateBucket.lastPeriodStamp = globalPeriodStamp;
+    if (!rateLimit)
+        return;
+    if (rateAimdThreshold && stats.forwardQueueDepth >= rateAimdThreshold)
+        rateCongestion();
+    else if (rateAimdThreshold && rateBucket.rate < rateLimit && periodDiffCalculator(rateBucket.lastChangePeriodStamp) >= msgWaitingPeriod)
+    {
+        rateBucket.rate += RATE_INCREASE;
+        rateBucket.lastChangePeriodStamp = globalPeriodStamp;
+    }
+    unsigned char periodsPerSecond = ratePeriodsPerSecond();
+    unsigned long earned = rateBucket.remainder + (unsigned long)rateBucket.rate * elapsed;
+    rateBucket.remainder = earned % periodsPerSecond;
+    earned /= periodsPerSecond;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        long tokens = rateBucket.tokens + (earned > rateBurst ? rateBurst : earned);
+        rateBucket.tokens = tokens > rateBurst ? rateBurst : tokens;
+    }
+}
+
+/**
+ * This is invoked when a message of this device times out, and at every period while forward queue is at rateAimdThreshold. <br>
+ * The rate is halved at most once per msgWaitingPeriod, as the effect of a cut is only seen after that, and never drops below 1 byte per second. 
+ * @brief This function cuts the rate in AIMD mode. 
+ */
+void rateCongestion()
+{
+    if (!rateLimit || !rateAimdThreshold || periodDiffCalculator(rateBucket.lastChangePeriodStamp) < msgWaitingPeriod)
+        return;
+    rateBucket.rate = rateBucket.rate > 1 ? rateBucket.rate / 2 : 1;
+    rateBucket.lastChangePeriodStamp = globalPeriodStamp;
+    statIncrement(rateCuts);
+}
+
+/**
+ * @brief This function prints the configured and current rate and the tokens in the bucket. 
+ */
+void ratePrint()
+{
+    if (!rateLimit)
+    {
+        printf("Rate not limited\r\n");
+        return;
+    }
+    int tokens;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        tokens = rateBucket.tokens;
+    }
+    printf("Rate %u of %u bytes/s, burst %u, tokens %d, AIMD %s\r\n", rateBucket.rate, rateLimit, rateBurst, tokens, rateAimdThreshold ? "on" : "off");
+}
@@ -0,0 +1,9 @@
+unsigned char ratePeriodsPerSecond();
+
+void rateReset();
+
+void ratePeriodUpdate();
+
+void rateCongestion();
+
+void ratePrint();
@@ -29,32 +29,69 @@
 #include "../layer2/data_link.h"
 #include "../irq/interrupt_handler.h"
 #include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "../trace/trace.h"
+#include "../ping/ping.h"
 
 extern struct data_node *forwardDataQueue, *forwardDataQueueEnd;
 extern struct data_node *sendDataQueue, *sendDataQueueEnd; // Queue for node to be sent
 extern struct data_node *sendDataNode; // Node currently being sent
 extern struct data_node *receiveDataNode; // Where received data goes
 
-extern const int ADDRESS;
+extern int ADDRESS;
+extern struct statistics stats;
+extern uint16_t multicastGroups;
+extern unsigned char forwardQueueLimit;
 
 /**
  * This function inserts sender and receiver addresses to the head of the payload from transport layer. <br>
- * Then prepareDataNodeForSending in data link layer is invoked for further processing before sending. 
+ * Then prepareDataNodeForSending in data link layer is invoked for further processing before sending. <br>
+ * If memory cannot be allocated, the payload is freed and nothing is sent. 
  * @brief This function inserts source and destination addresses into payload before passing it to data link layer. 
  * @param dest The destination address in integer. 
  * @param length The length of the payload without addresses. 
  * @param dataArr Payload to send as character array. 
+ * @param urgent A flag to denote whether the packet preempts other packets, which is only used for short control messages such as ACK. 
  */
-void prepareDataSend(int dest, int length, unsigned char *dataArr)
+void prepareDataSend(int dest, int length, unsigned char *dataArr, unsigned char urgent)
 {
-    unsigned char *payload = calloc(length + 2, sizeof(char)); // 2 bytes longer due to destination and source addresses
+    unsigned char *payload = memoryCalloc(MEMORY_NETWORK, length + 2, sizeof(char)); // 2 bytes longer due to destination and source addresses
+    if (payload == NULL)
+    {
+        memoryFree(dataArr);
+        return;
+    }
     payload[0] = dest, payload[1] = ADDRESS;
     int i;
     for (i = 0; i < length; i++) // copy everything from transport layer info to the network layer
         payload[i + 2] = dataArr[i];
 
-    free(dataArr);
-    prepareDataNodeForSending(length + 2, payload);
+    memoryFree(dataArr);
+    prepareDataNodeForSending(length + 2, payload, urgent);
+}
+
+/**
+ * Unlike prepareDataSend, the packet is not queued, but returned to transport layer, which keeps it for retransmission and queues it by requeueDataNode. 
+ * @brief This function inserts source and destination addresses into payload and builds the packet on data link layer. 
+ * @param dest The destination address in integer. 
+ * @param length The length of the payload without addresses. 
+ * @param dataArr Payload to send as character array. It is left to the caller. 
+ * @return The packet, or NULL if there is no memory. 
+ */
+struct data_node* prepareDataFrame(int dest, int length, unsigned char *dataArr)
+{
+    unsigned char *payload = memoryMalloc(MEMORY_NETWORK, length + 2);
+    if (payload == NULL)
+        return NULL;
+    payload[0] = dest, payload[1] = ADDRESS;
+    int i;
+    for (i = 0; i < length; i++)
+        payload[i + 2] = dataArr[i];
+    struct data_node *node = dataNodeConstructor(length + 2, payload);
+    if (node == NULL)
+        memoryFree(payload);
+    return node;
 }
 
 /**
@@ -67,44 +104,104 @@ void networkDataProcessing(struct data_node *data, int crcMatched)
     if (crcMatched)
     {
         printf("CRC GEKLAPPT!\r\n");
-        if (data->payload[1] == ADDRESS && data->payload[0]) // when a packet is sent from this device and the recipient does not exist
+        if (data->payload[0] == PING_ADDRESS) // a probe returned to this device, or to send on
+            pingReceived(data->payload, data->length, data->periodStamp);
+        else if (isMulticast(data->payload[0])) // only read when this device has joined the group, or the message sent by this device is returned
+        {
+            if (data->payload[1] == ADDRESS)
+                notifySuccessBroadcast(data->length - 2, data->payload + 2, data->payload[0]);
+            else
+                transportProcessing(data->payload[1], data->payload[0], data->length - 2, data->payload + 2, data);
+        }
+        else if (data->payload[1] == ADDRESS && data->payload[0]) // when a packet is sent from this device and the recipient does not exist
         {
             char tempAddress = data->payload[0];
-            notifyFailSend(data->payload + 2, tempAddress);
+            notifyFailSend((char*)data->payload + 2, tempAddress);
         }
         else if (data->payload[0] == ADDRESS || (data->payload[0] == 0 && data->payload[1] != ADDRESS)) 
         // when this device is the intended recipient or a broadcast message is received
         {
-            transportProcessing(data->payload[1], data->payload[0], data->header[4] - 2, data->payload + 2); // pass to transport layer for processing
-            // In above statement, "data->header[4] - 2" is passed because it is necessary to deduct the length of origin and destination addresses
+            transportProcessing(data->payload[1], data->payload[0], data->length - 2, data->payload + 2, data); // pass to transport layer for processing
+            // In above statement, "data->length - 2" is passed because it is necessary to deduct the length of origin and destination addresses
             // "data->payload + 2" is for skipping the first 2 bytes of payload, which carry destination and source addresses
         }
         else if (data->payload[1] == ADDRESS && data->payload[0] == 0) // when the broadcast message sent by this device is returned
-            notifySuccessBroadcast(data->header[4] - 2, data->payload + 2);
+            notifySuccessBroadcast(data->length - 2, data->payload + 2, 0);
 				
     }
     else
     {
         printf("schade: CRC not matched\r\n");
-        
+        statIncrement(crcFailures);
+        TRACE_TRIGGER(TRACE_TRIGGER_CRC);
     }
 }
 
 /**
+ * When forwardDataQueue already holds forwardQueueLimit packets, the packet is dropped by receiveAbort instead, so that a slow downstream node cannot exhaust the heap. 
+ * @brief This function pushes the packet being received to forwardDataQueue. 
+ */
+void forwardReceivingPacket()
+{
+    if (stats.forwardQueueDepth >= forwardQueueLimit)
+    {
+        statIncrement(queueDrops);
+        receiveAbort();
+        return;
+    }
+    jumpSendQueue(receiveDataNode);
+    statIncrement(framesForwarded);
+}
+
+/**
+ * A multicast packet is forwarded like a broadcast, but only read when this device has joined its group, which is a single bit test of multicastGroups. <br>
+ * A multicast packet sent by this device is read when it is returned, so that the group delivery can be reported. <br>
+ * A ping probe is only read, as it is sent on by ping.c after its record has been added. <br>
+ * If forwardDataQueue is full, the packet is dropped and receiveDataNode becomes NULL. 
  * @brief This is to determine whether the receiving node needs to be forwarded or read based on the sender and receiver addresses. 
  * @param payload This is the pointer to the payload in packet as a pointer of character array. 
  */
 void checkIfNeedForwardOrRead(unsigned char *payload)
 {
     printf("\r\nS:%d R:%d\r\n", payload[1], payload[0]);
-    if (payload[0] && payload[0] != ADDRESS && payload[1] != ADDRESS) // not broadcast and this atmega is not the intended recipient
+    if (payload[0] == PING_ADDRESS)
+        ; // read and sent on as a new packet
+    else if (isMulticast(payload[0]))
+    {
+        if (payload[1] != ADDRESS) // continuing forwarding if it is not the multicast message circulated back
+        {
+            receiveDataNode->toRead = isSubscribed(payload[0]);
+            forwardReceivingPacket();
+        }
+    }
+    else if (payload[0] && payload[0] != ADDRESS && payload[1] != ADDRESS) // not broadcast and this atmega is not the intended recipient
     {
         receiveDataNode->toRead = 0;
-        jumpSendQueue(receiveDataNode); // start forwarding
+        forwardReceivingPacket(); // start forwarding
     }
     else if (payload[0] == 0) // check if it is a broadcast message
     {
         if (payload[1] != ADDRESS) // continuing forwarding if it is not the broadcast message circulated back
-            jumpSendQueue(receiveDataNode);
+            forwardReceivingPacket();
     }
 }
+
+/**
+ * @brief This function makes this device a member of a multicast group, so that packets to the group are read. 
+ * @param group The number of the group, from 0 to MULTICAST_GROUPS - 1. 
+ */
+void multicastJoin(unsigned char group)
+{
+    if (group < MULTICAST_GROUPS)
+        multicastGroups |= 1 << group;
+}
+
+/**
+ * @brief This function removes this device from a multicast group, so that packets to the group are only forwarded. 
+ * @param group The number of the group, from 0 to MULTICAST_GROUPS - 1. 
+ */
+void multicastLeave(unsigned char group)
+{
+    if (group < MULTICAST_GROUPS)
+        multicastGroups &= ~(1 << group);
+}
@@ -1,10 +1,26 @@
+#define MULTICAST_FIRST 0xE0 ///< This is the address of multicast group 0. 
+#define MULTICAST_GROUPS 16 ///< This denotes the number of multicast groups, addressed from MULTICAST_FIRST onwards. 
 
+#define PING_ADDRESS 0xF0 ///< This is the destination of ping probes. A probe is not forwarded as it is received, but read and sent on by every node, which adds its record. No node may take this address. 
 
-void prepareDataSend(int dest, int length, unsigned char *dataArr);
+#define isMulticast(address) ((unsigned char)((address) - MULTICAST_FIRST) < MULTICAST_GROUPS) ///< This checks whether an address is a multicast group. 
+#define isSubscribed(address) ((multicastGroups >> ((address) - MULTICAST_FIRST)) & 1) ///< This checks whether this device has joined the multicast group of an address. 
+
+
+
+void prepareDataSend(int dest, int length, unsigned char *dataArr, unsigned char urgent);
+
+struct data_node* prepareDataFrame(int dest, int length, unsigned char *dataArr);
 
 
 
 void networkDataProcessing(struct data_node *data, int crcMatched);
 
 
-void checkIfNeedForwardOrRead( unsigned char *payload);
\ No newline at end of file
+void forwardReceivingPacket();
+
+void checkIfNeedForwardOrRead( unsigned char *payload);
+
+void multicastJoin(unsigned char group);
+
+void multicastLeave(unsigned char group);
@@ -0,0 +1,219 @@
+/**
+ * @file credit.c
+ * @author David Ng 550084
+ * @brief This component is responsible for flow control on transport layer, by which receivers advertise how many more messages they can accept. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "transport_struct.h"
+#include "inflight.h"
+#include "credit.h"
+
+extern unsigned int msgWaitingPeriod;
+extern unsigned int globalPeriodStamp;
+extern unsigned char sendQueueLimit;
+extern struct statistics stats;
+extern struct inflight_table inflight;
+
+struct peer_credit peerCredits[CREDIT_PEERS]; ///< This is the credit of peers that have advertised credit. Peers without entry are not limited. 
+unsigned char starvedPeers[CREDIT_STARVED]; ///< These are the peers to which no credit has been advertised, 0 for an unused entry. 
+
+/**
+ * Each credit stands for CREDIT_UNIT bytes of free memory between heap and stack. No credit is given while send queue is full, as ACK messages and forwarded packets could not be sent. 
+ * @brief This function calculates how many more messages this device can accept. 
+ * @return The credit from 0 to CREDIT_MAX. 
+ */
+unsigned char creditAvailable()
+{
+    if (stats.sendQueueDepth >= sendQueueLimit)
+        return 0;
+    unsigned int credit = memoryAvailable() / CREDIT_UNIT;
+    return credit > CREDIT_MAX ? CREDIT_MAX : credit;
+}
+
+/**
+ * @brief This function finds the credit entry of a peer. 
+ * @param address The address of the peer. 
+ * @param create A flag to denote whether an entry is taken for a peer without one, replacing the entry updated longest ago when all are used. 
+ * @return The credit entry, or NULL. 
+ */
+struct peer_credit* creditFind(unsigned char address, unsigned char create)
+{
+    struct peer_credit *oldest = &peerCredits[0];
+    for (unsigned char i = 0; i < CREDIT_PEERS; i++)
+    {
+        if (peerCredits[i].address == address)
+            return &peerCredits[i];
+        if (!peerCredits[i].address)
+            oldest = &peerCredits[i];
+        else if (oldest->address && periodDiffCalculator(peerCredits[i].lastPeriodStamp) > periodDiffCalculator(oldest->lastPeriodStamp))
+            oldest = &peerCredits[i];
+    }
+    if (!create)
+        return NULL;
+    oldest->address = address;
+    return oldest;
+}
+
+/**
+ * A peer that has never advertised credit is not limited. <br>
+ * A peer without credit is still sent one message once msgWaitingPeriod has passed since its last advertisement, so that a lost credit update does not block it forever. 
+ * @brief This function takes one credit of a peer before a message is sent to it. 
+ * @param address The address of the peer. 
+ * @return 1 if the message may be sent, 0 if it has to be held back. 
+ */
+unsigned char creditTake(unsigned char address)
+{
+    struct peer_credit *peer = creditFind(address, 0);
+    if (peer == NULL)
+        return 1;
+    if (peer->credit)
+    {
+        peer->credit--;
+        return 1;
+    }
+    if (periodDiffCalculator(peer->lastPeriodStamp) >= msgWaitingPeriod) // probe
+    {
+        peer->lastPeriodStamp = globalPeriodStamp;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * The advertised credit counts messages after the acknowledged one, so messages to the peer still waiting for ACK are deducted. <br>
+ * Held back messages are released at the next period. 
+ * @brief This function records the credit advertised by a peer in an ACK or credit update. 
+ * @param address The address of the peer. 
+ * @param advertised The third byte of the ACK or credit update. 
+ */
+void creditUpdate(unsigned char address, unsigned char advertised)
+{
+    if (!(advertised & CREDIT_PRESENT))
+        return;
+    unsigned char credit = advertised & ~CREDIT_PRESENT;
+    for (unsigned char i = 0; i < TRANSPORT_MAX_OUTSTANDING && credit; i++)
+        if (inflightInUse(i) && !inflightHeld(i) && inflight.destination[i] == address)
+            credit--;
+    struct peer_credit *peer = creditFind(address, 1);
+    peer->credit = credit;
+    peer->lastPeriodStamp = globalPeriodStamp;
+}
+
+/**
+ * @brief This function remembers a peer to which no credit has been advertised, so that it is told when credit is available again. 
+ * @param address The address of the peer. 
+ * @param credit The credit advertised to the peer. 
+ */
+void creditAdvertised(unsigned char address, unsigned char credit)
+{
+    if (credit)
+        return;
+    for (unsigned char i = 0; i < CREDIT_STARVED; i++)
+        if (starvedPeers[i] == address)
+            return;
+    for (unsigned char i = 0; i < CREDIT_STARVED; i++)
+    {
+        if (!starvedPeers[i])
+        {
+            starvedPeers[i] = address;
+            return;
+        }
+    }
+}
+
+/**
+ * The update is sent as [0][TRANSPORT_FLAG_CREDIT][CREDIT_PRESENT | credit] and is not acknowledged. 
+ * @brief This function sends a credit update to a peer. 
+ * @param address The address of the peer. 
+ * @param credit The credit to advertise. 
+ */
+void sendCredit(unsigned char address, unsigned char credit)
+{
+    unsigned char *payload = memoryMalloc(MEMORY_TRANSPORT, 3);
+    if (payload == NULL)
+        return;
+    payload[0] = 0, payload[1] = TRANSPORT_FLAG_CREDIT, payload[2] = CREDIT_PRESENT | credit;
+    prepareDataSend(address, 3, payload, 1);
+}
+
+/**
+ * Firstly, peers that have been advertised no credit are sent a credit update once credit is available again. <br>
+ * Then held back messages are sent as far as their receivers have credit. 
+ * @brief This function handles credit at every period. 
+ */
+void creditPeriodUpdate()
+{
+    unsigned char credit = creditAvailable();
+    for (unsigned char i = 0; i < CREDIT_STARVED && credit; i++)
+    {
+        if (starvedPeers[i])
+        {
+            sendCredit(starvedPeers[i], credit);
+            starvedPeers[i] = 0;
+        }
+    }
+    for (unsigned char i = 0; i < TRANSPORT_MAX_OUTSTANDING; i++)
+    {
+        if (!inflightInUse(i) || !inflightHeld(i) || !creditTake(inflight.destination[i]))
+            continue;
+        inflight.heldMap[i >> 3] &= ~(1 << (i & 7));
+        inflight.sentPeriodStamp[i] = globalPeriodStamp;
+        transmitMessage(i);
+    }
+}
+
+/**
+ * @brief This function counts the messages held back. 
+ * @param address The address of the receiver, or 0 for all receivers. 
+ * @return The number of held back messages. 
+ */
+unsigned char creditHeld(unsigned char address)
+{
+    unsigned char held = 0;
+    for (unsigned char i = 0; i < TRANSPORT_MAX_OUTSTANDING; i++)
+        if (inflightInUse(i) && inflightHeld(i) && (!address || inflight.destination[i] == address))
+            held++;
+    return held;
+}
+
+/**
+ * @brief This function prints the credit of every known peer, the number of held back messages, and the credit of this device. 
+ */
+void creditPrint()
+{
+    for (unsigned char i = 0; i < CREDIT_PEERS; i++)
+    {
+        if (!peerCredits[i].address)
+            continue;
+        printf("Node %d: credit %d, %d held back\r\n", peerCredits[i].address, peerCredits[i].credit, creditHeld(peerCredits[i].address));
+    }
+    printf("Own credit: %d\r\n", creditAvailable());
+}
@@ -0,0 +1,17 @@
+unsigned char creditAvailable();
+
+struct peer_credit* creditFind(unsigned char address, unsigned char create);
+
+unsigned char creditTake(unsigned char address);
+
+void creditUpdate(unsigned char address, unsigned char advertised);
+
+void creditAdvertised(unsigned char address, unsigned char credit);
+
+void sendCredit(unsigned char address, unsigned char credit);
+
+void creditPeriodUpdate();
+
+unsigned char creditHeld(unsigned char address);
+
+void creditPrint();
@@ -0,0 +1,218 @@
+/**
+ * @file fragment.c
+ * @author David Ng 550084
+ * @brief This component is responsible for splitting messages longer than one packet into fragments and reassembling them on transport layer. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "../hostlink/hostlink.h"
+#include "transport_struct.h"
+#include "inflight.h"
+#include "fragment.h"
+#include "port.h"
+
+extern int ADDRESS;
+extern unsigned int msgWaitingPeriod;
+extern unsigned int globalPeriodStamp;
+extern struct statistics stats;
+extern struct inflight_table inflight;
+
+struct reassembly_buffer reassembly = {NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0}; ///< This is the message being reassembled from received fragments. 
+unsigned char lastCompletedSource = 0; ///< This denotes the sender of the last reassembled message. 0 means that no message has been reassembled. 
+unsigned char lastCompletedId = 0; ///< This denotes the id of the last reassembled message. 
+
+/**
+ * The fragment is sent as [id][TRANSPORT_FLAG_FRAGMENT][index][count][flag of message][part of message]. <br>
+ * Every fragment carries TRANSPORT_FRAGMENT_SIZE bytes of the message except the last one. 
+ * @brief This function sends one fragment of a message in the in-flight table. 
+ * @param slot The slot of the message in the in-flight table. 
+ * @param index The index of the fragment. 
+ * @return 1 if the fragment has been passed to network layer, 0 if there is not enough memory. 
+ */
+unsigned char sendFragment(unsigned char slot, unsigned char index)
+{
+    int offset = index * TRANSPORT_FRAGMENT_SIZE;
+    int chunkLength = inflight.length[slot] - offset;
+    if (chunkLength > TRANSPORT_FRAGMENT_SIZE)
+        chunkLength = TRANSPORT_FRAGMENT_SIZE;
+    unsigned char *payload = memoryMalloc(MEMORY_TRANSPORT, chunkLength + 5);
+    if (payload == NULL) // pushed again at the next period
+        return 0;
+    payload[0] = inflight.id[slot], payload[1] = TRANSPORT_FLAG_FRAGMENT;
+    payload[2] = index, payload[3] = inflight.fragmentCount[slot], payload[4] = inflight.fragmentType[slot];
+    memcpy(payload + 5, inflight.msg[slot] + offset, chunkLength);
+    prepareDataSend(inflight.destination[slot], chunkLength + 5, payload, 0);
+    return 1;
+}
+
+/**
+ * Fragments are pushed one after another without waiting for any ACK, as long as send queue holds fewer than TRANSPORT_FRAGMENT_WINDOW packets. <br>
+ * This function is called whenever a fragmented message is sent and on every period, so that the ring is kept busy without flooding the heap. A fragment is only marked as sent when it could be built, otherwise it is pushed at the next period. 
+ * @brief This function pushes the fragments of a message which have not been sent in the current round. 
+ * @param slot The slot of the message in the in-flight table. 
+ */
+void pumpFragments(unsigned char slot)
+{
+    for (unsigned char i = 0; i < inflight.fragmentCount[slot] && stats.sendQueueDepth < TRANSPORT_FRAGMENT_WINDOW; i++)
+    {
+        if (inflight.fragmentsSent[slot] & (1 << i))
+            continue;
+        if (!sendFragment(slot, i))
+            break;
+        inflight.fragmentsSent[slot] |= 1 << i;
+        inflight.sentPeriodStamp[slot] = globalPeriodStamp;
+    }
+}
+
+/**
+ * The ACK is sent as [id][TRANSPORT_FLAG_FRAGMENT_ACK][bitmap of received fragments][missing flag]. <br>
+ * The missing flag asks the sender to send every fragment which is not in the bitmap again at once. 
+ * @brief This function sends the selective ACK of a fragmented message. 
+ * @param address The address of the message sender. 
+ * @param id The id of the message on transport layer of the sender. 
+ * @param bitmap The bitmap of received fragments. 
+ * @param missing The flag to denote that fragments are missing. 
+ */
+void sendFragmentACK(unsigned char address, unsigned char id, unsigned char bitmap, unsigned char missing)
+{
+    unsigned char *payload = memoryMalloc(MEMORY_TRANSPORT, 4);
+    if (payload == NULL)
+        return;
+    payload[0] = id, payload[1] = TRANSPORT_FLAG_FRAGMENT_ACK, payload[2] = bitmap, payload[3] = missing;
+    prepareDataSend(address, 4, payload, 1);
+}
+
+/**
+ * Only one message is reassembled at a time, in a buffer of fragment count times TRANSPORT_FRAGMENT_SIZE bytes. Fragments of another message are dropped and will be sent again by their sender after time-out. <br>
+ * When all fragments have been received, the reassembled buffer is delivered to the consumer of its port, and the selective ACK is sent back. An inbox takes over the buffer. If the consumer refuses the message, it is kept without ACK, and delivered again when its fragments are sent again. <br>
+ * Fragments of the last reassembled message, which are sent again when the ACK has been lost, are acknowledged again. 
+ * @brief This function processes a received fragment. 
+ * @param srcAddress The sender address of the fragment. 
+ * @param length The length of the transport layer payload. 
+ * @param data The transport layer payload. 
+ */
+void fragmentReceived(unsigned char srcAddress, int length, unsigned char *data)
+{
+    if (length < 6)
+        return;
+    unsigned char index = data[2], count = data[3];
+    int chunkLength = length - 5;
+    if (count == 0 || count > TRANSPORT_MAX_FRAGMENTS || index >= count || chunkLength > TRANSPORT_FRAGMENT_SIZE || (index != count - 1 && chunkLength != TRANSPORT_FRAGMENT_SIZE))
+        return;
+    unsigned char fullMask = (1 << count) - 1;
+    if (reassembly.data == NULL || reassembly.source != srcAddress || reassembly.id != data[0])
+    {
+        if (srcAddress == lastCompletedSource && data[0] == lastCompletedId)
+        {
+            sendFragmentACK(srcAddress, data[0], fullMask, 0);
+            return;
+        }
+        if (reassembly.data != NULL)
+            return;
+        reassembly.data = memoryMalloc(MEMORY_TRANSPORT, count * TRANSPORT_FRAGMENT_SIZE);
+        if (reassembly.data == NULL)
+            return;
+        reassembly.source = srcAddress, reassembly.id = data[0], reassembly.type = data[4];
+        reassembly.count = count, reassembly.received = 0, reassembly.length = 0, reassembly.refused = 0;
+    }
+    if (count != reassembly.count)
+        return;
+    memcpy(reassembly.data + index * TRANSPORT_FRAGMENT_SIZE, data + 5, chunkLength);
+    reassembly.received |= 1 << index;
+    reassembly.lastPeriodStamp = globalPeriodStamp;
+    reassembly.nackSent = 0;
+    if (index == count - 1)
+        reassembly.length = index * TRANSPORT_FRAGMENT_SIZE + chunkLength;
+    if (reassembly.received == fullMask)
+    {
+        struct port_message message = {NULL, reassembly.data, reassembly.length, srcAddress, ADDRESS, reassembly.type};
+        unsigned char result = portDeliver(&message);
+        if (result == PORT_REFUSED)
+        {
+            reassembly.refused = 1;
+            return;
+        }
+        sendFragmentACK(srcAddress, reassembly.id, fullMask, 0);
+        lastCompletedSource = srcAddress, lastCompletedId = reassembly.id;
+        if (result == PORT_DONE)
+            memoryFree(reassembly.data);
+        reassembly.data = NULL;
+    }
+}
+
+/**
+ * The acknowledged fragments are recorded. When all fragments have been acknowledged, the message is removed from the in-flight table. <br>
+ * If the receiver reports missing fragments, they are sent again without waiting for time-out. 
+ * @brief This function processes a received selective ACK of a fragmented message. 
+ * @param srcAddress The sender address of the ACK. 
+ * @param data The transport layer payload. 
+ */
+void fragmentACKReceived(unsigned char srcAddress, unsigned char *data)
+{
+    int slot = inflightFind(data[0]);
+    if (slot < 0 || inflight.flag[slot] != TRANSPORT_FLAG_FRAGMENT || inflight.destination[slot] != srcAddress)
+        return;
+    inflight.fragmentsAcked[slot] |= data[2];
+    if (inflight.fragmentsAcked[slot] == (unsigned char)((1 << inflight.fragmentCount[slot]) - 1))
+    {
+        printf("Node %d received message of %d bytes\r\n", srcAddress, inflight.length[slot]);
+        hostlinkEvent(HOSTLINK_EVENT_ACKED, srcAddress, data[0], NULL, 0);
+        inflightRelease(slot);
+        return;
+    }
+    if (data[3]) // missing fragments are reported
+    {
+        inflight.fragmentsSent[slot] = inflight.fragmentsAcked[slot];
+        statIncrement(retransmits);
+        pumpFragments(slot);
+    }
+}
+
+/**
+ * When no fragment has arrived for half of msgWaitingPeriod, the missing fragments are reported to the sender once. A message refused by its consumer has no missing fragments, and a report of all fragments would be taken as its ACK, so the sender is left to send it again after its time-out. <br>
+ * When no fragment has arrived for 4 times msgWaitingPeriod, the message is given up and the buffer is freed for other messages. 
+ * @brief This function checks whether the message being reassembled has timed out. 
+ */
+void reassemblyTimeoutCheck()
+{
+    if (reassembly.data == NULL)
+        return;
+    unsigned int periodDiff = periodDiffCalculator(reassembly.lastPeriodStamp);
+    if (periodDiff >= (unsigned long)msgWaitingPeriod * 4)
+    {
+        memoryFree(reassembly.data);
+        reassembly.data = NULL;
+    }
+    else if (periodDiff >= msgWaitingPeriod / 2 && !reassembly.nackSent && !reassembly.refused)
+    {
+        sendFragmentACK(reassembly.source, reassembly.id, reassembly.received, 1);
+        reassembly.nackSent = 1;
+    }
+}
@@ -0,0 +1,11 @@
+unsigned char sendFragment(unsigned char slot, unsigned char index);
+
+void pumpFragments(unsigned char slot);
+
+void sendFragmentACK(unsigned char address, unsigned char id, unsigned char bitmap, unsigned char missing);
+
+void fragmentReceived(unsigned char srcAddress, int length, unsigned char *data);
+
+void fragmentACKReceived(unsigned char srcAddress, unsigned char *data);
+
+void reassemblyTimeoutCheck();
@@ -0,0 +1,94 @@
+/**
+ * @file inflight.c
+ * @author David Ng 550084
+ * @brief This component is responsible for the table of sent messages waiting for ACK on transport layer. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "transport_struct.h"
+#include "inflight.h"
+
+struct inflight_table inflight; ///< This is the table of sent messages waiting for ACK. 
+
+/**
+ * All slots are marked free, and the ids start at the slot numbers. 
+ * @brief This function initialises the in-flight table. 
+ */
+void inflightInit()
+{
+    for (int i = 0; i < TRANSPORT_MAX_OUTSTANDING; i++)
+    {
+        inflight.id[i] = i;
+        inflight.msg[i] = NULL;
+        inflight.frame[i] = NULL;
+    }
+    for (int i = 0; i < TRANSPORT_MAX_OUTSTANDING / 8; i++)
+    {
+        inflight.freeMap[i] = 0xFF;
+        inflight.heldMap[i] = 0;
+    }
+}
+
+/**
+ * The first byte of freeMap with a free slot is looked up. Its lowest set bit is isolated, and its index is assembled from 3 mask tests, without looping over bits. <br>
+ * The id of the slot is advanced by TRANSPORT_MAX_OUTSTANDING, so that it differs from the previous message in the slot. 
+ * @brief This function takes a free slot of the in-flight table. 
+ * @return The slot, or -1 if all slots are taken. 
+ */
+int inflightAlloc()
+{
+    for (unsigned char i = 0; i < TRANSPORT_MAX_OUTSTANDING / 8; i++)
+    {
+        unsigned char bits = inflight.freeMap[i];
+        if (!bits)
+            continue;
+        bits &= -bits; // keep the lowest set bit only
+        unsigned char bit = (bits & 0xF0 ? 4 : 0) | (bits & 0xCC ? 2 : 0) | (bits & 0xAA ? 1 : 0);
+        unsigned char slot = i * 8 + bit;
+        inflight.freeMap[i] &= ~(1 << bit);
+        inflight.id[slot] += TRANSPORT_MAX_OUTSTANDING;
+        return slot;
+    }
+    return -1;
+}
+
+/**
+ * The message is left to the caller, so this is only used on its own when a message is refused. 
+ * @brief This function releases a slot of the in-flight table. 
+ * @param slot The slot to release. 
+ */
+void inflightFree(unsigned char slot)
+{
+    inflight.msg[slot] = NULL;
+    inflight.freeMap[slot >> 3] |= 1 << (slot & 7);
+    inflight.heldMap[slot >> 3] &= ~(1 << (slot & 7));
+}
+
+/**
+ * @brief This function finds the slot of a message by its id, e.g. when its ACK is received. 
+ * @param id The id of the message on transport layer. 
+ * @return The slot, or -1 if no message with the id is waiting for ACK. 
+ */
+int inflightFind(unsigned char id)
+{
+    unsigned char slot = id & (TRANSPORT_MAX_OUTSTANDING - 1);
+    if (!inflightInUse(slot) || inflight.id[slot] != id)
+        return -1;
+    return slot;
+}
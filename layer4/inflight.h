@@ -0,0 +1,11 @@
+#define inflightInUse(slot) (!((inflight.freeMap[(slot) >> 3] >> ((slot) & 7)) & 1)) ///< This checks whether a slot of the in-flight table holds a message. 
+
+#define inflightHeld(slot) ((inflight.heldMap[(slot) >> 3] >> ((slot) & 7)) & 1) ///< This checks whether a message of the in-flight table is held back. 
+
+void inflightInit();
+
+int inflightAlloc();
+
+void inflightFree(unsigned char slot);
+
+int inflightFind(unsigned char id);
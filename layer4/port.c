@@ -0,0 +1,186 @@
+/**
+ * @file port.c
+ * @author David Ng 550084
+ * @brief This component is responsible for handing received messages to the applications registered for their port on transport layer 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "transport_struct.h"
+#include "port.h"
+
+extern struct statistics stats;
+
+struct port_entry portEntries[PORT_ENTRIES]; ///< This is the table of registered ports. 
+
+/**
+ * @brief This function looks up the registration of a port. 
+ * @param port The port. 
+ * @return The registration, or NULL if the port is not registered. 
+ */
+struct port_entry* portFind(unsigned char port)
+{
+    for (unsigned char i = 0; i < PORT_ENTRIES; i++)
+    {
+        if (portEntries[i].used && portEntries[i].port == port)
+            return &portEntries[i];
+    }
+    return NULL;
+}
+
+/**
+ * A registration of the same port is replaced, and the messages in its inbox are dropped. 
+ * @brief This function registers a consumer for a port. 
+ * @param port The port, i.e. the flag of the messages, or PORT_ANY. 
+ * @param handler The receive handler, or NULL for an inbox of PORT_INBOX_DEPTH messages. 
+ * @return 1 if the port has been registered, 0 if the table is full. 
+ */
+int portRegister(unsigned char port, port_handler handler)
+{
+    struct port_entry *entry = portFind(port);
+    if (entry != NULL)
+        portUnregister(port);
+    else
+    {
+        for (unsigned char i = 0; i < PORT_ENTRIES && entry == NULL; i++)
+        {
+            if (!portEntries[i].used)
+                entry = &portEntries[i];
+        }
+        if (entry == NULL)
+            return 0;
+    }
+    entry->port = port;
+    entry->handler = handler;
+    entry->head = entry->count = 0;
+    entry->used = 1;
+    return 1;
+}
+
+/**
+ * @brief This function removes the registration of a port and drops the messages in its inbox. 
+ * @param port The port. 
+ */
+void portUnregister(unsigned char port)
+{
+    struct port_entry *entry = portFind(port);
+    if (entry == NULL)
+        return;
+    while (entry->count)
+    {
+        portDone(&entry->inbox[entry->head]);
+        entry->head = (entry->head + 1) & (PORT_INBOX_DEPTH - 1);
+        entry->count--;
+    }
+    entry->used = 0;
+}
+
+/**
+ * The message goes to the registration of its port, or else to the registration of PORT_ANY. Without either, it is discarded. <br>
+ * A handler is invoked at once. Otherwise the message is put into the inbox, which takes a reference to the packet, so that the packet stays valid after receiving has finished, without copying. <br>
+ * A full inbox or a handler that cannot take the message refuses it, which is counted in the statistics. 
+ * @brief This function delivers a received message to the consumer of its port. 
+ * @param message The message. It is copied into the inbox, so it may be a local variable of the caller. 
+ * @return PORT_REFUSED, PORT_DONE or PORT_QUEUED. 
+ */
+unsigned char portDeliver(struct port_message *message)
+{
+    struct port_entry *entry = portFind(message->port);
+    unsigned char result;
+    if (entry == NULL)
+        entry = portFind(PORT_ANY);
+    if (entry == NULL)
+        return PORT_DONE;
+    if (entry->handler != NULL)
+        result = entry->handler(message);
+    else if (entry->count == PORT_INBOX_DEPTH)
+        result = PORT_REFUSED;
+    else
+    {
+        entry->inbox[(entry->head + entry->count) & (PORT_INBOX_DEPTH - 1)] = *message;
+        entry->count++;
+        if (message->node != NULL)
+            dataNodeRetain(message->node);
+        result = PORT_QUEUED;
+    }
+    if (result == PORT_REFUSED)
+        statIncrement(portRefusals);
+    return result;
+}
+
+/**
+ * The message stays valid until it is given back with portDone. 
+ * @brief This function takes the oldest message from the inbox of a port. 
+ * @param port The port. 
+ * @param message The message to write. 
+ * @return 1 if a message has been taken, 0 if the inbox is empty or the port has no inbox. 
+ */
+int portReceive(unsigned char port, struct port_message *message)
+{
+    struct port_entry *entry = portFind(port);
+    if (entry == NULL || entry->handler != NULL || !entry->count)
+        return 0;
+    *message = entry->inbox[entry->head];
+    entry->head = (entry->head + 1) & (PORT_INBOX_DEPTH - 1);
+    entry->count--;
+    return 1;
+}
+
+/**
+ * @brief This function gives back a message taken from an inbox. Its packet is released, or its buffer freed if it has no packet. 
+ * @param message The message. 
+ */
+void portDone(struct port_message *message)
+{
+    if (message->node != NULL)
+        dataNodeRelease(message->node);
+    else
+        memoryFree(message->data);
+}
+
+/**
+ * @brief This function prints the registered ports and the messages waiting in their inboxes. 
+ */
+void portPrint()
+{
+    for (unsigned char i = 0; i < PORT_ENTRIES; i++)
+    {
+        struct port_entry *entry = &portEntries[i];
+        if (!entry->used)
+            continue;
+        if (entry->port == PORT_ANY)
+            printf("Port any: ");
+        else
+            printf("Port %u: ", entry->port);
+        if (entry->handler != NULL)
+            printf("handler\r\n");
+        else
+            printf("inbox %u of %u\r\n", entry->count, PORT_INBOX_DEPTH);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef PORT_ENTRIES
+#define PORT_ENTRIES 4 ///< This denotes how many ports can be registered at the same time, including the console consumer. 
+#endif
+#ifndef PORT_INBOX_DEPTH
+#define PORT_INBOX_DEPTH 4 ///< This denotes how many messages an inbox holds. It must be a power of 2. 
+#endif
+
+#define PORT_ANY 0xFF ///< This port receives the messages of all ports without a registration of their own. The console consumer is registered for it at startup. 
+
+#define PORT_REFUSED 0 ///< This is returned when the consumer cannot take the message, so that a message that needs ACK is not acknowledged and is sent again after time-out. 
+#define PORT_DONE 1 ///< This is returned when the message has been consumed during delivery, and its data is left to the caller. 
+#define PORT_QUEUED 2 ///< This is returned when the message has been put into an inbox, which has taken a reference to its packet, or taken over its buffer if there is no packet. 
+
+//! This structure is a message delivered to a port. 
+/**
+ * data points into the payload of the received packet, behind addresses, id and flag, so nothing is copied. <br>
+ * A message reassembled from fragments has no packet. Its data is then a buffer of its own, which is freed by portDone. 
+*/
+struct port_message
+{
+    struct data_node *node; ///< This is the received packet holding the message, or NULL if the message has been reassembled. 
+    unsigned char *data; ///< This is the message. 
+    int length; ///< This denotes the length of the message in bytes. 
+    unsigned char source; ///< This denotes the address of the message sender. 
+    unsigned char destination; ///< This denotes the address the message has been sent to: this device, 0 for broadcast, or a multicast group. 
+    unsigned char port; ///< This is the flag of the message on transport layer, by which it is delivered. 
+};
+
+typedef unsigned char (*port_handler)(struct port_message *message); ///< This is a receive handler. It returns PORT_DONE or PORT_REFUSED, and must not keep the message after returning. 
+
+//! This structure is the registration of a port. 
+/**
+ * A port is either consumed by a handler, which is invoked at delivery, or by an inbox, from which the application takes messages with portReceive when it is ready. 
+*/
+struct port_entry
+{
+    port_handler handler; ///< This is the receive handler, or NULL if the port has an inbox. 
+    struct port_message inbox[PORT_INBOX_DEPTH]; ///< This is the ring of messages waiting in the inbox. 
+    unsigned char port; ///< This is the registered port. 
+    unsigned char used; ///< This flag denotes that the entry holds a registration. 
+    unsigned char head; ///< This is the index of the oldest message in the inbox. 
+    unsigned char count; ///< This denotes how many messages are in the inbox. 
+};
+
+int portRegister(unsigned char port, port_handler handler);
+
+void portUnregister(unsigned char port);
+
+struct port_entry* portFind(unsigned char port);
+
+unsigned char portDeliver(struct port_message *message);
+
+int portReceive(unsigned char port, struct port_message *message);
+
+void portDone(struct port_message *message);
+
+void portPrint();
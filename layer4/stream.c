@@ -0,0 +1,281 @@
+/**
+ * @file stream.c
+ * @author David Ng 550084
+ * @brief This component is responsible for stream transfers, which send data from UART to another node with constant memory. 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "../hostlink/hostlink.h"
+#include "transport_struct.h"
+#include "inflight.h"
+#include "stream.h"
+
+extern int operatingMode;
+extern unsigned char uartTextOutput;
+extern unsigned int msgWaitingPeriod;
+extern unsigned int globalPeriodStamp;
+extern struct statistics stats;
+extern struct inflight_table inflight;
+
+unsigned char streamBuffer[STREAM_CHUNK + STREAM_SLACK]; ///< This is the buffer of stream bytes received from UART but not sent yet. 
+int streamFill = 0; ///< This denotes the number of bytes in streamBuffer. 
+unsigned long streamRemaining = 0; ///< This denotes how many bytes of the stream are still expected from UART. 
+unsigned long streamLength = 0; ///< This denotes the length of the stream being sent. 
+unsigned char streamDestination = 0; ///< This denotes the receiver of the stream being sent. 
+unsigned char streamNumber = 0; ///< This is the number of the stream being sent, which tells streams of this device apart. 
+unsigned char streamSequence = 0; ///< This is the sequence number of the next packet of the stream being sent. 
+unsigned char streamInFlight = 0; ///< This denotes how many packets of the stream are waiting for ACK. 
+unsigned char streamSending = 0; ///< This flag denotes that a stream is being sent. 
+unsigned char streamPaused = 0; ///< This flag denotes that XOFF has been sent to the host. 
+unsigned int streamOverruns = 0; ///< This denotes how many bytes have been dropped because the host has not stopped after XOFF. 
+
+unsigned char streamSource = 0; ///< This denotes the sender of the stream being received. 0 means that no stream has been received. 
+unsigned char streamReceiveNumber = 0; ///< This is the number of the stream being received. 
+unsigned char streamExpected = 0; ///< This is the sequence number of the next packet expected from the stream being received. 
+unsigned char streamReceiving = 0; ///< This flag denotes that a stream is being received. 
+unsigned int streamLastPeriodStamp = 0; ///< This is the period stamp during which the last packet of the received stream has arrived. 
+
+/**
+ * After this function, every byte received from UART belongs to the stream until the given length has been received. 
+ * @brief This function starts sending a stream to another node. 
+ * @param address The address of the stream receiver. 
+ * @param length The number of bytes that the host is going to send. 
+ */
+void streamStart(int address, unsigned long length)
+{
+    if (streamSending || operatingMode == MODE_STREAM)
+    {
+        printf("A stream is being sent\r\n");
+        return;
+    }
+    if (address <= 0 || address > 255 || length == 0)
+    {
+        printf("Usage: /stream <address> <bytes>\r\n");
+        return;
+    }
+    streamDestination = address;
+    streamLength = streamRemaining = length;
+    streamFill = streamSequence = streamInFlight = streamPaused = 0;
+    streamOverruns = 0;
+    streamNumber++;
+    streamSending = 1;
+    operatingMode = MODE_STREAM;
+    printf("Streaming %lu bytes to %d\r\n", length, address);
+}
+
+/**
+ * Bytes beyond the space of streamBuffer are dropped and counted, which only happens when the host ignores XOFF. <br>
+ * When the last byte of the stream has been received, UART input is processed by the console again. 
+ * @brief This function processes a byte of the stream received from UART. 
+ * @param byte The byte received from UART. 
+ */
+void streamReceiveByte(unsigned char byte)
+{
+    if (!streamSending) // stream has failed, the rest is discarded
+        ;
+    else if (streamFill < STREAM_CHUNK + STREAM_SLACK)
+        streamBuffer[streamFill++] = byte;
+    else
+        streamOverruns++;
+    if (--streamRemaining == 0)
+        operatingMode = MODE_CONSOLE;
+    streamPump();
+}
+
+/**
+ * A packet is sent whenever a full chunk is buffered, or the last bytes of the stream, and fewer than STREAM_WINDOW packets are waiting for ACK. <br>
+ * When a full chunk cannot be sent, XOFF is sent to the host, and XON once there is space for another chunk. <br>
+ * Since a packet is only acknowledged after its data has been written out at the receiver, this limits the host to the pace of the whole path. 
+ * @brief This function sends buffered stream bytes as far as the window allows and controls the flow of the host. 
+ */
+void streamPump()
+{
+    while (streamSending && streamInFlight < STREAM_WINDOW && (streamFill >= STREAM_CHUNK || (streamRemaining == 0 && streamFill > 0)))
+    {
+        if (!streamSendChunk(streamFill < STREAM_CHUNK ? streamFill : STREAM_CHUNK)) // retried on next call
+            break;
+    }
+    if (!streamPaused && streamFill >= STREAM_CHUNK && streamRemaining)
+    {
+        uart_write(STREAM_XOFF);
+        streamPaused = 1;
+    }
+    else if (streamPaused && (streamFill < STREAM_CHUNK || !streamSending))
+    {
+        uart_write(STREAM_XON);
+        streamPaused = 0;
+    }
+    if (streamSending && streamRemaining == 0 && streamFill == 0 && streamInFlight == 0)
+    {
+        streamSending = 0;
+        printf("Stream of %lu bytes sent, %u bytes dropped\r\n", streamLength, streamOverruns);
+    }
+}
+
+/**
+ * The packet is sent as [id][TRANSPORT_FLAG_STREAM][stream number][sequence number][last flag][data]. <br>
+ * It is kept in the in-flight table until ACK, so that it can be sent again after time-out. 
+ * @brief This function sends the first bytes of streamBuffer as a packet of the stream. 
+ * @param length The number of bytes to send. 
+ * @return 1 if the packet has been sent, 0 if there is not enough memory or the in-flight table is full. 
+ */
+unsigned char streamSendChunk(int length)
+{
+    unsigned char *payload = memoryMalloc(MEMORY_TRANSPORT, length + 5);
+    if (payload == NULL)
+        return 0;
+    int slot = constructTransportNode(TRANSPORT_FLAG_STREAM, payload, streamDestination, length + 5);
+    if (slot < 0)
+    {
+        memoryFree(payload);
+        return 0;
+    }
+    payload[0] = inflight.id[slot], payload[1] = TRANSPORT_FLAG_STREAM;
+    payload[2] = streamNumber, payload[3] = streamSequence++;
+    payload[4] = streamRemaining == 0 && streamFill == length;
+    memcpy(payload + 5, streamBuffer, length);
+    streamFill -= length;
+    memmove(streamBuffer, streamBuffer + length, streamFill);
+    streamInFlight++;
+    streamResend(slot);
+    return 1;
+}
+
+/**
+ * At the first transmission, the packet of the stream is built and kept in the in-flight table, as transmitMessage does. After time-out, it is queued again as it is. 
+ * @brief This function sends a packet of the stream, for the first time or after time-out. 
+ * @param slot The slot of the packet in the in-flight table. 
+ */
+void streamResend(unsigned char slot)
+{
+    if (inflight.frame[slot] == NULL)
+    {
+        struct data_node *frame = prepareDataFrame(inflight.destination[slot], inflight.length[slot], inflight.msg[slot]);
+        if (frame == NULL) // sent again after time-out
+            return;
+        memoryFree(inflight.msg[slot]);
+        inflight.msg[slot] = frame->payload + 2; // behind addresses
+        inflight.frame[slot] = frame;
+    }
+    requeueDataNode(inflight.frame[slot]);
+}
+
+/**
+ * @brief This function is triggered when a packet of the stream has been acknowledged. 
+ */
+void streamAcked()
+{
+    if (streamInFlight)
+        streamInFlight--;
+    streamPump();
+}
+
+/**
+ * All packets of the stream waiting for ACK are removed from the in-flight table. The remaining bytes from the host are discarded. 
+ * @brief This function gives up the stream being sent, when its receiver does not exist. 
+ */
+void streamAbort()
+{
+    if (!streamSending)
+        return;
+    for (unsigned char i = 0; i < TRANSPORT_MAX_OUTSTANDING; i++)
+    {
+        if (inflightInUse(i) && inflight.flag[i] == TRANSPORT_FLAG_STREAM)
+        {
+            inflightRelease(i);
+        }
+    }
+    streamSending = streamInFlight = 0;
+    streamFill = 0;
+    printf("Stream failed: %d does not exist\r\n", streamDestination);
+    streamPump();
+}
+
+/**
+ * Packets are accepted strictly in order: the expected packet is written out of UART at once, or sent to the host as event in binary operating mode, and acknowledged. <br>
+ * Packets received before are acknowledged again, as their ACK may have been lost. Packets ahead of the expected one are dropped and will be sent again by the sender. <br>
+ * A new stream is accepted when no stream is being received, or the stream being received has been silent for 4 times msgWaitingPeriod. <br>
+ * Outside binary operating mode, text output of printf is disabled from the first packet until the stream ends, so that console and debug output does not get mixed into the data. 
+ * @brief This function processes a received packet of a stream. 
+ * @param srcAddress The sender address of the packet. 
+ * @param length The length of the transport layer payload. 
+ * @param data The transport layer payload. 
+ */
+void streamReceived(unsigned char srcAddress, int length, unsigned char *data)
+{
+    if (length < 5)
+        return;
+    unsigned char sameStream = srcAddress == streamSource && data[2] == streamReceiveNumber;
+    if (!sameStream)
+    {
+        if (data[3] != 0 || (streamReceiving && periodDiffCalculator(streamLastPeriodStamp) < (unsigned long)msgWaitingPeriod * 4))
+            return;
+        streamSource = srcAddress, streamReceiveNumber = data[2];
+        streamExpected = 0;
+        streamReceiving = 1;
+        if (operatingMode != MODE_BINARY) // the data is written out of UART as it is
+            uartTextOutput = 0;
+    }
+    unsigned char behind = streamExpected - data[3];
+    if (behind == 0 && streamReceiving)
+    {
+        if (operatingMode == MODE_BINARY)
+            hostlinkEvent(HOSTLINK_EVENT_RECEIVED, srcAddress, TRANSPORT_FLAG_STREAM, data + 5, length - 5);
+        else
+            for (int i = 5; i < length; i++)
+                uart_write(data[i]);
+        streamExpected++;
+        streamLastPeriodStamp = globalPeriodStamp;
+        if (data[4]) // last packet of the stream
+            streamReceiveEnd();
+        sendACK(srcAddress, data[0]);
+    }
+    else if (behind != 0 && behind <= STREAM_WINDOW)
+        sendACK(srcAddress, data[0]);
+}
+
+/**
+ * @brief This function ends the stream being received, and enables text output of printf again outside binary operating mode. 
+ */
+void streamReceiveEnd()
+{
+    streamReceiving = 0;
+    if (operatingMode != MODE_BINARY)
+        uartTextOutput = 1;
+}
+
+/**
+ * @brief This function ends the stream being received when it has been silent for 4 times msgWaitingPeriod, e.g. because its sender has been reset. It is invoked once per period from the main loop. 
+ */
+void streamReceiveTimeoutCheck()
+{
+    if (streamReceiving && periodDiffCalculator(streamLastPeriodStamp) >= (unsigned long)msgWaitingPeriod * 4)
+        streamReceiveEnd();
+}
@@ -0,0 +1,25 @@
+#define STREAM_CHUNK 64 ///< This denotes how many bytes of stream each packet carries. 
+#define STREAM_SLACK 16 ///< This denotes how many bytes the host may still send after XOFF. 
+#define STREAM_WINDOW 2 ///< This denotes how many stream packets may wait for ACK at the same time. 
+#define STREAM_XON 0x11 ///< This is the byte sent to the host to resume a stream. 
+#define STREAM_XOFF 0x13 ///< This is the byte sent to the host to pause a stream. 
+
+void streamStart(int address, unsigned long length);
+
+void streamReceiveByte(unsigned char byte);
+
+void streamPump();
+
+unsigned char streamSendChunk(int length);
+
+void streamResend(unsigned char slot);
+
+void streamAcked();
+
+void streamAbort();
+
+void streamReceived(unsigned char srcAddress, int length, unsigned char *data);
+
+void streamReceiveEnd();
+
+void streamReceiveTimeoutCheck();
@@ -31,24 +31,53 @@
 #include "../layer2/data_link.h"
 #include "../irq/interrupt_handler.h"
 #include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "../hostlink/hostlink.h"
 #include "transport_struct.h"
+#include "inflight.h"
+#include "fragment.h"
+#include "credit.h"
+#include "port.h"
+#include "stream.h"
+#include "../layer2/rate_limit.h"
+#include "../traffic/traffic.h"
 
-extern const int ADDRESS;
+extern int ADDRESS;
 extern unsigned int msgWaitingPeriod;
 extern unsigned int globalPeriodStamp;
+extern struct statistics stats;
+extern uint16_t multicastGroups;
+extern struct inflight_table inflight;
 
-struct transport_node **sentMessagesCache = NULL; ///< An array of transport_node to store all sent messages that are pending for respective ACK messages
-int nextAvailableSlot;
+unsigned char unacknowledgedId = 0; ///< This is the id of the next message that does not wait for ACK, i.e. datagram, broadcast or multicast. 
 
 /**
- * @brief This is to initialise the array that stores sent messages. 
+ * The console consumer is registered for PORT_ANY, so that messages are printed unless an application has registered their port. 
+ * @brief This is to initialise the table that stores sent messages and the port registrations. 
  */
 void transportCacheArrayInit()
 {
-    sentMessagesCache = malloc(sizeof(struct transport_node*) * 256);
-    nextAvailableSlot = 0;
-    for (int i = 0; i < 256; i++)
-        sentMessagesCache[i] = NULL;
+    inflightInit();
+    portRegister(PORT_ANY, transportConsoleHandler);
+}
+
+/**
+ * Messages sent to this device, to a multicast group and broadcast messages are printed differently, or sent to the host as event in binary operating mode. 
+ * @brief This function is the receive handler of the console, which consumes the messages of all ports without a registration of their own. 
+ * @param message The received message. 
+ * @return PORT_DONE, as the message is printed at once. 
+ */
+unsigned char transportConsoleHandler(struct port_message *message)
+{
+    if (isMulticast(message->destination))
+        printf("Received group %d message: %.*s\r\n", message->destination - MULTICAST_FIRST, message->length, message->data);
+    else if (message->destination == 0)
+        printf("Received broadcast message: %.*s\r\n", message->length, message->data);
+    else
+        printf("From %d received message: %.*s\r\n", message->source, message->length, message->data);
+    hostlinkEvent(HOSTLINK_EVENT_RECEIVED, message->source, message->port, message->data, message->length);
+    return PORT_DONE;
 }
 
 /**
@@ -80,160 +109,329 @@ unsigned int periodDiffCalculator(unsigned int comparator)
 }
 
 /**
- * This function calculates the difference between the sentPeriodStamp in each transport_node and globalPeriodStamp. <br>
- * Then if the type of message in transport_node is not 2, and the calculated difference exceeds the threshold, which denotes time-out, the message is sent again.
+ * This function calculates the difference between the sentPeriodStamp of each message in the in-flight table and globalPeriodStamp. <br>
+ * Then if the calculated difference exceeds the threshold, which denotes time-out, the message is sent again. <br>
+ * Fragmented messages push their next fragments on every period. On time-out, only the fragments which have not been acknowledged are sent again. <br>
+ * Messages held back for lack of credit are not timed out, they are released by creditPeriodUpdate. <br>
+ * Every time-out is taken as congestion by rateCongestion. 
  * @brief This function checks whether a sent message becomes timed out.
  */
 void periodClockUpdate()
 {
-    for (int i = 0; i < 256; i++)
+    for (unsigned char i = 0; i < TRANSPORT_MAX_OUTSTANDING; i++)
     {
-        if (sentMessagesCache[i] == NULL)
+        if (!inflightInUse(i) || inflightHeld(i))
             continue;
-        unsigned int periodDiff = periodDiffCalculator(sentMessagesCache[i]->sentPeriodStamp);
-        if (periodDiff >= msgWaitingPeriod)
+        unsigned int periodDiff = periodDiffCalculator(inflight.sentPeriodStamp[i]);
+        if (inflight.flag[i] == TRANSPORT_FLAG_FRAGMENT)
         {
-            if (sentMessagesCache[i]->flag != 2)
+            if (periodDiff >= msgWaitingPeriod)
             {
-			    prepareDataSend(sentMessagesCache[i]->destination, sentMessagesCache[i]->length, sentMessagesCache[i]->msg);
-                sentMessagesCache[i]->sentPeriodStamp = globalPeriodStamp;
+                inflight.fragmentsSent[i] = inflight.fragmentsAcked[i];
+                statIncrement(retransmits);
+                rateCongestion();
             }
+            pumpFragments(i);
+            continue;
+        }
+        if (periodDiff >= msgWaitingPeriod)
+        {
+            if (inflight.flag[i] == TRANSPORT_FLAG_STREAM)
+                streamResend(i);
             else
-            {
-                free(sentMessagesCache[i]);
-                sentMessagesCache[i] = NULL;
-            }
-            
+                transmitMessage(i);
+            inflight.sentPeriodStamp[i] = globalPeriodStamp;
+            statIncrement(retransmits);
+            rateCongestion();
         }
     }
+    reassemblyTimeoutCheck();
+    creditPeriodUpdate();
 }
 
 /**
- * @brief This function constructs a node of TransportNode. 
+ * @brief This function stores a sent message in the in-flight table until it is acknowledged. 
  * @param type Flags of the transport layer message as prescripted in specification. 
  * @param data The payload data to send. 
  * @param target The intended receiver of this message. 
  * @param length The length of the message. 
+ * @return The slot of the message, or -1 if the table is full. 
  * */
-struct transport_node* constructTransportNode(unsigned char type, unsigned char *data, unsigned char target, int length)
+int constructTransportNode(unsigned char type, unsigned char *data, unsigned char target, int length)
 {
-    struct transport_node *result = malloc(sizeof(struct transport_node));
-    result->sentPeriodStamp = globalPeriodStamp;
-    result->flag = type;
-    result->msg = data;
-    result->destination = target;
-    result->length = length;
-    return result;
+    int slot = inflightAlloc();
+    if (slot < 0)
+        return -1;
+    inflight.sentPeriodStamp[slot] = globalPeriodStamp;
+    inflight.flag[slot] = type;
+    inflight.msg[slot] = data;
+    inflight.destination[slot] = target;
+    inflight.length[slot] = length;
+    inflight.fragmentType[slot] = inflight.fragmentCount[slot] = inflight.fragmentsAcked[slot] = inflight.fragmentsSent[slot] = 0;
+    return slot;
 }
 
 /**
- * @brief This function updates the index number for array sentMessageCache, which will be used when another message is sent in the future. 
+ * If the packet of the message has been built, the message is part of its payload, and the reference of the table is released. The packet is then freed as soon as it is no longer queued. 
+ * @brief This function frees the message of a slot and releases the slot, when the message has been acknowledged or given up. 
+ * @param slot The slot to release. 
  */
-void updateCacheArrIndex()
+void inflightRelease(unsigned char slot)
 {
-    int oldValue = nextAvailableSlot;
-    while (sentMessagesCache[nextAvailableSlot] != NULL)
+    if (inflight.frame[slot] != NULL)
     {
-        nextAvailableSlot++;
-        if (nextAvailableSlot == 256)
-            nextAvailableSlot = 0;
-        if (oldValue == nextAvailableSlot)
-            ; // error
+        dataNodeRelease(inflight.frame[slot]);
+        inflight.frame[slot] = NULL;
     }
+    else
+        memoryFree(inflight.msg[slot]);
+    inflightFree(slot);
 }
 
 /**
+ * A message longer than TRANSPORT_MAX_SEGMENT is split into fragments with flag TRANSPORT_FLAG_FRAGMENT, which carry the given flag. Such a message must not be broadcast or datagram, and is kept in the in-flight table until all fragments are acknowledged. <br>
+ * A message that needs ACK is held back in the in-flight table while its receiver has no credit, up to CREDIT_HOLD_LIMIT messages. A fragmented message is refused instead. <br>
+ * When the message is accepted, the data is owned by transport layer and freed when it is no longer needed. When it is refused, the data is left to the caller. 
  * @brief This function is triggered when a new message is sent. 
  * @param address The address of the message receiver. 
  * @param type The flag of the payload as required in specification. 
  * @param data The payload data to send. 
  * @param length The length of the payload data. 
+ * @return The id of the message on transport layer, or one of the TRANSPORT_ERROR definitions. 
  */
-void initiateSend(int address, unsigned char type, unsigned char *data, int length)
+int initiateSend(int address, unsigned char type, unsigned char *data, int length)
 {
-	if (type != 2 && address)
-	    sentMessagesCache[nextAvailableSlot] = constructTransportNode(type, data, address, length);
+    if (length > TRANSPORT_MAX_SEGMENT)
+    {
+        if (transportIsDatagram(type) || !address || isMulticast(address) || length > TRANSPORT_MAX_MESSAGE)
+            return TRANSPORT_ERROR_TOO_LONG;
+        int slot = constructTransportNode(TRANSPORT_FLAG_FRAGMENT, data, address, length);
+        if (slot < 0)
+            return TRANSPORT_ERROR_TABLE_FULL;
+        if (!creditTake(address))
+        {
+            inflightFree(slot);
+            return TRANSPORT_ERROR_NO_CREDIT;
+        }
+        inflight.fragmentType[slot] = type;
+        inflight.fragmentCount[slot] = (length + TRANSPORT_FRAGMENT_SIZE - 1) / TRANSPORT_FRAGMENT_SIZE;
+        pumpFragments(slot);
+        return inflight.id[slot];
+    }
+	if (!transportIsDatagram(type) && address && !isMulticast(address))
+    {
+        int slot = constructTransportNode(type, data, address, length);
+        if (slot < 0)
+            return TRANSPORT_ERROR_TABLE_FULL;
+        if (!creditTake(address))
+        {
+            if (creditHeld(0) >= CREDIT_HOLD_LIMIT)
+            {
+                inflightFree(slot);
+                return TRANSPORT_ERROR_NO_CREDIT;
+            }
+            inflight.heldMap[slot >> 3] |= 1 << (slot & 7);
+            return inflight.id[slot];
+        }
+        transmitMessage(slot);
+        return inflight.id[slot];
+    }
+    unsigned char id = unacknowledgedId++;
     int newLength = length + 2;
-    unsigned char *payload = malloc(newLength);
-    payload[0] = nextAvailableSlot;
+    unsigned char *payload = memoryMalloc(MEMORY_TRANSPORT, newLength);
+    if (payload == NULL)
+        return TRANSPORT_ERROR_NO_MEMORY;
+    payload[0] = id;
     payload[1] = type;
 	for (int i = 0; i < length; i++)
 		payload[i + 2] = data[i];
-    updateCacheArrIndex(); // This function is called anyway because the id number is used in the message even when the message is not saved
-    prepareDataSend(address, newLength, payload);
+    memoryFree(data); // not needed, as the message is not sent again
+    prepareDataSend(address, newLength, payload, 0);
+    return id;
 }
 
 /**
- * @brief This function sends an ACK message without registering the message in sentMessageCache. 
+ * At the first transmission, the message is copied behind its id and flag and built into a packet, which is kept in the in-flight table until ACK. The message itself is freed, as it is part of the payload of the packet from then on. <br>
+ * After time-out, the kept packet is queued again as it is, without building its header and CRC again. 
+ * @brief This function sends a message of the in-flight table, for the first time or after time-out. 
+ * @param slot The slot of the message in the in-flight table. 
+ */
+void transmitMessage(unsigned char slot)
+{
+    if (inflight.frame[slot] == NULL)
+    {
+        unsigned char *payload = memoryMalloc(MEMORY_TRANSPORT, inflight.length[slot] + 2);
+        if (payload == NULL) // sent again after time-out
+            return;
+        payload[0] = inflight.id[slot];
+        payload[1] = inflight.flag[slot];
+        memcpy(payload + 2, inflight.msg[slot], inflight.length[slot]);
+        struct data_node *frame = prepareDataFrame(inflight.destination[slot], inflight.length[slot] + 2, payload);
+        memoryFree(payload);
+        if (frame == NULL) // sent again after time-out
+            return;
+        memoryFree(inflight.msg[slot]);
+        inflight.msg[slot] = frame->payload + 4; // behind addresses, id and flag
+        inflight.frame[slot] = frame;
+    }
+    requeueDataNode(inflight.frame[slot]);
+}
+
+/**
+ * The third byte of the ACK advertises the credit of this device with CREDIT_PRESENT set. If there is no credit, the sender is told by a credit update once there is. <br>
+ * If memory cannot be allocated, no ACK is sent, and the sender sends the message again after time-out. 
+ * @brief This function sends an ACK message without registering the message in the in-flight table. 
  */
 void sendACK(int address, unsigned char id)
 {
-	char *payload = malloc(3);
-	payload[0] = id, payload[1] = 1, payload[2] = 0;
-	prepareDataSend(address, 3, payload);
+	unsigned char *payload = memoryMalloc(MEMORY_TRANSPORT, 3);
+    if (payload == NULL)
+        return;
+    unsigned char credit = creditAvailable();
+	payload[0] = id, payload[1] = 1, payload[2] = CREDIT_PRESENT | credit;
+    creditAdvertised(address, credit);
+	prepareDataSend(address, 3, payload, 1);
 }
 
 /**
  * If the flag of newly received message is 1 (which denotes ACK), it means that the sender has received a previously sent message successfully. <br>
- * Then the corresponding instance of transport_node in sentMessageCache is removed. <br>
- * If the flag of newly received message is 2 (which denotes datagram), the received message is printed and discarded. <br>
- * If other types of message are received, the message is printed and an ACK message will be sent back to the sender.
+ * Then the corresponding message in the in-flight table is removed, and the credit advertised in the ACK is recorded, as is the credit in a credit update. <br>
+ * Fragments and their selective ACKs are handed over to fragment.c, packets of streams to stream.c, and benchmark messages are counted by traffic.c without printing. <br>
+ * Other messages, including datagrams with flag 2, broadcast and multicast messages, are delivered by portDeliver to the consumer registered for their flag as port, which is the console unless an application has registered it. <br>
+ * A message that needs ACK is only acknowledged when its consumer has taken it. If its inbox is full, it is not acknowledged, so that its sender sends it again after time-out. 
  * @brief This function is triggered to process message received from other node.
  * @param srcAddress The sender address of the data packet that is being processed.
  * @param targetAddress The receiver of the data packet that is being processed.
  * @param length The length of the payload data.
  * @param data The payload data.
+ * @param node The received packet that holds the payload, to which an inbox takes a reference. 
  */
-void transportProcessing(unsigned char srcAddress, unsigned char targetAddress, int length, unsigned char *data)
+void transportProcessing(unsigned char srcAddress, unsigned char targetAddress, int length, unsigned char *data, struct data_node *node)
 {
+    struct port_message message = {node, data + 2, length - 2, srcAddress, targetAddress, data[1]};
     if (targetAddress == ADDRESS)
     {
         switch (data[1])
         {
             case 1:
-                printf("Node %d received message: %s\r\n", srcAddress, sentMessagesCache[data[0]]->msg);
-                free(sentMessagesCache[data[0]]);
-                sentMessagesCache[data[0]] = NULL;
+            {
+                statIncrement(acksReceived);
+                int slot = inflightFind(data[0]); // -1 for ACK of a message already acknowledged
+                if (slot >= 0 && inflight.flag[slot] == TRANSPORT_FLAG_STREAM)
+                {
+                    inflightRelease(slot);
+                    streamAcked();
+                }
+                else if (slot >= 0 && inflight.flag[slot] == TRANSPORT_FLAG_BENCH)
+                {
+                    trafficDelivered(inflight.msg[slot]);
+                    inflightRelease(slot);
+                }
+                else if (slot >= 0)
+                {
+                    printf("Node %d received message: %.*s\r\n", srcAddress, inflight.length[slot], inflight.msg[slot]);
+                    hostlinkEvent(HOSTLINK_EVENT_ACKED, srcAddress, data[0], NULL, 0);
+                    inflightRelease(slot);
+                }
+                if (length >= 3)
+                    creditUpdate(srcAddress, data[2]);
+            }
+            break;
+            case TRANSPORT_FLAG_CREDIT:
+                if (length >= 3)
+                    creditUpdate(srcAddress, data[2]);
+            break;
+            case TRANSPORT_FLAG_FRAGMENT:
+                fragmentReceived(srcAddress, length, data);
+            break;
+            case TRANSPORT_FLAG_STREAM:
+                streamReceived(srcAddress, length, data);
+            break;
+            case TRANSPORT_FLAG_FRAGMENT_ACK:
+                if (length >= 4)
+                    fragmentACKReceived(srcAddress, data);
+            break;
+            case TRANSPORT_FLAG_BENCH:
+                // acknowledged, then counted like a benchmark datagram
+                sendACK(srcAddress, data[0]);
+                /* fall through */
+            case TRANSPORT_FLAG_BENCH_DATAGRAM:
+                trafficReceived(length - 2);
             break;
             case 0xfc: // future use
             default:
-				;
-				sendACK(srcAddress, data[0]);
+				if (portDeliver(&message) != PORT_REFUSED)
+				    sendACK(srcAddress, data[0]);
+            break;
             case 2:
-                printf("From %d received message: %s\r\n", srcAddress, data+2);
+                portDeliver(&message);
             break;
         }
     }
-    else if (srcAddress == 0)
-    {
-        printf("Received broadcast message: %s\r\n", data);
-    }
-    else
-        ; // error
+    else if (data[1] == TRANSPORT_FLAG_BENCH_DATAGRAM) // broadcast or multicast benchmark
+        trafficReceived(length - 2);
+    else if (isMulticast(targetAddress) || targetAddress == 0)
+        portDeliver(&message);
+    // else error
     
     
 }
 
 /**
+ * A benchmark message sent to the own address is returned by design, thus it is delivered in loopback. 
  * @brief This function is to notify user whenever a sent non-broadcast message is returned. 
  * @param payload The payload data which has not been sent successfully. 
  * @param dest The false destination of the message. 
  */
 void notifyFailSend(char *payload, char dest)
 {
-    free(sentMessagesCache[payload[0]]);
-    sentMessagesCache[payload[0]] = NULL;
+    if (payload[1] == (char)TRANSPORT_FLAG_STREAM)
+    {
+        streamAbort();
+        return;
+    }
+    if (transportNeedsAck((unsigned char)payload[1])) // ACK and credit updates carry the id of a message of another device
+    {
+        int slot = inflightFind(payload[0]);
+        if (slot >= 0 && inflight.destination[slot] == (unsigned char)dest && inflight.flag[slot] == (unsigned char)payload[1])
+            inflightRelease(slot);
+    }
+    if (payload[1] == (char)TRANSPORT_FLAG_BENCH || payload[1] == (char)TRANSPORT_FLAG_BENCH_DATAGRAM)
+    {
+        if (dest == (char)ADDRESS) // loopback, the message has passed the line
+        {
+            trafficDelivered((unsigned char*)payload + 2);
+            return;
+        }
+        trafficFailed();
+    }
+    statIncrement(failedSends);
     printf("Send failed: %d does not exist\r\n", dest);
+    hostlinkEvent(HOSTLINK_EVENT_FAILED, dest, payload[0], NULL, 0);
 }
 
 /**
- * @brief This function is triggered when a broadcast is successful. 
+ * A multicast message has passed every node of the ring when it is returned, thus it has been delivered to all members of its group. A benchmark message is recorded as delivered instead of printed. 
+ * @brief This function is triggered when a broadcast or multicast is successful. 
  * @param length The length of the successfully broadcasted message. 
  * @param data The message broadcasted successfully. 
+ * @param group The multicast address of the message, or 0 for broadcast. 
  */
-void notifySuccessBroadcast(int length, unsigned char *data)
+void notifySuccessBroadcast(int length, unsigned char *data, unsigned char group)
 {
-    printf("Message: %s\r\nAbove message is successfully broadcasted\r\n", data + 2);
+    if (data[1] == TRANSPORT_FLAG_BENCH_DATAGRAM)
+    {
+        trafficDelivered(data + 2);
+        return;
+    }
+    if (group)
+    {
+        printf("Message: %.*s\r\nAbove message is delivered to group %d\r\n", length - 2, data + 2, group - MULTICAST_FIRST);
+        hostlinkEvent(HOSTLINK_EVENT_BROADCASTED, data[0], group, NULL, 0);
+        return;
+    }
+    printf("Message: %.*s\r\nAbove message is successfully broadcasted\r\n", length - 2, data + 2);
+    hostlinkEvent(HOSTLINK_EVENT_BROADCASTED, data[0], 0, NULL, -1);
 }
 
 
@@ -1,6 +1,10 @@
 
 void transportCacheArrayInit();
 
+struct port_message;
+
+unsigned char transportConsoleHandler(struct port_message *message);
+
 
 int calculateLength(char *data);
 
@@ -11,20 +15,22 @@ unsigned int periodDiffCalculator(unsigned int comparator);
 void periodClockUpdate();
 
 
-struct transport_node* constructTransportNode(unsigned char type, unsigned char *data, unsigned char target, int length);
+int constructTransportNode(unsigned char type, unsigned char *data, unsigned char target, int length);
+
+void inflightRelease(unsigned char slot);
 
-void updateCacheArrIndex();
 
+int initiateSend(int address, unsigned char type, unsigned char *data, int length);
 
-void initiateSend(int address, unsigned char type, unsigned char *data, int length);
+void transmitMessage(unsigned char slot);
 
 void sendACK(int address, unsigned char id);
 
-void transportProcessing(unsigned char srcAddress, unsigned char targetAddress, int length, unsigned char *data);
+void transportProcessing(unsigned char srcAddress, unsigned char targetAddress, int length, unsigned char *data, struct data_node *node);
 
 
 void notifyFailSend(char *payload, char dest);
 
 
-void notifySuccessBroadcast(int length, unsigned char *data);
+void notifySuccessBroadcast(int length, unsigned char *data, unsigned char group);
 
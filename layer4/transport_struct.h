@@ -7,12 +7,82 @@
  * 
  */
 
-/// This structure stores transport layer messages that have been sent by the device. 
-struct transport_node
+#define TRANSPORT_FLAG_FRAGMENT 0xFA ///< This is the flag of a fragment of a message longer than TRANSPORT_MAX_SEGMENT. 
+#define TRANSPORT_FLAG_FRAGMENT_ACK 0xFB ///< This is the flag of the selective ACK of fragments. 
+#define TRANSPORT_FLAG_STREAM 0xF9 ///< This is the flag of a packet of a stream transfer. 
+#define TRANSPORT_FLAG_CREDIT 0xF8 ///< This is the flag of a credit update, sent when a receiver has buffer again after advertising none. 
+#define TRANSPORT_FLAG_BENCH 0xF7 ///< This is the flag of a benchmark message that needs ACK. 
+#define TRANSPORT_FLAG_BENCH_DATAGRAM 0xF6 ///< This is the flag of a benchmark datagram, which is not acknowledged like flag 2. 
+#define transportIsDatagram(type) ((type) == 2 || (type) == TRANSPORT_FLAG_BENCH_DATAGRAM) ///< This tells whether a message of the given flag is sent without ACK. 
+#define transportNeedsAck(type) (!transportIsDatagram(type) && (type) != 1 && (type) != TRANSPORT_FLAG_FRAGMENT_ACK && (type) != TRANSPORT_FLAG_CREDIT) ///< This tells whether a packet of the given flag carries a message kept in the in-flight table until ACK, i.e. it is neither a datagram nor an ACK or credit update. 
+
+#define TRANSPORT_MAX_SEGMENT 251 ///< This denotes the longest message sent in one packet: 255 bytes of payload without addresses, id and flag. 
+#define TRANSPORT_FRAGMENT_SIZE 64 ///< This denotes how many bytes of message each fragment carries. 
+#define TRANSPORT_MAX_FRAGMENTS 8 ///< This denotes the largest number of fragments of a message, at most 8 as the fragment bitmaps are 8 bits. 
+#define TRANSPORT_MAX_MESSAGE (TRANSPORT_FRAGMENT_SIZE * TRANSPORT_MAX_FRAGMENTS) ///< This denotes the longest message that can be sent, 512 bytes. The selective ACK carries a bitmap of 1 byte, and the sender keeps the whole message and the receiver a buffer of its size in the 2 kB of SRAM, so longer messages are sent as a stream. 
+#define TRANSPORT_FRAGMENT_WINDOW 2 ///< This denotes how many packets may wait in send queue before the next fragment is pushed. 
+
+#ifndef TRANSPORT_MAX_OUTSTANDING
+#define TRANSPORT_MAX_OUTSTANDING 16 ///< This denotes how many messages may wait for ACK at the same time. It must be a power of 2 from 8 to 128. 
+#endif
+
+#define TRANSPORT_ERROR_TOO_LONG -1 ///< This is returned by initiateSend when the message is too long to send. 
+#define TRANSPORT_ERROR_TABLE_FULL -2 ///< This is returned by initiateSend when TRANSPORT_MAX_OUTSTANDING messages are waiting for ACK. 
+#define TRANSPORT_ERROR_NO_CREDIT -3 ///< This is returned by initiateSend when the receiver has no credit and CREDIT_HOLD_LIMIT messages are already held back. 
+#define TRANSPORT_ERROR_NO_MEMORY -4 ///< This is returned by initiateSend when there is not enough memory to build the packet of a datagram or broadcast. 
+
+#define CREDIT_PRESENT 0x80 ///< This bit is set in the third byte of an ACK when it carries credit. ACK messages without it carry no credit. 
+#define CREDIT_MAX 7 ///< This denotes the largest credit advertised. 
+#define CREDIT_UNIT 300 ///< This denotes how many bytes of free memory a receiver needs for one credit, enough for a packet of the largest size and its structures. 
+#define CREDIT_PEERS 8 ///< This denotes how many peers the credit table keeps. 
+#define CREDIT_HOLD_LIMIT 4 ///< This denotes how many messages may be held back for peers without credit. 
+#define CREDIT_STARVED 4 ///< This denotes how many peers a receiver remembers having advertised no credit to. 
+
+//! This structure stores transport layer messages that have been sent by the device and wait for ACK. 
+/**
+ * Each message occupies one slot, and each field is an array indexed by slot, so that no padding or pointer per message is needed. <br>
+ * The id of a message is its slot plus a multiple of TRANSPORT_MAX_OUTSTANDING, which is advanced whenever the slot is taken again. Thus a late ACK of a previous message in the same slot does not match. <br>
+ * A set bit in freeMap denotes a free slot, so that a free slot is found by looking at one byte per 8 slots. 
+ */
+struct inflight_table
+{
+    unsigned int sentPeriodStamp[TRANSPORT_MAX_OUTSTANDING]; ///< This is the period stamp during which the message is sent. 
+    int length[TRANSPORT_MAX_OUTSTANDING]; ///< This denotes the length of the layer-4 payload in bytes. 
+    unsigned char *msg[TRANSPORT_MAX_OUTSTANDING]; ///< This denotes the payload messages to send. Once the packet has been built, it points into the payload of frame. 
+    struct data_node *frame[TRANSPORT_MAX_OUTSTANDING]; ///< This is the encoded packet of the message, kept with its header and CRC for retransmission, or NULL if it has not been built. 
+    unsigned char id[TRANSPORT_MAX_OUTSTANDING]; ///< This is the id of the message on transport layer. 
+    unsigned char flag[TRANSPORT_MAX_OUTSTANDING]; ///< This denotes the flag of the message. 
+    unsigned char destination[TRANSPORT_MAX_OUTSTANDING]; ///< This denotes the address of the message receiver. 
+    unsigned char fragmentType[TRANSPORT_MAX_OUTSTANDING]; ///< This denotes the flag of a fragmented message, which is carried in each fragment. 
+    unsigned char fragmentCount[TRANSPORT_MAX_OUTSTANDING]; ///< This denotes the number of fragments of a fragmented message. 
+    unsigned char fragmentsAcked[TRANSPORT_MAX_OUTSTANDING]; ///< This is the bitmap of fragments acknowledged by the receiver. 
+    unsigned char fragmentsSent[TRANSPORT_MAX_OUTSTANDING]; ///< This is the bitmap of fragments sent in the current round, including acknowledged ones. 
+    unsigned char freeMap[TRANSPORT_MAX_OUTSTANDING / 8]; ///< This is the bitmap of free slots. 
+    unsigned char heldMap[TRANSPORT_MAX_OUTSTANDING / 8]; ///< This is the bitmap of messages held back, because their receiver has no credit. 
+};
+
+/// This structure stores the credit of a peer, i.e. how many more messages it has advertised to accept. 
+struct peer_credit
+{
+    unsigned char address; ///< This denotes the address of the peer, 0 for an unused entry. 
+    unsigned char credit; ///< This denotes how many more messages may be sent to the peer. 
+    unsigned int lastPeriodStamp; ///< This is the period stamp of the last credit advertised by the peer, or of the last probe. 
+};
+
+/// This structure stores a fragmented message that is being reassembled. 
+/**
+ * Only one message is reassembled at a time. Fragments of other messages are dropped and will be sent again by their senders. 
+ */
+struct reassembly_buffer
 {
-    unsigned int sentPeriodStamp; ///< This is the period stamp during which the message is sent. 
-    int length; ///< This denotes the lengoth of the layer-4 payload in bytes. 
-    unsigned char flag; ///< This denotes the flag of the message. 
-    unsigned char *msg; ///< This denotes the payload messages to send. 
-    unsigned char destination; ///< This denotes the address of the message receiver. 
+    unsigned char *data; ///< This is the buffer of the message, NULL when no message is being reassembled. 
+    int length; ///< This denotes the length of the message, known when the last fragment has been received. 
+    unsigned int lastPeriodStamp; ///< This is the period stamp during which the last fragment has been received. 
+    unsigned char source; ///< This denotes the address of the message sender. 
+    unsigned char id; ///< This denotes the id of the message on transport layer of the sender. 
+    unsigned char type; ///< This denotes the flag of the message. 
+    unsigned char count; ///< This denotes the number of fragments of the message. 
+    unsigned char received; ///< This is the bitmap of received fragments. 
+    unsigned char nackSent; ///< This flag denotes whether the missing fragments have been reported since the last fragment. 
+    unsigned char refused; ///< This flag denotes that all fragments have been received, but the consumer has refused the message. No fragment is missing then, so none are reported. 
 };
\ No newline at end of file
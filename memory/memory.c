@@ -0,0 +1,217 @@
+/**
+ * @file memory.c
+ * @author David Ng 550084
+ * @brief This component is responsible for profiling the usage of heap and stack
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "memory.h"
+
+extern char _end; ///< This is the end of static variables, provided by the linker. 
+extern char __heap_start; ///< This is the start of heap, provided by the linker. 
+extern char *__brkval; ///< This is the current end of heap, maintained by malloc. 
+extern struct statistics stats;
+
+uint16_t allocationCount[MEMORY_SUBSYSTEMS]; ///< This denotes how many allocations each subsystem has made. 
+uint32_t allocationBytes[MEMORY_SUBSYSTEMS]; ///< This denotes how many bytes each subsystem has allocated in total. 
+uint16_t allocationFailures; ///< This denotes how many allocations have returned NULL. 
+char *heapPeak = &__heap_start; ///< This is the highest end of heap observed. 
+unsigned int stackHighWater = 0; ///< This denotes the largest stack usage recorded before the guard is repainted. 
+
+const char *memorySubsystemNames[MEMORY_SUBSYSTEMS] = {"Main", "Data link", "Network", "Transport"}; ///< These are the names of subsystems. 
+
+/**
+ * This function is placed in section .init3, so it runs after the stack pointer is set up and before static variables are initialised. <br>
+ * It fills everything between the end of static variables and the stack pointer with MEMORY_CANARY, so that any byte touched by heap or stack afterwards can be recognised. 
+ * @brief This function paints the free memory at startup. 
+ */
+void memoryPaint(void)
+{
+    uint8_t *pointer = (uint8_t*)&_end;
+    while (pointer <= (uint8_t*)SP)
+        *pointer++ = MEMORY_CANARY;
+}
+
+/**
+ * @brief This function records an allocation of a subsystem. 
+ * @param subsystem The subsystem making the allocation, one of the MEMORY_ definitions. 
+ * @param size The number of bytes allocated. 
+ * @param pointer The result of the allocation. 
+ */
+void memoryRecord(unsigned char subsystem, size_t size, void *pointer)
+{
+    allocationCount[subsystem]++;
+    allocationBytes[subsystem] += size;
+    if (pointer == NULL)
+        allocationFailures++;
+    if (__brkval > heapPeak)
+        heapPeak = __brkval;
+}
+
+/**
+ * The allocation is made with interrupts disabled, because malloc is not reentrant and packets are also allocated at pin change interrupt. 
+ * @brief This function allocates memory like malloc and records it for the given subsystem. 
+ * @param subsystem The subsystem making the allocation, one of the MEMORY_ definitions. 
+ * @param size The number of bytes to allocate. 
+ * @return The pointer to the allocated memory, or NULL. 
+ */
+void *memoryMalloc(unsigned char subsystem, size_t size)
+{
+    void *pointer;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pointer = malloc(size);
+        memoryRecord(subsystem, size, pointer);
+    }
+    return pointer;
+}
+
+/**
+ * @brief This function allocates zeroed memory like calloc and records it for the given subsystem. 
+ * @param subsystem The subsystem making the allocation, one of the MEMORY_ definitions. 
+ * @param count The number of elements to allocate. 
+ * @param size The size of each element. 
+ * @return The pointer to the allocated memory, or NULL. 
+ */
+void *memoryCalloc(unsigned char subsystem, size_t count, size_t size)
+{
+    void *pointer;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pointer = calloc(count, size);
+        memoryRecord(subsystem, count * size, pointer);
+    }
+    return pointer;
+}
+
+/**
+ * @brief This function resizes memory allocated by memoryMalloc or memoryCalloc like realloc, with interrupts disabled. 
+ * @param subsystem The subsystem making the allocation, one of the MEMORY_ definitions. 
+ * @param pointer The pointer to the memory to resize. 
+ * @param size The new number of bytes. 
+ * @return The pointer to the resized memory, or NULL, in which case the original memory is kept. 
+ */
+void *memoryRealloc(unsigned char subsystem, void *pointer, size_t size)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pointer = realloc(pointer, size);
+        memoryRecord(subsystem, size, pointer);
+    }
+    return pointer;
+}
+
+/**
+ * @brief This function frees memory allocated by memoryMalloc or memoryCalloc with interrupts disabled. 
+ * @param pointer The pointer to the memory to free. 
+ */
+void memoryFree(void *pointer)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        free(pointer);
+    }
+}
+
+/**
+ * @brief This function calculates the current heap usage. 
+ * @return The heap usage in bytes. 
+ */
+unsigned int memoryHeapUsed()
+{
+    return __brkval ? __brkval - &__heap_start : 0;
+}
+
+/**
+ * @brief This function calculates the memory left between the end of heap and the stack pointer. 
+ * @return The free memory in bytes. 
+ */
+unsigned int memoryAvailable()
+{
+    char *top = __brkval ? __brkval : &__heap_start;
+    return (char*)SP > top ? (char*)SP - top : 0;
+}
+
+/**
+ * The painted memory is scanned upwards from the highest end of heap until the first byte not equal to MEMORY_CANARY, which is the deepest byte the stack has reached. 
+ * @brief This function calculates the stack high-water mark. 
+ * @return The largest stack usage in bytes since startup. 
+ */
+unsigned int memoryStackHighWater()
+{
+    uint8_t *pointer = (uint8_t*)(__brkval > heapPeak ? __brkval : heapPeak);
+    while (pointer <= (uint8_t*)RAMEND && *pointer == MEMORY_CANARY)
+        pointer++;
+    unsigned int used = (uint8_t*)RAMEND - pointer + 1;
+    return used > stackHighWater ? used : stackHighWater;
+}
+
+/**
+ * Only the MEMORY_GUARD bytes right above the highest end of heap are checked, so that this check is cheap enough to run at every period. <br>
+ * If any of them is no longer MEMORY_CANARY, the stack has come within MEMORY_GUARD bytes of heap and memoryWarnings in stats is incremented. <br>
+ * Then the stack high-water mark is recorded, and the guard bytes below the stack pointer are painted again, so that the next approach is counted again. 
+ * @brief This function checks periodically whether stack and heap are about to meet. 
+ */
+void memoryCheck()
+{
+    uint8_t *pointer;
+    ATOMIC_BLOCK(ATOMIC_FORCEON)
+    {
+        if (__brkval > heapPeak)
+            heapPeak = __brkval;
+        pointer = (uint8_t*)heapPeak;
+    }
+    int i;
+    for (i = 0; i < MEMORY_GUARD; i++)
+    {
+        if (pointer[i] != MEMORY_CANARY)
+        {
+            statIncrement(memoryWarnings);
+            stackHighWater = memoryStackHighWater();
+            ATOMIC_BLOCK(ATOMIC_FORCEON)
+            {
+                for (; i < MEMORY_GUARD && pointer + i < (uint8_t*)SP; i++) // bytes below the stack pointer are not in use
+                    pointer[i] = MEMORY_CANARY;
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * @brief This function prints heap usage, stack high-water mark, and allocation totals of each subsystem. 
+ */
+void memoryPrint()
+{
+    unsigned int heapUsed = memoryHeapUsed(), stackUsed = memoryStackHighWater();
+    printf("Static: %u Heap: %u (peak %u) Stack high-water: %u\r\n", (unsigned int)(&_end - (char*)RAMSTART), heapUsed, (unsigned int)(heapPeak - &__heap_start), stackUsed);
+    printf("Never used: %u Warnings: %u Failed allocations: %u\r\n", (unsigned int)((char*)RAMEND + 1 - heapPeak) - stackUsed, stats.memoryWarnings, allocationFailures);
+    int i;
+    for (i = 0; i < MEMORY_SUBSYSTEMS; i++)
+        printf("%s: %u allocations, %lu bytes\r\n", memorySubsystemNames[i], allocationCount[i], (unsigned long)allocationBytes[i]);
+}
@@ -0,0 +1,28 @@
+#define MEMORY_MAIN 0 ///< This denotes allocations made by the main program and console. 
+#define MEMORY_DATALINK 1 ///< This denotes allocations made on data link layer. 
+#define MEMORY_NETWORK 2 ///< This denotes allocations made on network layer. 
+#define MEMORY_TRANSPORT 3 ///< This denotes allocations made on transport layer. 
+#define MEMORY_SUBSYSTEMS 4 ///< This denotes the number of subsystems of which allocations are counted. 
+
+#define MEMORY_CANARY 0xC5 ///< This is the value painted into free memory at startup. 
+#define MEMORY_GUARD 32 ///< This denotes how many bytes above the top of heap are checked for stack growth. 
+
+void memoryPaint(void) __attribute__((naked, used, section(".init3")));
+
+void *memoryMalloc(unsigned char subsystem, size_t size);
+
+void *memoryCalloc(unsigned char subsystem, size_t count, size_t size);
+
+void *memoryRealloc(unsigned char subsystem, void *pointer, size_t size);
+
+void memoryFree(void *pointer);
+
+unsigned int memoryHeapUsed();
+
+unsigned int memoryAvailable();
+
+unsigned int memoryStackHighWater();
+
+void memoryCheck();
+
+void memoryPrint();
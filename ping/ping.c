@@ -0,0 +1,217 @@
+/**
+ * @file ping.c
+ * @author David Ng 550084
+ * @brief This component sends probes around the ring and reports the round trip and the time spent in each node 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "../layer2/rate_limit.h"
+#include "ping.h"
+
+extern int ADDRESS;
+extern unsigned int msgWaitingPeriod;
+extern unsigned int globalPeriodStamp;
+extern unsigned char sendQueueLimit;
+extern unsigned char forwardQueueLimit;
+extern struct statistics stats;
+
+struct ping_run pingRun; ///< This is the current or last ping run. 
+
+/**
+ * @brief This function starts a ping run. A run going on is replaced. 
+ * @param probes The number of probes, PING_PROBES if 0. 
+ */
+void pingStart(unsigned int probes)
+{
+    unsigned char sequence = pingRun.sequence + 1; // a late probe of the previous run does not match
+    memset(&pingRun, 0, sizeof(pingRun));
+    pingRun.sequence = sequence;
+    pingRun.probes = probes ? probes : PING_PROBES;
+    pingRun.roundTripMin = 0xFFFF;
+    for (unsigned char i = 0; i < PING_MAX_HOPS; i++)
+        pingRun.hops[i].min = 0xFFFF;
+    pingRun.active = 1;
+    printf("Ping: %u probes around the ring\r\n", pingRun.probes);
+    pingSend();
+}
+
+/**
+ * The probe carries the record of this device, whose time is stamped by sendStart, so that it covers the wait in send queue. 
+ * @brief This function queues the next probe. 
+ * @return 1 if the probe has been queued, 0 if send queue is full or there is no memory, in which case it is tried again at the next period. 
+ */
+int pingSend()
+{
+    if (stats.sendQueueDepth >= sendQueueLimit)
+        return 0;
+    unsigned char *payload = memoryCalloc(MEMORY_NETWORK, PING_HEADER + PING_RECORD, sizeof(char));
+    if (payload == NULL)
+        return 0;
+    payload[0] = PING_ADDRESS, payload[1] = ADDRESS, payload[2] = pingRun.sequence;
+    payload[PING_HEADER] = ADDRESS;
+    struct data_node *node = dataNodeConstructor(PING_HEADER + PING_RECORD, payload);
+    if (node == NULL)
+    {
+        memoryFree(payload);
+        return 0;
+    }
+    node->stampOffset = PING_HEADER + 1;
+    pingRun.sentPeriodStamp = globalPeriodStamp;
+    pingRun.waiting = 1;
+    pingRun.sent++;
+    statIncrement(framesQueued);
+    pushSendQueue(node);
+    return 1;
+}
+
+/**
+ * @brief This function records the round trip and the records of a returned probe. 
+ * @param payload The payload of the probe. 
+ * @param length The length of the payload. 
+ */
+void pingReturned(unsigned char *payload, unsigned char length)
+{
+    if (!pingRun.active || !pingRun.waiting || payload[2] != pingRun.sequence) // late probe of a previous run or a lost probe
+        return;
+    unsigned int roundTrip = globalPeriodStamp - pingRun.sentPeriodStamp;
+    pingRun.roundTripSum += roundTrip;
+    if (roundTrip < pingRun.roundTripMin)
+        pingRun.roundTripMin = roundTrip;
+    if (roundTrip > pingRun.roundTripMax)
+        pingRun.roundTripMax = roundTrip;
+    unsigned char i;
+    for (i = 0; i < (length - PING_HEADER) / PING_RECORD && i < PING_MAX_HOPS; i++)
+    {
+        unsigned char *record = payload + PING_HEADER + i * PING_RECORD;
+        unsigned int spent = record[1] | record[2] << 8;
+        struct ping_hop *hop = &pingRun.hops[i];
+        hop->address = record[0];
+        hop->count++;
+        hop->sum += spent;
+        if (spent < hop->min)
+            hop->min = spent;
+        if (spent > hop->max)
+            hop->max = spent;
+    }
+    pingRun.returned++;
+    pingRun.waiting = 0;
+    pingRun.sequence++;
+    pingPump();
+}
+
+/**
+ * A probe of this device has gone around the ring and is recorded. <br>
+ * A probe of another node is sent on as a new packet with its record appended, unless it already carries PING_MAX_HOPS records. Its period stamp is the start of receiving it, so that sendStart stamps the time from its first byte arriving to its first byte leaving. <br>
+ * It is pushed to forward queue like a forwarded packet, and dropped like one when forward queue is full. 
+ * @brief This function processes a received probe. It is invoked by networkDataProcessing. 
+ * @param payload The payload of the probe. 
+ * @param length The length of the payload. 
+ * @param periodStamp The period stamp at which receiving the probe has started. 
+ */
+void pingReceived(unsigned char *payload, unsigned char length, unsigned int periodStamp)
+{
+    if (length < PING_HEADER || (length - PING_HEADER) % PING_RECORD)
+        return;
+    if (payload[1] == ADDRESS)
+    {
+        pingReturned(payload, length);
+        return;
+    }
+    if (stats.forwardQueueDepth >= forwardQueueLimit)
+    {
+        statIncrement(queueDrops);
+        return;
+    }
+    unsigned char append = (length - PING_HEADER) / PING_RECORD < PING_MAX_HOPS ? PING_RECORD : 0;
+    unsigned char *copy = memoryCalloc(MEMORY_NETWORK, length + append, sizeof(char));
+    if (copy == NULL)
+        return;
+    memcpy(copy, payload, length);
+    struct data_node *node = dataNodeConstructor(length + append, copy);
+    if (node == NULL)
+    {
+        memoryFree(copy);
+        return;
+    }
+    node->periodStamp = periodStamp;
+    if (append)
+    {
+        copy[length] = ADDRESS;
+        node->stampOffset = length + 1;
+    }
+    jumpSendQueue(node);
+    dataNodeRelease(node); // the forward queue holds its own reference
+    statIncrement(framesForwarded);
+}
+
+/**
+ * @brief This function counts a probe as lost after msgWaitingPeriod, and sends the next probe or ends the run. It is invoked once per period from the main loop and when a probe returns. 
+ */
+void pingPump()
+{
+    if (!pingRun.active)
+        return;
+    if (pingRun.waiting && periodDiffCalculator(pingRun.sentPeriodStamp) >= msgWaitingPeriod)
+    {
+        pingRun.waiting = 0;
+        pingRun.sequence++;
+    }
+    if (pingRun.waiting)
+        return;
+    if (pingRun.sent < pingRun.probes)
+        pingSend();
+    else
+    {
+        pingRun.active = 0;
+        pingReport();
+    }
+}
+
+/**
+ * The time on the lines is what remains of the round trip besides the times spent in the nodes, i.e. the transmission of the probe on every line. A node without ping support forwards the probe as it is received, so its time is counted there as well. 
+ * @brief This function prints the round trip and the time spent in each node, in the order the probes have passed them. 
+ */
+void pingReport()
+{
+    unsigned long periodsPerSecond = ratePeriodsPerSecond();
+    printf("Ping%s: sent %u, returned %u, lost %u\r\n", pingRun.active ? " (running)" : "", pingRun.sent, pingRun.returned, pingRun.sent - pingRun.returned - pingRun.waiting);
+    if (!pingRun.returned)
+        return;
+    printf("Round trip min %lu avg %lu max %lu ms\r\n", pingRun.roundTripMin * 1000UL / periodsPerSecond, pingRun.roundTripSum / pingRun.returned * 1000 / periodsPerSecond, pingRun.roundTripMax * 1000UL / periodsPerSecond);
+    unsigned long spentSum = 0;
+    for (unsigned char i = 0; i < PING_MAX_HOPS && pingRun.hops[i].count; i++)
+    {
+        struct ping_hop *hop = &pingRun.hops[i];
+        spentSum += hop->sum / hop->count;
+        printf("Hop %u node %u: min %lu avg %lu max %lu ms\r\n", i, hop->address, hop->min * 1000UL / periodsPerSecond, hop->sum / hop->count * 1000 / periodsPerSecond, hop->max * 1000UL / periodsPerSecond);
+    }
+    unsigned long roundTripAverage = pingRun.roundTripSum / pingRun.returned;
+    printf("Lines avg %lu ms\r\n", (roundTripAverage > spentSum ? roundTripAverage - spentSum : 0) * 1000 / periodsPerSecond);
+}
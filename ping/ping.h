@@ -0,0 +1,46 @@
+#define PING_HEADER 3 ///< This denotes the bytes of a probe in front of its records: PING_ADDRESS, the address of the sender, and the sequence number. 
+#define PING_RECORD 3 ///< This denotes the bytes of a record: the address of the node, and the periods the probe has spent in it in little endian. 
+#ifndef PING_MAX_HOPS
+#define PING_MAX_HOPS 8 ///< This denotes how many records a probe carries, including the one of its sender. Further nodes send the probe on without adding theirs. 
+#endif
+#define PING_PROBES 4 ///< This denotes how many probes are sent when no number is given. 
+
+//! This structure stores the delays observed at one position of the ring. 
+struct ping_hop
+{
+    uint8_t address; ///< This is the address of the node at this position in the last returned probe. 
+    uint8_t count; ///< This denotes how many returned probes carried a record for this position. 
+    uint16_t min; ///< This is the shortest time spent in the node in periods. 
+    uint16_t max; ///< This is the longest time spent in the node in periods. 
+    unsigned long sum; ///< This is the sum of the times spent in the node in periods. 
+};
+
+//! This structure stores the settings and results of a ping run. 
+/**
+ * One probe is sent at a time. The next one is sent when it returns, or after msgWaitingPeriod, when it is counted as lost. <br>
+ * The round trip is measured from queueing the probe to its return, so it is the sum of the times spent in all nodes, including the send queue of this device, and the time on the lines. 
+*/
+struct ping_run
+{
+    uint8_t active; ///< This flag denotes that the run is going on. 
+    uint8_t waiting; ///< This flag denotes that a probe is on its way. 
+    uint8_t sequence; ///< This is the sequence number of the probe on its way. 
+    uint16_t probes; ///< This denotes how many probes are sent. 
+    uint16_t sent; ///< This denotes how many probes have been sent. 
+    uint16_t returned; ///< This denotes how many probes have returned. 
+    unsigned int sentPeriodStamp; ///< This is the period stamp at which the probe on its way has been queued. 
+    unsigned long roundTripSum; ///< This is the sum of the round trips in periods. 
+    unsigned int roundTripMin; ///< This is the shortest round trip in periods. 
+    unsigned int roundTripMax; ///< This is the longest round trip in periods. 
+    struct ping_hop hops[PING_MAX_HOPS]; ///< These are the delays of the nodes in the order the probes have passed them, starting with this device. 
+};
+
+void pingStart(unsigned int probes);
+
+int pingSend();
+
+void pingReceived(unsigned char *payload, unsigned char length, unsigned int periodStamp);
+
+void pingPump();
+
+void pingReport();
@@ -0,0 +1,132 @@
+/**
+ * @file profiler.c
+ * @author David Ng 550084
+ * @brief This component is responsible for measuring the execution time of interrupts in the profiling build
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "profiler.h"
+
+#ifdef PROFILE_ISR
+
+struct profile_entry profileEntries[PROFILE_SECTIONS]; ///< This is the array of timing records, indexed by profiled section. 
+unsigned char cyclesPerTick = 8; ///< This denotes how many CPU cycles a tick of Timer 1 lasts in the profiling build. 
+
+const char *profileNames[PROFILE_SECTIONS] = {"Timer ISR", "Pin ISR", "clockTickSendDecisionMaker", "prepareSendBit", "sendBit", "detectPremeable", "writeBitToBuffer"}; ///< These are the names of profiled sections. 
+
+/**
+ * In the profiling build Timer 1 is also used as free-running timestamp, so it runs at prescaler 8 instead of 256 to get a finer resolution. <br>
+ * The period of 0.2 sec does not fit into 16 bits at prescaler 8, so prescaler 64 is used for it. <br>
+ * The compare value is scaled accordingly, thus the bit rate is the same as in the normal build. The clock select bits are cleared first, as the timer is set up again when the speed is changed. 
+ * @brief This function starts Timer 1 with a finer prescaler for profiling. 
+ * @param compareValue The compare value of OCR1A at prescaler 256. 
+ */
+void profilerTimerInit(unsigned int compareValue)
+{
+    if ((unsigned long)(compareValue + 1) * 32 > 65536) // does not fit at prescaler 8
+    {
+        cyclesPerTick = 64;
+        OCR1A = (compareValue + 1) * 4 - 1;
+        TCCR1B = (TCCR1B & ~(1 << CS12 | 1 << CS11 | 1 << CS10)) | (1 << CS11 | 1 << CS10); // set prescaler to 64 and start the timer
+    }
+    else
+    {
+        cyclesPerTick = 8;
+        OCR1A = (compareValue + 1) * 32 - 1;
+        TCCR1B = (TCCR1B & ~(1 << CS12 | 1 << CS11 | 1 << CS10)) | (1 << CS11); // set prescaler to 8 and start the timer
+    }
+    memset(profileEntries, 0, sizeof(profileEntries));
+}
+
+/**
+ * The elapsed time is the difference between TCNT1 and start, taking into account that TCNT1 is cleared at OCR1A. <br>
+ * Because of this, an execution longer than the bit period cannot be measured and is recorded as one full bit period. 
+ * @brief This function records the elapsed time of a profiled section. 
+ * @param section The profiled section, one of the PROFILE_ definitions. 
+ * @param start The value of TCNT1 at the beginning of the section. 
+ * @param overrun A flag to denote whether the section has taken longer than the bit period. 
+ */
+void profilerRecord(unsigned char section, unsigned int start, unsigned char overrun)
+{
+    unsigned int end = TCNT1;
+    unsigned int ticks = end >= start ? end - start : end + OCR1A + 1 - start;
+    struct profile_entry *entry = &profileEntries[section];
+    if (overrun)
+    {
+        ticks = OCR1A + 1;
+        entry->overruns++;
+    }
+    if (entry->count == 0 || ticks < entry->minTicks)
+        entry->minTicks = ticks;
+    if (ticks > entry->maxTicks)
+        entry->maxTicks = ticks;
+    entry->count++;
+    unsigned long cycles = (unsigned long)ticks * cyclesPerTick;
+    unsigned char bucket = 0;
+    for (cycles >>= 6; cycles && bucket < PROFILE_BUCKETS - 1; cycles >>= 2) // find i for 64 * 4^i
+        bucket++;
+    entry->histogram[bucket]++;
+}
+
+/**
+ * For each section, the number of executions, the shortest and longest execution in cycles, the number of overruns and the histogram are printed. <br>
+ * Finally a safe bit rate is estimated. At each bit a timer interrupt and a pin change interrupt are handled, and sendBit waits for about half of the period, <br>
+ * so the work of both interrupts, without the delay in sendBit, must fit into half of the period. <br>
+ * In the hardware-shifted build, the SPI interrupt, profiled as pin change interrupt, is handled once per byte, and it may be delayed by a timer interrupt, so both must fit into half of a byte clock. 
+ * @brief This function prints all timing records. 
+ * @param reset A flag to denote whether the records are cleared after reading. 
+ */
+void profilerPrint(int reset)
+{
+    struct profile_entry copy[PROFILE_SECTIONS];
+    ATOMIC_BLOCK(ATOMIC_FORCEON)
+    {
+        memcpy(copy, profileEntries, sizeof(profileEntries));
+        if (reset)
+            memset(profileEntries, 0, sizeof(profileEntries));
+    }
+    int i, j;
+    for (i = 0; i < PROFILE_SECTIONS; i++)
+    {
+        printf("%s: n=%u min=%lu max=%lu overruns=%u hist=", profileNames[i], copy[i].count, (unsigned long)copy[i].minTicks * cyclesPerTick, (unsigned long)copy[i].maxTicks * cyclesPerTick, copy[i].overruns);
+        for (j = 0; j < PROFILE_BUCKETS; j++)
+            printf("%u ", copy[i].histogram[j]);
+        printf("\r\n");
+    }
+#ifdef PHY_HW_SHIFT
+    unsigned long work = (unsigned long)(copy[PROFILE_TIMER_ISR].maxTicks + copy[PROFILE_PIN_ISR].maxTicks) * cyclesPerTick; // the timer interrupt may delay the SPI interrupt of a byte
+    if (work)
+        printf("Estimated safe bit rate: %lu bps\r\n", F_CPU * 8 / (2 * work));
+#else
+    unsigned long work = (unsigned long)(copy[PROFILE_TIMER_ISR].maxTicks - copy[PROFILE_SEND_BIT].maxTicks + copy[PROFILE_PIN_ISR].maxTicks) * cyclesPerTick;
+    if (work)
+        printf("Estimated safe bit rate: %lu bps\r\n", F_CPU / (2 * work));
+#endif
+}
+
+#endif
@@ -0,0 +1,39 @@
+#define PROFILE_TIMER_ISR 0 ///< This denotes the timer interrupt as profiled section. 
+#define PROFILE_PIN_ISR 1 ///< This denotes the pin change interrupt as profiled section. 
+#define PROFILE_SEND_DECISION 2 ///< This denotes clockTickSendDecisionMaker as profiled section. 
+#define PROFILE_PREPARE_SEND_BIT 3 ///< This denotes prepareSendBit as profiled section. 
+#define PROFILE_SEND_BIT 4 ///< This denotes sendBit, including its delay, as profiled section. 
+#define PROFILE_DETECT_PREMEABLE 5 ///< This denotes detectPremeable as profiled section. 
+#define PROFILE_WRITE_BIT 6 ///< This denotes writeBitToBuffer as profiled section. 
+#define PROFILE_SECTIONS 7 ///< This denotes the number of profiled sections. 
+#define PROFILE_BUCKETS 8 ///< This denotes the number of histogram buckets of each profiled section. 
+
+#ifdef PROFILE_ISR
+#define PROFILE_BEGIN(section) unsigned int profileStart##section = TCNT1 ///< This takes the timestamp at the beginning of a profiled section. 
+#define PROFILE_END(section) profilerRecord(section, profileStart##section, 0) ///< This records the elapsed time of a profiled section. 
+#define PROFILE_END_OVERRUN(section, overrun) profilerRecord(section, profileStart##section, overrun) ///< This records the elapsed time of an interrupt, together with whether it has overrun. 
+#else
+#define PROFILE_BEGIN(section)
+#define PROFILE_END(section)
+#define PROFILE_END_OVERRUN(section, overrun)
+#endif
+
+//! This structure stores the timing record of a profiled section. 
+/**
+ * Elapsed time is measured in ticks of Timer 1 and converted to cycles when printed. <br>
+ * Bucket i of the histogram counts executions shorter than 64 * 4^i cycles, the last bucket counts all longer executions. 
+*/
+struct profile_entry
+{
+    uint16_t count; ///< This denotes how many times the section has been executed. 
+    uint16_t minTicks; ///< This denotes the shortest execution in timer ticks. 
+    uint16_t maxTicks; ///< This denotes the longest execution in timer ticks. 
+    uint16_t overruns; ///< This denotes how many executions have taken longer than the bit period. 
+    uint16_t histogram[PROFILE_BUCKETS]; ///< This is the histogram of execution time in cycles. 
+};
+
+void profilerTimerInit(unsigned int compareValue);
+
+void profilerRecord(unsigned char section, unsigned int start, unsigned char overrun);
+
+void profilerPrint(int reset);
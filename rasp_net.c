@@ -29,22 +29,41 @@
 #include "layer2/data_link.h"
 #include "irq/interrupt_handler.h"
 #include "layer1/physical.h"
+#include "stats/stats.h"
+#include "console/console.h"
+#include "profiler/profiler.h"
+#include "memory/memory.h"
+#include "hostlink/hostlink.h"
+#include "config/config.h"
+#include "layer4/transport_struct.h"
+#include "layer4/stream.h"
+#include "layer2/rate_limit.h"
+#include "trace/trace.h"
+#include "scheduler/scheduler.h"
+#include "traffic/traffic.h"
 
 // 64
 
 // use stdint.h
 
-struct comm_control sendControl = {0, 0, 0, 0}; ///< This is an instance of comm_control for maintaining control data for send procedures. 
-struct comm_control receiveControl = {0, 0, 0, 0}; ///< This is an instance of comm_control for maintaining control data for receive procedures. 
+struct comm_control sendControl = {0, 0, 0, 0, 0}; ///< This is an instance of comm_control for maintaining control data for send procedures. 
+struct comm_control receiveControl = {0, 0, 0, 0, 0}; ///< This is an instance of comm_control for maintaining control data for receive procedures. 
+struct send_register sendRegister = {0, 0, 0, NULL, 0}; ///< This is the shift register of the byte being sent. 
+struct send_register sendPausedRegister = {0, 0, 0, NULL, 0}; ///< This is the shift register of the packet that has been preempted, at the byte where it was paused. 
+struct comm_control receivePausedControl = {0, 0, 0, 0, 0}; ///< This is the receive control data of the packet that has been preempted. 
 
-struct receive_buffer bufferReceive = {NULL, 0, 0, 0, 0}; ///< This is an instance of receive_buffer for maintaining temporarily read bits. 
+struct receive_buffer bufferReceive = {NULL, 0, 0, 0, 0, 0, 0}; ///< This is an instance of receive_buffer for maintaining temporarily read bits. 
 
 struct data_node *forwardDataQueue = NULL, *forwardDataQueueEnd = NULL; ///< This is a queue of data_node to be forwarded. 
 struct data_node *sendDataQueue = NULL, *sendDataQueueEnd = NULL; ///< This is a queue of data_node to be sent.
+struct data_node *urgentDataQueue = NULL, *urgentDataQueueEnd = NULL; ///< This is a queue of data_node that preempt other packets, such as ACK messages. 
 struct data_node *receiveDataNode = NULL; ///< This is the instance of data_node that is being written by received bytes. 
 struct data_node *sendDataNode = NULL; ///< This is the instance of data_node that is being sent. 
+struct data_node *sendPausedNode = NULL; ///< This is the instance of data_node that has been preempted by sendDataNode. 
+struct data_node *receivePausedNode = NULL; ///< This is the instance of data_node that has been preempted by receiveDataNode. 
 
-const int ADDRESS = 15; ///< This denotes the address of the current device. 
+int ADDRESS = 15; ///< This denotes the address of the current device. It is replaced by the configuration in EEPROM if present. 
+uint16_t multicastGroups = 0; ///< This is the bitmap of multicast groups joined by the current device. Bit n stands for address MULTICAST_FIRST + n. 
 int sendSpeed = 1; ///< This is the flag of the period of interrupt, thus how long would it take to send one bit. 
 unsigned int globalPeriodStamp = 0; ///< This denotes how many timer interrupts have been triggered. 
 
@@ -52,13 +71,22 @@ static FILE uart_output = FDEV_SETUP_STREAM(uart_putchar, NULL, _FDEV_SETUP_WRIT
 static FILE uart_input = FDEV_SETUP_STREAM(NULL, uart_getchar, _FDEV_SETUP_READ); ///< This forwards the UART input to the input of stdio. 
 
 int printMode = 0; 
+int operatingMode = MODE_CONSOLE; ///< This denotes whether UART input is processed by the console or by the binary host protocol. 
 unsigned int msgWaitingPeriod = 2048 * 2 * 2; ///< This denotes the threshold number of elasped interrupts. When the period stamp difference is greater than this period, it denotes that the message has timed out. 
+unsigned int receiveTimeoutPeriods = 128; ///< This denotes how many periods may pass without a received bit before the packet being received is aborted. It must cover the bit time of the slowest neighbour. 
+unsigned char receiveMaxLength = 255; ///< This denotes the longest payload accepted in a received header. Packets announcing a longer payload are aborted. 
+unsigned char sendQueueLimit = 255; ///< This denotes how many packets send queue may hold. Further packets are dropped. 
+unsigned char forwardQueueLimit = 255; ///< This denotes how many packets forward queue may hold. Further packets are dropped. 
+unsigned int rateLimit = 0; ///< This denotes how many bytes per second of packets originated by this device may be sent, including premeable and header. 0 means no limit. 
+unsigned char rateBurst = 32; ///< This denotes how many bytes may be sent at once after the device has been idle. 
+unsigned char rateAimdThreshold = 0; ///< This denotes the depth of forward queue at which the rate is cut in AIMD mode. 0 means that AIMD mode is off. 
 
 
 /**
- * Also it asks the user to input the desired period of timer interrupt. <br>
+ * If a valid configuration is stored in EEPROM, it is applied and the device starts operating at once. <br>
+ * Otherwise it asks the user to input the desired period of timer interrupt. <br>
  * After that, the interruptInit will be triggered to initalise pin change and timer interrupts.  <br>
- * Finally it enables interrupt globally and invokes transportCacheArrayInit to initalise transport layer. 
+ * Finally it enables interrupt globally and invokes transportCacheArrayInit to initalise transport layer. If the stored operating mode is binary, the binary host protocol is started. In the benchmark build, a benchmark run is started. 
  * @brief This function initalises send and receiving pins and LED outputs. Also it configures the length of a time interrupt (i.e. Transmission speed). 
  */
 void generalInit()
@@ -68,102 +96,92 @@ void generalInit()
 	DDRC = 1 << DDC3;
     PORTC = 0;
     PORTD = 0;
-    bufferReceive.buffer = (unsigned char*)calloc(sizeof(unsigned char), 5);
+    bufferReceive.buffer = (unsigned char*)memoryCalloc(MEMORY_MAIN, sizeof(unsigned char), 5);
     uart_init();
 	stdin = &uart_input;
 	stdout = &uart_output;
-    printf("Please key in speed 1-5 one slowest\r\n");
-    char *speedBuffer = malloc(2);
-    speedBuffer[0] = getchar();
-    speedBuffer[1] = 0;
-    sendSpeed = strtol(speedBuffer, NULL, 0);
+    int storedMode = configLoad();
+    if (storedMode < 0) // no valid configuration in EEPROM
+    {
+        printf("Please key in speed 1-5 one slowest\r\n");
+        char *speedBuffer = memoryMalloc(MEMORY_MAIN, 2);
+        speedBuffer[0] = getchar();
+        speedBuffer[1] = 0;
+        sendSpeed = strtol(speedBuffer, NULL, 0);
+    }
+    else if (storedMode == MODE_CONSOLE)
+        printf("Configuration loaded: address %d speed %d\r\n", ADDRESS, sendSpeed);
     // Attention: Need connect PD0 to one of buffer and put jumper to relevant output pins
+    rateReset();
     interruptInit(sendSpeed);
     sei(); // enable Interrupt globally
     transportCacheArrayInit();
+    if (storedMode == MODE_BINARY)
+        hostlinkStart();
+#ifdef TRAFFIC_AT_BOOT
+    trafficStart(TRAFFIC_BOOT_ADDRESS, TRAFFIC_BOOT_PACKETS, TRAFFIC_BOOT_MIN_SIZE, TRAFFIC_BOOT_MAX_SIZE, TRAFFIC_BOOT_RATE, TRAFFIC_BOOT_DATAGRAM);
+#endif
 }
 
 /**
- * In a while loop, it processes: <br>
- * 1. User input for sending a message. Firstly the user should type the address of the receiver, and press ENTER. <br>
- * Then the user should type the message to send, and press ENTER. After that, initiateSend function on transport layer will be invoked to start the sending procedures. <br>
- * 2. If sendBackOff in sendDataNode has the value of 1, it will retry the invocation of prepareSendBit to send a bit again. <br>
- * 3. If writeBackOff in receiveDataNode has the value of 1, it will retry the invocation of writeByteToStruct to write a byte again. <br>
- * 4. If the period stamp has been updated, it will call periodClockUpdate to check if a sent message is timed out.
+ * In a while loop, it invokes schedulerRun, which runs the task of the highest priority that has been posted by an interrupt, or sleeps until the next interrupt: <br>
+ * 1. The receive task writes a received byte to the packet being received, and retries it if writing has backed off. <br>
+ * 2. The send task retries loading the next byte to send if loading has backed off. <br>
+ * 3. The timers task calls receiveWatchdog, ratePeriodUpdate, periodClockUpdate, streamPump, trafficPump and pingPump once per period. <br>
+ * 4. The UART task passes a received character to consoleReceiveChar, to hostlinkReceiveByte in binary operating mode, or to streamReceiveByte during a stream transfer. <br>
+ * 5. The stats task calls memoryCheck to check if stack and heap are about to meet. In the trace build, traceCheck dumps a triggered capture.
  * @brief This is the main function. It begins all initialisation processes and contains an infinite loop to process user inputs, missed inputs, and missed outputs
  */
 int main(void)
 {
     generalInit();
-    unsigned char *messageBuffer = malloc(128);
-    int index = 0;
-    int typeMessage = 0; // 0 is target address 1 is message
-    int address = 0;
-    int type = 0;
-	int inputMode = 0;
-	int clockComparator = globalPeriodStamp;
     while (1)
-    {		
-        if (UCSR0A >> 7) // check if data exists
-        {
-            unsigned char temp = getchar();
-            if (temp == '\r')
-            {
-                if (inputMode == 2) // when accepting message body
-                {
-                    messageBuffer[index++] = '\0';
-                    initiateSend(address, type, messageBuffer, index);
-                    messageBuffer = malloc(128), index = 0, inputMode = 0;
-                }
-                else if (inputMode == 1) // when accepting type of message (flag in transport layer)
-                {
-                    type = strtol(messageBuffer, NULL, 0);
-                    free(messageBuffer);
-                    messageBuffer = malloc(128), index = 0, inputMode = 2;
-                }
-                else // when accepting address of recipient
-                {
-                    address = strtol(messageBuffer, NULL, 0);
-                    free(messageBuffer);
-                    messageBuffer = malloc(128), index = 0, inputMode = 1;
-                }
-                
-            }
-            else if (temp == '\b') // Remove one character from buffer when "backspace" is taped
-            {
-                messageBuffer[index] = '\0';
-                if (index)
-                    index--;
-            }
-            else
-                messageBuffer[index++] = temp;
-        }
-        if (sendDataNode != NULL && sendDataNode->sendBackOff) // When send process fails to get a bit from sendDataNode to send
-        {
-            prepareSendBit();
-            sendDataNode->sendBackOff = 0;
-        }
-        if (receiveDataNode != NULL && (bufferReceive.writeToStructFlag || receiveDataNode->writeBackOff)) // When receive process fails to write the bit to receiveDataNode
-        {
-            writeByteToStruct();
-        }
-		if (globalPeriodStamp != clockComparator)
-		{
-			clockComparator = globalPeriodStamp;
-		    periodClockUpdate();
-		}
-    }
+        schedulerRun();
     return 0;
 }
 
 // Timer interrupt (Clock)
 ISR (TIMER1_COMPA_vect)
 {
+    PROFILE_BEGIN(PROFILE_TIMER_ISR);
     timeInterruptFunction();
+    PROFILE_END_OVERRUN(PROFILE_TIMER_ISR, (TIFR1 >> OCF1A) & 1); // next compare match has occurred before finishing
+}
+
+#ifdef PHY_HW_SHIFT
+// SPI serial transfer complete interrupt (Subject to byte clock of the master)
+ISR (SPI_STC_vect)
+{
+    PROFILE_BEGIN(PROFILE_PIN_ISR);
+    shiftInterruptFunction();
+    PROFILE_END_OVERRUN(PROFILE_PIN_ISR, (SPSR >> SPIF) & 1); // next byte has been shifted before finishing
 }
 
+#ifdef PHY_SHIFT_MASTER
+// Timer 2 interrupt (Byte clock)
+ISR (TIMER2_COMPA_vect)
+{
+    shiftByteClock();
+}
+#endif
+#else
 // Pin Change Interrupt (Subject to clock)
 ISR (PCINT2_vect)
 {
+    PROFILE_BEGIN(PROFILE_PIN_ISR);
     pinInterruptFunction();
+    PROFILE_END_OVERRUN(PROFILE_PIN_ISR, (PCIFR >> PCIF2) & 1); // next clock edge has arrived before finishing
+}
+#endif
+
+// UART receive complete interrupt
+ISR (USART_RX_vect)
+{
+    uartReceiveInterrupt();
 }
+
+// UART data register empty interrupt
+ISR (USART_UDRE_vect)
+{
+    uartTransmitInterrupt();
+}
\ No newline at end of file
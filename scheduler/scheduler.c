@@ -0,0 +1,298 @@
+/**
+ * @file scheduler.c
+ * @author David Ng 550084
+ * @brief This component runs the work of the main loop as prioritised tasks posted by interrupts, and lets the CPU sleep when there is none 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../console/console.h"
+#include "../memory/memory.h"
+#include "../hostlink/hostlink.h"
+#include "../layer4/stream.h"
+#include "../layer2/rate_limit.h"
+#include "../trace/trace.h"
+#include "../traffic/traffic.h"
+#include "../ping/ping.h"
+#include "scheduler.h"
+
+extern unsigned int globalPeriodStamp;
+extern int operatingMode;
+extern struct data_node *sendDataNode;
+extern struct data_node *receiveDataNode;
+extern struct receive_buffer bufferReceive;
+extern struct send_register sendRegister;
+#ifdef PROFILE_ISR
+extern unsigned char cyclesPerTick;
+#endif
+
+volatile unsigned char schedulerPending = 0; ///< This is the bitmap of posted tasks. Bit n stands for task n. 
+unsigned char schedulerRunning = 0; ///< This is the bitmap of running tasks, which nest when output runs the urgent tasks. Bit n stands for task n. 
+struct scheduler_entry schedulerEntries[SCHEDULER_TASKS]; ///< This is the run-time accounting, indexed by task. 
+unsigned long schedulerIdleTicks = 0; ///< This denotes how long the CPU has slept. 
+
+const char *schedulerNames[SCHEDULER_TASKS] = {"receive", "send", "timers", "uart", "stats"}; ///< These are the names of the tasks. 
+
+/**
+ * This can be invoked at interrupts as well as from tasks. A task posted several times before it runs is run once. 
+ * @brief This function posts a task to be run by the main loop. 
+ * @param task One of the SCHEDULER_TASK definitions. 
+ */
+void schedulerPost(unsigned char task)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        schedulerPending |= 1 << task;
+    }
+}
+
+/**
+ * If the compare match of Timer 1 is pending, TCNT1 has been cleared but globalPeriodStamp has not been incremented yet, so the period is counted here. 
+ * @brief This function takes the current time. 
+ * @param time The time to write. 
+ */
+void schedulerTime(struct scheduler_time *time)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        time->count = TCNT1;
+        time->periodStamp = globalPeriodStamp;
+        if ((TIFR1 >> OCF1A) & 1 && time->count < OCR1A / 2)
+            time->periodStamp++;
+    }
+}
+
+/**
+ * @brief This function calculates the ticks of Timer 1 elapsed since a time. It is correct on wrap around of globalPeriodStamp as well. 
+ * @param start The time taken before. 
+ * @return The elapsed ticks. 
+ */
+unsigned long schedulerElapsed(struct scheduler_time *start)
+{
+    struct scheduler_time now;
+    schedulerTime(&now);
+    return (unsigned long)(unsigned int)(now.periodStamp - start->periodStamp) * (OCR1A + 1) + now.count - start->count;
+}
+
+/**
+ * A byte is written only if writeToStructFlag is set or writing has backed off. If it backs off again, the task is posted again to retry. <br>
+ * In the hardware-shifted build, the task is posted again while bytes are waiting in the queue, whether the last one has been written or has backed off. 
+ * @brief This function is the task that writes a received byte to receiveDataNode. 
+ */
+void schedulerTaskReceive()
+{
+#ifdef PHY_HW_SHIFT
+    if (bufferReceive.writeToStructFlag)
+        writeByteToStruct();
+    if (bufferReceive.writeToStructFlag)
+        schedulerPost(SCHEDULER_TASK_RECEIVE);
+#else
+    if (receiveDataNode != NULL && (bufferReceive.writeToStructFlag || receiveDataNode->writeBackOff)) // When receive process fails to write the bit to receiveDataNode
+        writeByteToStruct();
+    if (receiveDataNode != NULL && receiveDataNode->writeBackOff)
+        schedulerPost(SCHEDULER_TASK_RECEIVE);
+#endif
+}
+
+/**
+ * The timer interrupt also retries at the next bit, so the byte is only loaded here if it has not done so yet. 
+ * @brief This function is the task that retries loading the next byte to send after it has backed off. 
+ */
+void schedulerTaskSend()
+{
+    ATOMIC_BLOCK(ATOMIC_FORCEON)
+    {
+        if (sendDataNode != NULL && sendDataNode->sendBackOff)
+        {
+            sendDataNode->sendBackOff = 0;
+            if (sendRegister.bitsLeft == 0) // timer interrupt has not retried yet
+                loadNextSendByte();
+        }
+    }
+}
+
+/**
+ * If several periods have passed since the task has run last, the work is done once, as before. 
+ * @brief This function is the task run at every period. It calls receiveWatchdog to abort a packet of which the reception has stalled, ratePeriodUpdate to refill the token bucket, periodClockUpdate to check if a sent message is timed out, streamPump to send buffered stream bytes, streamReceiveTimeoutCheck to end a received stream that has gone silent, trafficPump to send the next benchmark message, and pingPump to send the next ping probe. 
+ */
+void schedulerTaskTimers()
+{
+    receiveWatchdog();
+    ratePeriodUpdate();
+    periodClockUpdate();
+    streamPump();
+    streamReceiveTimeoutCheck();
+    trafficPump();
+    pingPump();
+    schedulerPost(SCHEDULER_TASK_STATS);
+}
+
+/**
+ * Only one byte is processed per run, so that received packets are processed between the bytes of a long input. 
+ * @brief This function is the task that passes a byte of UART input to consoleReceiveChar, to hostlinkReceiveByte in binary operating mode, or to streamReceiveByte during a stream transfer. 
+ */
+void schedulerTaskUart()
+{
+    int c = uartReadByte();
+    if (c < 0)
+        return;
+    if (operatingMode == MODE_BINARY)
+        hostlinkReceiveByte(c);
+    else if (operatingMode == MODE_STREAM)
+        streamReceiveByte(c);
+    else
+        consoleReceiveChar(c);
+    if (uartAvailable())
+        schedulerPost(SCHEDULER_TASK_UART);
+}
+
+/**
+ * @brief This function is the task that calls memoryCheck to check if stack and heap are about to meet. In the trace build, traceCheck dumps a triggered capture. 
+ */
+void schedulerTaskStats()
+{
+    memoryCheck();
+#ifdef TRACE_CAPTURE
+    traceCheck();
+#endif
+}
+
+/**
+ * @brief This function runs a task and accounts its run time. 
+ * @param task One of the SCHEDULER_TASK definitions. 
+ */
+void schedulerDispatch(unsigned char task)
+{
+    struct scheduler_time start;
+    schedulerTime(&start);
+    ATOMIC_BLOCK(ATOMIC_FORCEON)
+    {
+        schedulerPending &= ~(1 << task);
+    }
+    schedulerRunning |= 1 << task;
+    switch (task)
+    {
+        case SCHEDULER_TASK_RECEIVE:
+        schedulerTaskReceive();
+        break;
+        case SCHEDULER_TASK_SEND:
+        schedulerTaskSend();
+        break;
+        case SCHEDULER_TASK_TIMERS:
+        schedulerTaskTimers();
+        break;
+        case SCHEDULER_TASK_UART:
+        schedulerTaskUart();
+        break;
+        default:
+        schedulerTaskStats();
+        break;
+    }
+    schedulerRunning &= ~(1 << task);
+    unsigned long ticks = schedulerElapsed(&start);
+    struct scheduler_entry *entry = &schedulerEntries[task];
+    entry->runs++;
+    entry->ticks += ticks;
+    if (ticks > entry->maxTicks)
+        entry->maxTicks = ticks;
+}
+
+/**
+ * The posted task with the highest priority is run to completion, so that after every task the receive task is checked first again. <br>
+ * When no task is posted, the CPU sleeps in idle mode until the next interrupt. Interrupts are only enabled by the sleep instruction, so that a task posted in between is not missed. 
+ * @brief This function runs one task, or sleeps if there is none. It is invoked in the loop of the main function. 
+ */
+void schedulerRun()
+{
+    unsigned char pending = schedulerPending;
+    unsigned char task;
+    for (task = 0; task < SCHEDULER_TASKS; task++)
+    {
+        if (pending & 1 << task)
+        {
+            schedulerDispatch(task);
+            return;
+        }
+    }
+    struct scheduler_time start;
+    schedulerTime(&start);
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    if (!schedulerPending)
+    {
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+    sei();
+    schedulerIdleTicks += schedulerElapsed(&start);
+}
+
+/**
+ * This is invoked while output waits for space in the UART output buffer, so that received bytes are not lost behind console output. <br>
+ * Output while the receive or send task is running, e.g. debug output of receiveProcess, waits without running either of them, as they are not reentrant. 
+ * @brief This function runs the posted receive and send tasks. 
+ */
+void schedulerRunUrgent()
+{
+    if (schedulerRunning & (1 << SCHEDULER_TASK_RECEIVE | 1 << SCHEDULER_TASK_SEND))
+        return;
+    if (schedulerPending & 1 << SCHEDULER_TASK_RECEIVE)
+        schedulerDispatch(SCHEDULER_TASK_RECEIVE);
+    if (schedulerPending & 1 << SCHEDULER_TASK_SEND)
+        schedulerDispatch(SCHEDULER_TASK_SEND);
+}
+
+/**
+ * For each task, the number of runs, the total run time in milliseconds, the longest run in microseconds and the share of the measured time are printed, followed by the time slept. <br>
+ * A millisecond is 12000 cycles, i.e. 1500 ticks of 8 cycles. Totals are divided first, as they would overflow otherwise. 
+ * @brief This function prints the run-time accounting of all tasks. 
+ * @param reset A flag to denote whether the accounting is cleared after reading. 
+ */
+void schedulerPrint(int reset)
+{
+#ifdef PROFILE_ISR
+    unsigned int cycles = cyclesPerTick;
+#else
+    unsigned int cycles = 256; // prescaler of Timer 1
+#endif
+    unsigned long total = schedulerIdleTicks;
+    unsigned char i;
+    for (i = 0; i < SCHEDULER_TASKS; i++)
+        total += schedulerEntries[i].ticks;
+    total = total / 100 + 1; // ticks per percent
+    for (i = 0; i < SCHEDULER_TASKS; i++)
+        printf("%s: runs=%lu time=%lu ms max=%lu us share=%lu%%\r\n", schedulerNames[i], schedulerEntries[i].runs, schedulerEntries[i].ticks / 1500 * (cycles / 8), schedulerEntries[i].maxTicks * cycles / (F_CPU / 1000000), schedulerEntries[i].ticks / total);
+    printf("idle: time=%lu ms share=%lu%%\r\n", schedulerIdleTicks / 1500 * (cycles / 8), schedulerIdleTicks / total);
+    if (reset)
+    {
+        memset(schedulerEntries, 0, sizeof(schedulerEntries));
+        schedulerIdleTicks = 0;
+    }
+}
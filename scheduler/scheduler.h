@@ -0,0 +1,32 @@
+#define SCHEDULER_TASK_RECEIVE 0 ///< This denotes the task that writes a received byte to the packet being received, and thereby delivers complete frames to network layer. 
+#define SCHEDULER_TASK_SEND 1 ///< This denotes the task that retries loading a byte to send after it has backed off. 
+#define SCHEDULER_TASK_TIMERS 2 ///< This denotes the task run once per period: receive time-out, token bucket, retransmit timers, stream transfer and benchmark traffic. 
+#define SCHEDULER_TASK_UART 3 ///< This denotes the task that processes a byte of UART input for the console, the binary host protocol or a stream transfer. 
+#define SCHEDULER_TASK_STATS 4 ///< This denotes the task that checks stack and heap and dumps a triggered trace capture. 
+#define SCHEDULER_TASKS 5 ///< This denotes the number of tasks. A lower number is a higher priority. 
+
+//! This structure stores the run-time accounting of a task. 
+/**
+ * Time is measured in ticks of Timer 1 and converted to microseconds when printed. Interrupts that occur while a task runs are accounted to the task. 
+*/
+struct scheduler_entry
+{
+    unsigned long runs; ///< This denotes how many times the task has been run. 
+    unsigned long ticks; ///< This denotes the total run time of the task. 
+    unsigned long maxTicks; ///< This denotes the longest run of the task. 
+};
+
+//! This structure is a point in time as period stamp and counter of Timer 1. 
+struct scheduler_time
+{
+    unsigned int periodStamp; ///< This is globalPeriodStamp. 
+    unsigned int count; ///< This is TCNT1. 
+};
+
+void schedulerPost(unsigned char task);
+
+void schedulerRun();
+
+void schedulerRunUrgent();
+
+void schedulerPrint(int reset);
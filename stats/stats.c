@@ -0,0 +1,98 @@
+/**
+ * @file stats.c
+ * @author David Ng 550084
+ * @brief This component is responsible for maintaining runtime statistics and printing them to UART
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "stats.h"
+
+extern char __heap_start; ///< This is the start of heap, provided by the linker. 
+extern char *__brkval; ///< This is the current end of heap, maintained by malloc. 
+
+struct statistics stats; ///< This is the instance of statistics that is updated at the call sites in each layer. 
+
+/**
+ * Counters are copied with interrupts disabled, because some of them are incremented in interrupts. <br>
+ * If reset is set, all counters and queue peaks are cleared after copying, while the queue depths are kept. 
+ * @brief This function takes a consistent copy of the statistics. 
+ * @param copy The instance of statistics to copy into. 
+ * @param reset A flag to denote whether the counters are cleared after copying. 
+ */
+void statsSnapshot(struct statistics *copy, int reset)
+{
+    ATOMIC_BLOCK(ATOMIC_FORCEON)
+    {
+        *copy = stats;
+        if (reset)
+        {
+            unsigned char sendDepth = stats.sendQueueDepth, forwardDepth = stats.forwardQueueDepth;
+            memset(&stats, 0, sizeof(struct statistics));
+            stats.sendQueueDepth = stats.sendQueuePeak = sendDepth;
+            stats.forwardQueueDepth = stats.forwardQueuePeak = forwardDepth;
+        }
+    }
+    copy->heapUsed = __brkval ? __brkval - &__heap_start : 0;
+}
+
+/**
+ * @brief This function prints the statistics as text. 
+ * @param reset A flag to denote whether the counters are cleared after reading. 
+ */
+void statsPrintText(int reset)
+{
+    struct statistics copy;
+    statsSnapshot(&copy, reset);
+    printf("Queued: %u Sent: %u Received: %u Forwarded: %u\r\n", copy.framesQueued, copy.framesSent, copy.framesReceived, copy.framesForwarded);
+    printf("CRC failures: %u Header CRC failures: %u\r\n", copy.crcFailures, copy.headerCrcFailures);
+    printf("Retransmits: %u Failed sends: %u ACKs: %u Port refusals: %u\r\n", copy.retransmits, copy.failedSends, copy.acksReceived, copy.portRefusals);
+    printf("Send back-offs: %u Write back-offs: %u\r\n", copy.sendBackOffs, copy.writeBackOffs);
+    printf("Memory warnings: %u\r\n", copy.memoryWarnings);
+    printf("Receive time-outs: %u Length aborts: %u Queue drops: %u Rate cuts: %u Preemptions: %u Overruns: %u\r\n", copy.receiveTimeouts, copy.lengthAborts, copy.queueDrops, copy.rateCuts, copy.preemptions, copy.receiveOverruns);
+    printf("Receive out of memory: %u\r\n", copy.receiveNoMemory);
+    printf("Send queue: %u (peak %u) Forward queue: %u (peak %u)\r\n", copy.sendQueueDepth, copy.sendQueuePeak, copy.forwardQueueDepth, copy.forwardQueuePeak);
+    printf("Heap used: %u\r\n", copy.heapUsed);
+}
+
+/**
+ * The snapshot is printed as STATS_BINARY_MARKER, the size of the statistics struct, the struct in little endian, and a CRC-8 over the struct. 
+ * @brief This function prints the statistics as a compact binary snapshot. 
+ * @param reset A flag to denote whether the counters are cleared after reading. 
+ */
+void statsPrintBinary(int reset)
+{
+    struct statistics copy;
+    statsSnapshot(&copy, reset);
+    unsigned char *raw = (unsigned char*)&copy;
+    putchar(STATS_BINARY_MARKER);
+    putchar(sizeof(struct statistics));
+    unsigned int i;
+    for (i = 0; i < sizeof(struct statistics); i++)
+        putchar(raw[i]);
+    putchar(calculateCRC8(raw, sizeof(struct statistics)));
+}
@@ -0,0 +1,44 @@
+//! This structure stores the runtime statistics of this device. 
+/**
+ * All counters are 16-bit and wrap around on overflow, reset-on-read can be used to keep them in range. <br>
+ * Several counters are incremented both in interrupts and in the main loop, so statIncrement increments with interrupts disabled, as a 16-bit increment takes several instructions on AVR. <br>
+ * The queue depths are gauges and are not cleared on reset, while their peaks are. heapUsed is only filled when a snapshot is taken. 
+*/
+struct statistics
+{
+    uint16_t framesQueued; ///< This denotes the number of packets originated by this device and pushed to send queue. 
+    uint16_t framesSent; ///< This denotes the number of packets completely sent, including forwarded packets. 
+    uint16_t framesReceived; ///< This denotes the number of packets completely received for reading. 
+    uint16_t framesForwarded; ///< This denotes the number of packets pushed to forward queue. 
+    uint16_t crcFailures; ///< This denotes the number of received packets of which the CRC32 does not match. 
+    uint16_t headerCrcFailures; ///< This denotes the number of packets dropped because the header CRC-8 does not match. 
+    uint16_t retransmits; ///< This denotes the number of messages sent again after time-out. 
+    uint16_t failedSends; ///< This denotes the number of messages returned because the recipient does not exist. 
+    uint16_t acksReceived; ///< This denotes the number of ACK messages received. 
+    uint16_t sendBackOffs; ///< This denotes the number of times a send method has failed to get the mutex. 
+    uint16_t writeBackOffs; ///< This denotes the number of times a receive method has failed to get the mutex. 
+    uint16_t memoryWarnings; ///< This denotes the number of times the stack has come close to heap. 
+    uint16_t receiveTimeouts; ///< This denotes the number of packets aborted because no bit or byte has arrived in time. 
+    uint16_t lengthAborts; ///< This denotes the number of packets aborted because their length is out of the accepted range. 
+    uint16_t queueDrops; ///< This denotes the number of packets dropped because send or forward queue has reached its limit. 
+    uint16_t preemptions; ///< This denotes the number of packets paused for an urgent packet. 
+    uint16_t rateCuts; ///< This denotes the number of times the rate has been cut in AIMD mode. 
+    uint16_t portRefusals; ///< This denotes the number of received messages refused by a full inbox or a receive handler. 
+    uint16_t receiveOverruns; ///< This denotes the number of bytes lost by the hardware-shifted physical layer because the receive queue was full. 
+    uint16_t receiveNoMemory; ///< This denotes the number of packets not received because memory for them could not be allocated. 
+    uint16_t heapUsed; ///< This denotes the heap usage in bytes at the time of the snapshot. 
+    uint8_t sendQueueDepth; ///< This denotes the number of packets in sendDataQueue. 
+    uint8_t forwardQueueDepth; ///< This denotes the number of packets in forwardDataQueue. 
+    uint8_t sendQueuePeak; ///< This denotes the highest depth of sendDataQueue since last reset. 
+    uint8_t forwardQueuePeak; ///< This denotes the highest depth of forwardDataQueue since last reset. 
+};
+
+#define STATS_BINARY_MARKER 0xA5 ///< This is the first byte of a binary statistics snapshot. 
+
+#define statIncrement(counter) ATOMIC_BLOCK(ATOMIC_RESTORESTATE) stats.counter++ ///< This increments a counter in stats, so that an interrupt cannot lose the increment of the main loop or the other way round. 
+
+void statsSnapshot(struct statistics *copy, int reset);
+
+void statsPrintText(int reset);
+
+void statsPrintBinary(int reset);
@@ -0,0 +1,182 @@
+/**
+ * @file trace.c
+ * @author David Ng 550084
+ * @brief This component is responsible for capturing received and sent bits with their period stamps in the trace build 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../hostlink/hostlink.h"
+#include "trace.h"
+
+#ifdef TRACE_CAPTURE
+
+extern unsigned int globalPeriodStamp;
+extern int sendSpeed;
+extern int operatingMode;
+
+struct trace_entry traceRing[TRACE_ENTRIES]; ///< This is the ring of trace entries. 
+struct trace_channel traceChannels[2] = {{0, 0, TRACE_ENTRIES}, {0, 0, TRACE_ENTRIES}}; ///< These collect the bits of received and sent bytes, indexed by channel. 
+unsigned char traceHead = 0; ///< This is the slot to which the next entry is written. 
+unsigned char traceCount = 0; ///< This denotes how many entries of the ring are used. 
+unsigned char traceReason = TRACE_TRIGGER_NONE; ///< This is the reason of the first trigger since the capture has been armed. 
+unsigned char tracePostTrigger = 0; ///< This denotes how many entries are still written after the trigger. 
+unsigned char traceStopped = 0; ///< This flag denotes that no more entries are written. 
+unsigned char traceDumped = 0; ///< This flag denotes that the stopped capture has been dumped. 
+
+/**
+ * If the entry overwrites the current run of bytes of 0 of a channel, the run is ended, so that the next byte of 0 starts a new entry. <br>
+ * After a trigger, the capture is stopped when the entries after the trigger have been written. 
+ * @brief This function writes an entry to the trace ring. It is only invoked at interrupts or with interrupts disabled. 
+ * @param kind The kind of the entry. 
+ * @param data The data of the entry. 
+ * @return The slot of the entry. 
+ */
+unsigned char traceWrite(unsigned char kind, unsigned char data)
+{
+    unsigned char slot = traceHead;
+    traceHead = (traceHead + 1) & (TRACE_ENTRIES - 1);
+    if (traceCount < TRACE_ENTRIES)
+        traceCount++;
+    if (traceChannels[TRACE_RX].idleSlot == slot)
+        traceChannels[TRACE_RX].idleSlot = TRACE_ENTRIES;
+    if (traceChannels[TRACE_TX].idleSlot == slot)
+        traceChannels[TRACE_TX].idleSlot = TRACE_ENTRIES;
+    traceRing[slot].periodStamp = globalPeriodStamp;
+    traceRing[slot].kind = kind;
+    traceRing[slot].data = data;
+    if (traceReason != TRACE_TRIGGER_NONE && --tracePostTrigger == 0)
+        traceStopped = 1;
+    return slot;
+}
+
+/**
+ * The bit is shifted into the byte of its channel. Only a complete byte is written to the ring, so that the cost of most bits is a shift and an increment. <br>
+ * A byte of 0, i.e. an idle line, extends the current run of its channel instead of taking a new entry, up to 255 bytes. 
+ * @brief This function records a received or sent bit. It is invoked at pin change interrupt for received bits and at timer interrupt for sent bits. 
+ * @param channel TRACE_RX or TRACE_TX. 
+ * @param bit The bit. 
+ */
+void traceBit(unsigned char channel, unsigned char bit)
+{
+    if (traceStopped)
+        return;
+    struct trace_channel *current = &traceChannels[channel];
+    current->bits = current->bits << 1 | bit;
+    if (++current->count < 8)
+        return;
+    current->count = 0;
+    if (current->bits)
+    {
+        traceWrite(TRACE_KIND_BITS + channel, current->bits);
+        current->idleSlot = TRACE_ENTRIES;
+    }
+    else if (current->idleSlot != TRACE_ENTRIES && traceRing[current->idleSlot].data != 0xFF)
+    {
+        traceRing[current->idleSlot].data++;
+        traceRing[current->idleSlot].periodStamp = globalPeriodStamp;
+    }
+    else
+        current->idleSlot = traceWrite(TRACE_KIND_IDLE + channel, 1);
+}
+
+/**
+ * Only the first trigger since the capture has been armed is recorded. The capture goes on for half of the ring, so that the dump shows what has happened before and after the trigger. 
+ * @brief This function triggers the capture. 
+ * @param reason One of the TRACE_TRIGGER definitions. 
+ */
+void traceTrigger(unsigned char reason)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (traceReason == TRACE_TRIGGER_NONE && !traceStopped)
+        {
+            traceReason = reason;
+            tracePostTrigger = TRACE_ENTRIES / 2;
+            traceWrite(TRACE_KIND_TRIGGER, reason);
+        }
+    }
+}
+
+/**
+ * In binary operating mode the dump would break the host frames, so it waits until the console is back. 
+ * @brief This function dumps the capture once it has stopped after a trigger. It is invoked once per period from the main loop. 
+ */
+void traceCheck()
+{
+    if (traceStopped && !traceDumped && operatingMode == MODE_CONSOLE)
+        traceDump(0);
+}
+
+/**
+ * The dump is printed as TRACE_DUMP_MARKER, TRACE_DUMP_VERSION, speed, trigger reason, number of entries, the entries from oldest to newest as period stamp in little endian, kind and data, and a CRC-8 over all bytes after the marker. <br>
+ * The capture is stopped while dumping, and goes on afterwards unless it has stopped after a trigger. 
+ * @brief This function prints the trace ring as binary dump. 
+ * @param rearm A flag to denote whether the ring is cleared and the capture is armed again after dumping. 
+ */
+void traceDump(int rearm)
+{
+    unsigned char wasStopped;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        wasStopped = traceStopped;
+        traceStopped = 1;
+    }
+    unsigned char head[4] = {TRACE_DUMP_VERSION, sendSpeed, traceReason, traceCount};
+    unsigned char crc = 0;
+    unsigned char i, j;
+    putchar(TRACE_DUMP_MARKER);
+    for (i = 0; i < 4; i++)
+    {
+        putchar(head[i]);
+        crc = calculateCRC8Update(crc, head[i]);
+    }
+    for (i = 0; i < traceCount; i++)
+    {
+        struct trace_entry *entry = &traceRing[(traceHead - traceCount + i) & (TRACE_ENTRIES - 1)];
+        unsigned char raw[4] = {entry->periodStamp & 0xFF, entry->periodStamp >> 8, entry->kind, entry->data};
+        for (j = 0; j < 4; j++)
+        {
+            putchar(raw[j]);
+            crc = calculateCRC8Update(crc, raw[j]);
+        }
+    }
+    putchar(crc);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (rearm)
+        {
+            traceHead = traceCount = tracePostTrigger = traceDumped = 0;
+            traceReason = TRACE_TRIGGER_NONE;
+            traceChannels[TRACE_RX].idleSlot = traceChannels[TRACE_TX].idleSlot = TRACE_ENTRIES;
+            traceStopped = 0;
+        }
+        else
+            traceStopped = traceDumped = wasStopped;
+    }
+}
+
+#endif
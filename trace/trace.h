@@ -0,0 +1,56 @@
+#ifndef TRACE_ENTRIES
+#define TRACE_ENTRIES 64 ///< This denotes how many entries the trace ring holds, 4 bytes each. It must be a power of 2 up to 128, e.g. -DTRACE_ENTRIES=128. 
+#endif
+
+#define TRACE_RX 0 ///< This denotes the channel of received bits. 
+#define TRACE_TX 1 ///< This denotes the channel of sent bits. 
+
+#define TRACE_KIND_BITS 0 ///< Entry kind of 8 bits of a channel, highest bit first. The kind is added to the channel. 
+#define TRACE_KIND_IDLE 2 ///< Entry kind of a run of bytes of 0 of a channel, data is the number of bytes. The kind is added to the channel. 
+#define TRACE_KIND_TRIGGER 4 ///< Entry kind of a trigger, data is one of the TRACE_TRIGGER definitions. 
+
+#define TRACE_TRIGGER_NONE 0 ///< This denotes that the capture has not been triggered. 
+#define TRACE_TRIGGER_MANUAL 1 ///< This denotes a trigger by the console command. 
+#define TRACE_TRIGGER_HEADER_CRC 2 ///< This denotes a trigger by a header CRC-8 that does not match. 
+#define TRACE_TRIGGER_CRC 3 ///< This denotes a trigger by a CRC32 that does not match. 
+#define TRACE_TRIGGER_LENGTH 4 ///< This denotes a trigger by a length out of range. 
+#define TRACE_TRIGGER_TIMEOUT 5 ///< This denotes a trigger by a receive time-out. 
+
+#define TRACE_DUMP_MARKER 0xA7 ///< This is the first byte of a trace dump. 
+#define TRACE_DUMP_VERSION 1 ///< This is the version of the layout of a trace dump. 
+
+#ifdef TRACE_CAPTURE
+#define TRACE_BIT(channel, bit) traceBit(channel, bit) ///< This records a received or sent bit. 
+#define TRACE_TRIGGER(reason) traceTrigger(reason) ///< This triggers the capture, which stops after half of the ring has been written. 
+#else
+#define TRACE_BIT(channel, bit)
+#define TRACE_TRIGGER(reason)
+#endif
+
+//! This structure is an entry of the trace ring.
+/**
+ * The period stamp is the lower 16 bits of globalPeriodStamp when the last bit of the entry has been recorded. <br>
+ * The decoder spreads the bits of an entry backwards over the periods before its stamp, as one bit is sent or received per period. 
+*/
+struct trace_entry
+{
+    uint16_t periodStamp; ///< This is the period stamp of the last bit of the entry. 
+    uint8_t kind; ///< This is the kind of entry, one of the TRACE_KIND definitions plus the channel. 
+    uint8_t data; ///< This is the 8 bits, the number of bytes of 0, or the trigger reason. 
+};
+
+//! This structure collects the bits of a channel until a byte is complete.
+struct trace_channel
+{
+    uint8_t bits; ///< This is the shift register of the bits of the byte being collected. 
+    uint8_t count; ///< This denotes how many bits have been collected. 
+    uint8_t idleSlot; ///< This is the slot of the entry of the current run of bytes of 0, or TRACE_ENTRIES if there is none. 
+};
+
+void traceBit(unsigned char channel, unsigned char bit);
+
+void traceTrigger(unsigned char reason);
+
+void traceCheck();
+
+void traceDump(int rearm);
@@ -0,0 +1,232 @@
+/**
+ * @file traffic.c
+ * @author David Ng 550084
+ * @brief This component generates benchmark traffic through transport layer and reports goodput, frame rate, errors and latency of the run 
+ * @date 2020-02-20
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#define F_CPU 12000000UL
+#define BAUD 9600
+#define MYUBRR F_CPU/16/BAUD-1
+
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include <util/setbaud.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+#include "../layer2/data_struct.h"
+#include "../uart/uart_init.h"
+#include "../layer4/transport.h"
+#include "../irq/clock_init.h"
+#include "../layer3/network.h"
+#include "../crc/crc.h"
+#include "../layer2/data_link.h"
+#include "../irq/interrupt_handler.h"
+#include "../layer1/physical.h"
+#include "../stats/stats.h"
+#include "../memory/memory.h"
+#include "../layer4/transport_struct.h"
+#include "../layer2/rate_limit.h"
+#include "traffic.h"
+
+extern int ADDRESS;
+extern unsigned int msgWaitingPeriod;
+extern unsigned int globalPeriodStamp;
+extern struct statistics stats;
+
+struct traffic_run trafficRun; ///< This is the current or last benchmark run. 
+uint16_t trafficReceivedPackets = 0; ///< This denotes how many generated messages of other nodes have been received. 
+unsigned long trafficReceivedBytes = 0; ///< This denotes the bytes of generated messages of other nodes received. 
+
+/**
+ * @brief This function draws the size of the next message between minSize and maxSize with a 16 bit xorshift, which is the same for every run with the same settings. 
+ */
+void trafficNextSize()
+{
+    uint16_t x = trafficRun.random;
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+    trafficRun.random = x;
+    trafficRun.nextSize = trafficRun.minSize + x % (trafficRun.maxSize - trafficRun.minSize + 1);
+}
+
+/**
+ * Sizes are limited to TRAFFIC_HEADER to TRANSPORT_MAX_SEGMENT bytes, so that no message is fragmented. Broadcast and multicast runs always send datagrams. <br>
+ * The counters of stats are kept, so that the errors during the run are reported as differences. 
+ * @brief This function starts a benchmark run. 
+ * @param address The destination, 0 for broadcast or the own address for loopback. 
+ * @param packets The number of messages to send. 
+ * @param minSize The shortest message. 
+ * @param maxSize The longest message, equal to minSize for a fixed size. 
+ * @param rate The rate in bytes per second, 0 for saturating. 
+ * @param datagram A flag to denote that datagrams are sent instead of messages that need ACK. 
+ */
+void trafficStart(int address, unsigned int packets, int minSize, int maxSize, unsigned int rate, unsigned char datagram)
+{
+    if (trafficRun.active)
+    {
+        printf("A benchmark is running\r\n");
+        return;
+    }
+    if (address < 0 || address > 255 || packets == 0 || minSize < TRAFFIC_HEADER || maxSize < minSize || maxSize > TRANSPORT_MAX_SEGMENT)
+    {
+        printf("Usage: /bench <address> <packets> <size>[-<max size>] [<bytes per second>] [d]\r\n");
+        return;
+    }
+    memset(&trafficRun, 0, sizeof(trafficRun));
+    trafficRun.address = address;
+    trafficRun.packets = packets;
+    trafficRun.minSize = minSize;
+    trafficRun.maxSize = maxSize;
+    trafficRun.rate = rate;
+    trafficRun.datagram = datagram || !address || isMulticast(address); // broadcast and multicast are not acknowledged
+    trafficRun.random = TRAFFIC_SEED;
+    trafficRun.latencyMin = 0xFFFF;
+    trafficRun.startPeriodStamp = trafficRun.lastPeriodStamp = globalPeriodStamp;
+    trafficRun.framesSent = stats.framesSent;
+    trafficRun.crcFailures = stats.crcFailures + stats.headerCrcFailures;
+    trafficRun.retransmits = stats.retransmits;
+    trafficNextSize();
+    trafficRun.active = 1;
+    printf("Benchmark: %u packets of %d-%d bytes to %d\r\n", packets, minSize, maxSize, address);
+}
+
+/**
+ * @brief This function tells whether every sent message has been delivered or returned, so that the run can end. 
+ * @return Whether no more deliveries are expected. 
+ */
+unsigned char trafficComplete()
+{
+    if (trafficRun.datagram && trafficRun.address && trafficRun.address != ADDRESS) // datagrams to another node are not reported back
+        return stats.sendQueueDepth == 0;
+    return trafficRun.delivered + trafficRun.failed == trafficRun.sent;
+}
+
+/**
+ * A rate-limited run earns rate bytes times periods per second at every period, and sends a message when it has earned its size. <br>
+ * A saturating run sends a message whenever send queue holds less than TRAFFIC_QUEUE_DEPTH packets, so that the line never idles. <br>
+ * A refused message is tried again at the next period. After the last message, the run ends when every message is delivered or after msgWaitingPeriod, and the results are printed. 
+ * @brief This function sends the next message of the benchmark run. It is invoked once per period by the timers task. 
+ */
+void trafficPump()
+{
+    if (!trafficRun.active)
+        return;
+    if (trafficRun.sent == trafficRun.packets)
+    {
+        if (trafficComplete() || periodDiffCalculator(trafficRun.lastPeriodStamp) >= msgWaitingPeriod)
+        {
+            trafficRun.active = 0;
+            trafficReport();
+        }
+        return;
+    }
+    unsigned char size = trafficRun.nextSize;
+    unsigned long cost = (unsigned long)size * ratePeriodsPerSecond();
+    if (trafficRun.rate)
+    {
+        if (trafficRun.budget < cost)
+            trafficRun.budget += trafficRun.rate;
+        if (trafficRun.budget < cost)
+            return;
+    }
+    else if (stats.sendQueueDepth >= TRAFFIC_QUEUE_DEPTH)
+        return;
+    unsigned char *message = memoryMalloc(MEMORY_MAIN, size);
+    if (message == NULL)
+        return;
+    message[0] = globalPeriodStamp & 0xFF;
+    message[1] = globalPeriodStamp >> 8;
+    message[2] = size;
+    memset(message + TRAFFIC_HEADER, trafficRun.sent & 0xFF, size - TRAFFIC_HEADER);
+    int id = initiateSend(trafficRun.address, trafficRun.datagram ? TRANSPORT_FLAG_BENCH_DATAGRAM : TRANSPORT_FLAG_BENCH, message, size);
+    if (id < 0)
+    {
+        memoryFree(message);
+        trafficRun.refused++;
+        return;
+    }
+    if (trafficRun.rate)
+        trafficRun.budget -= cost;
+    trafficRun.sent++;
+    trafficRun.sentBytes += size;
+    trafficRun.lastPeriodStamp = globalPeriodStamp;
+    trafficNextSize();
+}
+
+/**
+ * @brief This function records the delivery of a generated message. 
+ * @param message The message, which starts with the period stamp of sending and its length. 
+ */
+void trafficDelivered(unsigned char *message)
+{
+    if (!trafficRun.active)
+        return;
+    unsigned int latency = globalPeriodStamp - (message[0] | message[1] << 8);
+    trafficRun.delivered++;
+    trafficRun.deliveredBytes += message[2];
+    trafficRun.latencySum += latency;
+    if (latency < trafficRun.latencyMin)
+        trafficRun.latencyMin = latency;
+    if (latency > trafficRun.latencyMax)
+        trafficRun.latencyMax = latency;
+    trafficRun.lastPeriodStamp = globalPeriodStamp;
+}
+
+/**
+ * @brief This function records a generated message returned because its destination does not exist. 
+ */
+void trafficFailed()
+{
+    if (!trafficRun.active)
+        return;
+    trafficRun.failed++;
+    trafficRun.lastPeriodStamp = globalPeriodStamp;
+}
+
+/**
+ * @brief This function counts a generated message of another node received by this device. 
+ * @param length The length of the message. 
+ */
+void trafficReceived(int length)
+{
+    trafficReceivedPackets++;
+    trafficReceivedBytes += length;
+}
+
+/**
+ * The duration is measured from the start of the run to the last message sent or delivered. Time is converted from periods to milliseconds at the current speed. <br>
+ * Offered load counts the bytes of messages sent, goodput the bytes of messages delivered. Frames include ACK and forwarded packets. 
+ * @brief This function prints the results of the current or last benchmark run, and the generated messages received from other nodes. 
+ */
+void trafficReport()
+{
+    unsigned long periodsPerSecond = ratePeriodsPerSecond();
+    unsigned long ms = (unsigned long)(unsigned int)(trafficRun.lastPeriodStamp - trafficRun.startPeriodStamp) * 1000 / periodsPerSecond;
+    unsigned long divisor = ms ? ms : 1;
+    printf("Benchmark to %d%s: sent %u of %u, delivered %u, failed %u, refused %u, in %lu ms\r\n", trafficRun.address, trafficRun.active ? " (running)" : "", trafficRun.sent, trafficRun.packets, trafficRun.delivered, trafficRun.failed, trafficRun.refused, ms);
+    printf("Offered %lu B/s, goodput %lu B/s, %lu frames/s, CRC failures %u, retransmits %u\r\n", trafficRun.sentBytes * 1000 / divisor, trafficRun.deliveredBytes * 1000 / divisor, (unsigned long)(uint16_t)(stats.framesSent - trafficRun.framesSent) * 1000 / divisor, (uint16_t)(stats.crcFailures + stats.headerCrcFailures - trafficRun.crcFailures), (uint16_t)(stats.retransmits - trafficRun.retransmits));
+    if (trafficRun.delivered)
+        printf("Latency min %lu avg %lu max %lu ms\r\n", trafficRun.latencyMin * 1000UL / periodsPerSecond, trafficRun.latencySum / trafficRun.delivered * 1000 / periodsPerSecond, trafficRun.latencyMax * 1000UL / periodsPerSecond);
+    if (trafficReceivedPackets)
+        printf("Received %u packets, %lu bytes of other benchmarks\r\n", trafficReceivedPackets, trafficReceivedBytes);
+}
+
+/**
+ * @brief This function ends the benchmark run and prints its results so far. Messages waiting for ACK are still sent again until acknowledged. 
+ */
+void trafficStop()
+{
+    if (!trafficRun.active)
+        return;
+    trafficRun.active = 0;
+    trafficReport();
+}
@@ -0,0 +1,71 @@
+#define TRAFFIC_HEADER 3 ///< This denotes the bytes in front of every generated message: the period stamp of sending in little endian and the length of the message. 
+#define TRAFFIC_QUEUE_DEPTH 2 ///< This denotes how many packets a saturating run keeps in send queue. 
+#define TRAFFIC_SEED 0xACE1 ///< This is the seed of the random sizes, so that every run with the same settings generates the same sizes. 
+
+#ifdef TRAFFIC_AT_BOOT
+#ifndef TRAFFIC_BOOT_ADDRESS
+#define TRAFFIC_BOOT_ADDRESS ADDRESS ///< This is the destination of the run started at boot. The own address loops the packets back. 
+#endif
+#ifndef TRAFFIC_BOOT_PACKETS
+#define TRAFFIC_BOOT_PACKETS 20 ///< This denotes how many packets the run started at boot sends. 
+#endif
+#ifndef TRAFFIC_BOOT_MIN_SIZE
+#define TRAFFIC_BOOT_MIN_SIZE 8 ///< This denotes the shortest message of the run started at boot. 
+#endif
+#ifndef TRAFFIC_BOOT_MAX_SIZE
+#define TRAFFIC_BOOT_MAX_SIZE 32 ///< This denotes the longest message of the run started at boot. 
+#endif
+#ifndef TRAFFIC_BOOT_RATE
+#define TRAFFIC_BOOT_RATE 0 ///< This denotes the rate of the run started at boot in bytes per second, 0 for saturating. 
+#endif
+#ifndef TRAFFIC_BOOT_DATAGRAM
+#define TRAFFIC_BOOT_DATAGRAM 0 ///< This flag denotes that the run started at boot sends datagrams instead of messages that need ACK. 
+#endif
+#endif
+
+//! This structure stores the settings and results of a benchmark run. 
+/**
+ * A message is delivered when it is acknowledged, when a broadcast returns, or in loopback, i.e. to the own address, when it returns. <br>
+ * Latency is measured from the period stamp in the message to its delivery, so it is a round trip for acknowledged messages and a trip around the ring for broadcasts. 
+*/
+struct traffic_run
+{
+    uint8_t active; ///< This flag denotes that the run is going on. 
+    uint8_t address; ///< This is the destination, 0 for broadcast. 
+    uint8_t datagram; ///< This flag denotes that datagrams are sent instead of messages that need ACK. 
+    uint8_t minSize; ///< This denotes the shortest message. 
+    uint8_t maxSize; ///< This denotes the longest message. Sizes are drawn at random between both. 
+    uint8_t nextSize; ///< This denotes the size of the next message. 
+    uint16_t random; ///< This is the state of the random sizes. 
+    uint16_t rate; ///< This denotes the rate in bytes per second, 0 for saturating. 
+    uint16_t packets; ///< This denotes how many messages are sent. 
+    uint16_t sent; ///< This denotes how many messages have been sent. 
+    uint16_t delivered; ///< This denotes how many messages have been delivered. 
+    uint16_t failed; ///< This denotes how many messages have been returned because the destination does not exist. 
+    uint16_t refused; ///< This denotes how many times initiateSend has refused a message, which is tried again at the next period. 
+    unsigned long budget; ///< This is the sending budget of a rate-limited run, in bytes times periods per second. 
+    unsigned long sentBytes; ///< This denotes the bytes of messages sent. 
+    unsigned long deliveredBytes; ///< This denotes the bytes of messages delivered. 
+    unsigned long latencySum; ///< This is the sum of the latencies of delivered messages in periods. 
+    unsigned int latencyMin; ///< This is the shortest latency in periods. 
+    unsigned int latencyMax; ///< This is the longest latency in periods. 
+    unsigned int startPeriodStamp; ///< This is the period stamp at the start of the run. 
+    unsigned int lastPeriodStamp; ///< This is the period stamp of the last message sent or delivered. 
+    uint16_t framesSent; ///< This is stats.framesSent at the start of the run. 
+    uint16_t crcFailures; ///< This is the sum of CRC and header CRC failures at the start of the run. 
+    uint16_t retransmits; ///< This is stats.retransmits at the start of the run. 
+};
+
+void trafficStart(int address, unsigned int packets, int minSize, int maxSize, unsigned int rate, unsigned char datagram);
+
+void trafficPump();
+
+void trafficDelivered(unsigned char *message);
+
+void trafficFailed();
+
+void trafficReceived(int length);
+
+void trafficReport();
+
+void trafficStop();
@@ -29,30 +29,129 @@
 #include "../layer2/data_link.h"
 #include "../irq/interrupt_handler.h"
 #include "../layer1/physical.h"
+#include "../scheduler/scheduler.h"
 
-extern const int ADDRESS;
+extern int ADDRESS;
+
+unsigned char uartTextOutput = 1; ///< This flag denotes whether printf output is written to UART. It is cleared in binary operating mode, so that text does not corrupt frames. 
+unsigned char uartTxBuffer[UART_TX_BUFFER]; ///< This is the ring of bytes waiting to be written to UART. 
+volatile unsigned char uartTxHead = 0, uartTxTail = 0; ///< These are the next slot to fill and the next slot to write of uartTxBuffer. 
+unsigned char uartRxBuffer[UART_RX_BUFFER]; ///< This is the ring of bytes received from UART and not processed yet. 
+volatile unsigned char uartRxHead = 0, uartRxTail = 0; ///< These are the next slot to fill and the next slot to read of uartRxBuffer. 
 
 /**
  * @brief This function forwards STDIO input to UART send function and invoked whenever a bit is written to printf. 
+ * The character is dropped when uartTextOutput is cleared. 
  * @param c The character to be sent to rasperrypi. 
  * @param stream The STDIO stream. 
 */
 void uart_putchar(char c, FILE *stream) 
 {
-    loop_until_bit_is_set(UCSR0A, UDRE0);
-    UDR0 = c;
+    if (uartTextOutput)
+        uart_write(c);
+}
+
+/**
+ * @brief This function writes a byte to UART regardless of uartTextOutput. 
+ * The byte is put into uartTxBuffer and written by the data register empty interrupt, so that output does not hold up the main loop. <br>
+ * While the buffer is full, the posted receive and send tasks are run. If interrupts are disabled, the buffer is written by polling instead. 
+ * @param c The byte to be sent to rasperrypi. 
+*/
+void uart_write(unsigned char c) 
+{
+    while (1)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            unsigned char next = (uartTxHead + 1) & (UART_TX_BUFFER - 1);
+            if (next != uartTxTail) // space left
+            {
+                uartTxBuffer[uartTxHead] = c;
+                uartTxHead = next;
+                UCSR0B |= _BV(UDRIE0);
+                return;
+            }
+        }
+        if (SREG & _BV(SREG_I))
+            schedulerRunUrgent();
+        else if (bit_is_set(UCSR0A, UDRE0)) // at interrupt, the data register empty interrupt cannot run
+            uartTransmitInterrupt();
+    }
+}
+
+/**
+ * @brief This function writes the next byte of uartTxBuffer to UART. It is invoked at data register empty interrupt. 
+ * When the buffer is empty, the interrupt is disabled until the next byte is written. 
+*/
+void uartTransmitInterrupt()
+{
+    if (uartTxHead == uartTxTail)
+    {
+        UCSR0B &= ~_BV(UDRIE0);
+        return;
+    }
+    UDR0 = uartTxBuffer[uartTxTail];
+    uartTxTail = (uartTxTail + 1) & (UART_TX_BUFFER - 1);
+}
+
+/**
+ * @brief This function stores a byte received from UART in uartRxBuffer and posts the UART task. It is invoked at receive complete interrupt. 
+ * The byte is dropped when the buffer is full. 
+*/
+void uartReceiveInterrupt()
+{
+    unsigned char c = UDR0;
+    unsigned char next = (uartRxHead + 1) & (UART_RX_BUFFER - 1);
+    if (next != uartRxTail)
+    {
+        uartRxBuffer[uartRxHead] = c;
+        uartRxHead = next;
+    }
+    schedulerPost(SCHEDULER_TASK_UART);
+}
+
+/**
+ * @brief This function checks whether uartRxBuffer holds a byte. 
+ * @return Whether a byte can be read. 
+*/
+unsigned char uartAvailable()
+{
+    return uartRxHead != uartRxTail;
+}
+
+/**
+ * @brief This function takes the next byte from uartRxBuffer. 
+ * @return The byte, or -1 if there is none. 
+*/
+int uartReadByte()
+{
+    if (uartRxHead == uartRxTail)
+        return -1;
+    unsigned char c = uartRxBuffer[uartRxTail];
+    uartRxTail = (uartRxTail + 1) & (UART_RX_BUFFER - 1);
+    return c;
 }
 
 /**
  * @brief This function forwards UART receive function to STDIO output and invoked whenever a bit is received from UART. 
- * The received bit will be returned when getchar function is invoked. 
+ * The received bit will be returned when getchar function is invoked. Before interrupts are enabled at startup, the data register is read directly, and buffered output is written while waiting. 
  * @param stream The STDIO stream. 
  * @return The received character from raspberry pi. 
 */
 char uart_getchar(FILE *stream) 
 {
-    loop_until_bit_is_set(UCSR0A, RXC0); 
-    return UDR0;
+    if (!(SREG & _BV(SREG_I)))
+    {
+        while (bit_is_clear(UCSR0A, RXC0))
+        {
+            if (bit_is_set(UCSR0A, UDRE0)) // write the prompt meanwhile
+                uartTransmitInterrupt();
+        }
+        return UDR0;
+    }
+    int c;
+    while ((c = uartReadByte()) < 0);
+    return c;
 }
 
 /**
@@ -64,5 +163,5 @@ void uart_init(void)
     UBRR0L = UBRRL_VALUE;
     UCSR0A &= ~(_BV(U2X0)); // set single channel
     UCSR0C = _BV(UCSZ01) | _BV(UCSZ00); // set 8 bit data 1 stop bit
-    UCSR0B = _BV(RXEN0) | _BV(TXEN0);   // enable receiver and transmitter
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);   // enable receiver, transmitter and receive complete interrupt
 }
@@ -1,6 +1,22 @@
+#ifndef UART_TX_BUFFER
+#define UART_TX_BUFFER 64 ///< This denotes how many bytes of output are buffered. It must be a power of 2 up to 128. 
+#endif
+#ifndef UART_RX_BUFFER
+#define UART_RX_BUFFER 32 ///< This denotes how many bytes of input are buffered. It must be a power of 2 up to 128. 
+#endif
 
 void uart_putchar(char c, FILE *stream);
 
+void uart_write(unsigned char c);
+
+void uartTransmitInterrupt();
+
+void uartReceiveInterrupt();
+
+unsigned char uartAvailable();
+
+int uartReadByte();
+
 char uart_getchar(FILE *stream);
 
-void uart_init(void);
\ No newline at end of file
+void uart_init(void);